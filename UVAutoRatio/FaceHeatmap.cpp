@@ -0,0 +1,163 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "MayaUtility.h"
+#include "ThreadUtility.h"
+#include "FaceHeatmap.h"
+
+// Faces measured per thread pool task
+static const int FaceGrainSize = 4096;
+
+// Shared with the thread pool tasks, every task writes to its own range of ratios
+struct MeasureRatiosData
+{
+	const MeshFaceData*				faceData;
+	const MFloatArray*				uArray;
+	const MFloatArray*				vArray;
+	const std::vector<double>*		surfaceAreas;
+	const MIntArray*				faces;
+	double*							ratios;
+};
+
+static void
+MeasureRatiosRange(void* data, int begin, int end)
+{
+	MeasureRatiosData& measure = *(MeasureRatiosData*)data;
+	for (int i = begin; i < end; i++)
+	{
+		int face = (*measure.faces)[i];
+
+		double surfaceArea, uvArea;
+		if (face < (int)measure.surfaceAreas->size() && (*measure.surfaceAreas)[face] >= 0.0)
+		{
+			surfaceArea = (*measure.surfaceAreas)[face];
+			uvArea = GetFaceUVArea(*measure.faceData, *measure.uArray, *measure.vArray, face);
+		}
+		else
+		{
+			GetFaceAreas(*measure.faceData, *measure.uArray, *measure.vArray, face, surfaceArea, uvArea);
+		}
+
+		measure.ratios[i] = 0.0;
+		if (uvArea > 0.0)
+		{
+			measure.ratios[i] = surfaceArea / uvArea;
+		}
+	}
+}
+
+FaceHeatmap::FaceHeatmap()
+{
+}
+
+const MColor&
+FaceHeatmap::GetPaletteColour(int index)
+{
+	// Blue to green then green to red, built the first time it's needed
+	static MColor palette[PaletteSize];
+	static bool isPaletteBuilt = false;
+	if (!isPaletteBuilt)
+	{
+		MColor blue(0.0f, 0.0f, 1.0f, 1.0f);
+		MColor green(0.0f, 1.0f, 0.0f, 1.0f);
+		MColor red(1.0f, 0.0f, 0.0f, 1.0f);
+		int halfSize = PaletteSize / 2;
+		for (int i = 0; i < halfSize; i++)
+		{
+			float t = (float)i / (float)halfSize;
+			palette[i] = Lerp(blue, green, t);
+			palette[halfSize + i] = Lerp(green, red, t);
+		}
+		isPaletteBuilt = true;
+	}
+	return palette[index];
+}
+
+void
+FaceHeatmap::MeasureRatios(const MeshFaceData& faceData, const MFloatArray& uArray, const MFloatArray& vArray, const std::vector<double>& surfaceAreas, const MIntArray& faces, std::vector<double>& ratios)
+{
+	int numFaces = (int)faces.length();
+	ratios.assign(numFaces, 0.0);
+	if (numFaces == 0)
+		return;
+
+	MeasureRatiosData measure;
+	measure.faceData = &faceData;
+	measure.uArray = &uArray;
+	measure.vArray = &vArray;
+	measure.surfaceAreas = &surfaceAreas;
+	measure.faces = &faces;
+	measure.ratios = &ratios[0];
+	ParallelFor(numFaces, FaceGrainSize, MeasureRatiosRange, &measure);
+}
+
+void
+FaceHeatmap::AddFaces(const MIntArray& faces, const std::vector<double>& ratios, double referenceRatio)
+{
+	int numFaces = (int)faces.length();
+	if (numFaces == 0)
+		return;
+
+	if (referenceRatio <= 0.0)
+	{
+		double totalRatio = 0.0;
+		for (int i = 0; i < numFaces; i++)
+		{
+			totalRatio += ratios[i];
+		}
+		referenceRatio = totalRatio / (double)numFaces;
+	}
+
+	// Faces at or below the bottom of the range, including faces without UV area, are black
+	double distance = referenceRatio * 0.8;
+	double minRatio = referenceRatio - distance;
+	double maxRatio = referenceRatio + distance;
+
+	uint offset = m_faces.length();
+	m_faces.setLength(offset + numFaces);
+	m_colours.setLength(offset + numFaces);
+	for (int i = 0; i < numFaces; i++)
+	{
+		m_faces[offset + i] = faces[i];
+
+		double ratio = ratios[i];
+		if (ratio > minRatio && maxRatio > minRatio)
+		{
+			if (ratio > maxRatio)
+				ratio = maxRatio;
+			double t = (ratio - minRatio) / (maxRatio - minRatio);
+			m_colours[offset + i] = GetPaletteColour((int)(t * (PaletteSize - 1)));
+		}
+		else
+		{
+			m_colours[offset + i] = MColor(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+}
+
+MStatus
+FaceHeatmap::Apply(MFnMesh& mesh)
+{
+	if (m_faces.length() == 0)
+		return MS::kSuccess;
+
+	return mesh.setFaceColors(m_colours, m_faces);
+}
+
+void
+FaceHeatmap::Clear()
+{
+	m_colours.clear();
+	m_faces.clear();
+}
@@ -0,0 +1,50 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef FACEHEATMAP_H
+#define FACEHEATMAP_H
+
+#include <vector>
+#include "Utility.h"
+
+// Colours faces by their surface/UV ratio relative to a reference ratio,
+// from blue below it through green to red above it.  Faces are added in
+// groups, each with its own reference, and the whole mesh is written with
+// one setFaceColors call.
+class FaceHeatmap
+{
+public:
+	FaceHeatmap();
+
+	// Measures the ratio of each face.  Surface areas already measured during
+	// gather are reused, a negative cached area means the face still needs measuring.
+	static void	MeasureRatios(const MeshFaceData& faceData, const MFloatArray& uArray, const MFloatArray& vArray, const std::vector<double>& surfaceAreas, const MIntArray& faces, std::vector<double>& ratios);
+
+	// Colours the faces relative to referenceRatio, or to the average face ratio of the group if it is 0
+	void		AddFaces(const MIntArray& faces, const std::vector<double>& ratios, double referenceRatio);
+	MStatus		Apply(MFnMesh& mesh);
+	void		Clear();
+
+private:
+	enum
+	{
+		PaletteSize = 64,
+	};
+
+	static const MColor&	GetPaletteColour(int index);
+
+	MColorArray		m_colours;
+	MIntArray		m_faces;
+};
+
+#endif
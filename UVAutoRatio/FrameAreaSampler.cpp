@@ -0,0 +1,214 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include <maya/MDGContext.h>
+#include "ThreadUtility.h"
+#include "FrameAreaSampler.h"
+
+// Faces measured per thread pool task
+static const int FaceGrainSize = 4096;
+
+// Shared with the thread pool tasks, every task writes to its own range of areas
+struct MeasureFrameData
+{
+	const MeshFaceData*		faceData;
+	const MPointArray*		points;
+	double*					areas;
+};
+
+static void
+MeasureFrameRange(void* data, int begin, int end)
+{
+	MeasureFrameData& measure = *(MeasureFrameData*)data;
+	for (int i = begin; i < end; i++)
+	{
+		measure.areas[i] = GetFaceSurfaceArea(*measure.faceData, *measure.points, i);
+	}
+}
+
+FrameAreaSampler::FrameAreaSampler()
+{
+	m_numFrames = 0;
+	m_numFaces = 0;
+}
+
+void
+FrameAreaSampler::GetFrameTimes(double startFrame, double endFrame, double frameStep, std::vector<MTime>& times)
+{
+	times.clear();
+	if (frameStep <= 0.0 || endFrame < startFrame)
+		return;
+
+	// Step by index so rounding doesn't drop the end frame
+	int numFrames = (int)floor((endFrame - startFrame) / frameStep + 0.0001) + 1;
+	times.reserve(numFrames);
+	for (int i = 0; i < numFrames; i++)
+	{
+		times.push_back(MTime(startFrame + i * frameStep, MTime::uiUnit()));
+	}
+}
+
+bool
+FrameAreaSampler::Sample(const MDagPath& dagPath, const MeshFaceData& faceData, const std::vector<MTime>& times)
+{
+	MStatus status;
+
+	Clear();
+
+	int numFaces = (int)faceData.faceVertexCounts.length();
+	if (numFaces == 0 || times.empty() || (int)faceData.triangleCounts.length() != numFaces)
+		return false;
+
+	// The world mesh of this instance has the transform applied, so animated transforms are sampled too
+	MFnDagNode dagNode(dagPath, &status);
+	if (status != MS::kSuccess)
+		return false;
+
+	MPlug worldMeshPlug = dagNode.findPlug("worldMesh", &status);
+	if (status != MS::kSuccess)
+		return false;
+	worldMeshPlug = worldMeshPlug.elementByLogicalIndex(dagPath.instanceNumber(), &status);
+	if (status != MS::kSuccess)
+		return false;
+
+	int numFrames = (int)times.size();
+	m_faceAreas.resize((size_t)numFrames * numFaces);
+
+	MPointArray points;
+	for (int i = 0; i < numFrames; i++)
+	{
+		MDGContext context(times[i]);
+		MObject meshData;
+		status = worldMeshPlug.getValue(meshData, context);
+		if (status != MS::kSuccess)
+			break;
+
+		MFnMesh frameMesh(meshData, &status);
+		if (status != MS::kSuccess)
+			break;
+
+		// Deformers move points but a change of topology would invalidate the triangulation
+		status = frameMesh.getPoints(points, MSpace::kWorld);
+		if (status != MS::kSuccess || points.length() != faceData.points.length())
+		{
+			status = MS::kFailure;
+			break;
+		}
+
+		MeasureFrameData measure;
+		measure.faceData = &faceData;
+		measure.points = &points;
+		measure.areas = &m_faceAreas[(size_t)i * numFaces];
+		ParallelFor(numFaces, FaceGrainSize, MeasureFrameRange, &measure);
+	}
+
+	if (status != MS::kSuccess)
+	{
+		Clear();
+		return false;
+	}
+
+	m_numFrames = numFrames;
+	m_numFaces = numFaces;
+	return true;
+}
+
+bool
+FrameAreaSampler::IsSampled() const
+{
+	return (m_numFrames > 0);
+}
+
+int
+FrameAreaSampler::GetNumFrames() const
+{
+	return m_numFrames;
+}
+
+void
+FrameAreaSampler::AddFrameAreas(const MIntArray* faces, std::vector<double>& frameAreas) const
+{
+	if ((int)frameAreas.size() != m_numFrames)
+	{
+		frameAreas.assign(m_numFrames, 0.0);
+	}
+
+	int numFaces = faces ? (int)faces->length() : m_numFaces;
+	for (int i = 0; i < m_numFrames; i++)
+	{
+		const double* areas = &m_faceAreas[(size_t)i * m_numFaces];
+
+		double area = 0.0;
+		for (int j = 0; j < numFaces; j++)
+		{
+			int face = faces ? (*faces)[j] : j;
+			if (face < m_numFaces)
+				area += areas[face];
+		}
+		frameAreas[i] += area;
+	}
+}
+
+double
+FrameAreaSampler::GetFacesArea(const MIntArray* faces, FrameStatistic statistic) const
+{
+	std::vector<double> frameAreas;
+	AddFrameAreas(faces, frameAreas);
+	return GetStatistic(frameAreas, statistic);
+}
+
+void
+FrameAreaSampler::GetStatistics(const std::vector<double>& frameAreas, double& minArea, double& meanArea, double& maxArea)
+{
+	minArea = meanArea = maxArea = 0.0;
+	if (frameAreas.empty())
+		return;
+
+	minArea = maxArea = frameAreas[0];
+	double total = 0.0;
+	for (size_t i = 0; i < frameAreas.size(); i++)
+	{
+		minArea = std::min(minArea, frameAreas[i]);
+		maxArea = std::max(maxArea, frameAreas[i]);
+		total += frameAreas[i];
+	}
+	meanArea = total / (double)frameAreas.size();
+}
+
+double
+FrameAreaSampler::GetStatistic(const std::vector<double>& frameAreas, FrameStatistic statistic)
+{
+	double minArea, meanArea, maxArea;
+	GetStatistics(frameAreas, minArea, meanArea, maxArea);
+	switch (statistic)
+	{
+	case FrameMinimum:
+		return minArea;
+	case FrameMaximum:
+		return maxArea;
+	case FrameMean:
+		break;
+	}
+	return meanArea;
+}
+
+void
+FrameAreaSampler::Clear()
+{
+	m_numFrames = 0;
+	m_numFaces = 0;
+
+	std::vector<double> empty;
+	m_faceAreas.swap(empty);
+}
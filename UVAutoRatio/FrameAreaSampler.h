@@ -0,0 +1,61 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef FRAMEAREASAMPLER_H
+#define FRAMEAREASAMPLER_H
+
+#include <vector>
+#include <maya/MTime.h>
+#include "Utility.h"
+
+enum FrameStatistic
+{
+	FrameMinimum,
+	FrameMean,
+	FrameMaximum,
+};
+
+// Measures the surface area of every face of a deforming mesh over a range
+// of frames.  The mesh is evaluated in a DG context for each frame instead of
+// changing the scene time, and only the points are read back since the
+// topology, and so Maya's triangulation in the MeshFaceData, stays the same.
+class FrameAreaSampler
+{
+public:
+	FrameAreaSampler();
+
+	// Frames from start to end inclusive, in the UI time unit
+	static void	GetFrameTimes(double startFrame, double endFrame, double frameStep, std::vector<MTime>& times);
+
+	// Needs MeshFaceData::BuildTriangles, returns false if any frame has a different topology
+	bool		Sample(const MDagPath& dagPath, const MeshFaceData& faceData, const std::vector<MTime>& times);
+	bool		IsSampled() const;
+	int			GetNumFrames() const;
+
+	// Adds the surface area of the faces (all of them if faces is NULL) at each frame to frameAreas
+	void		AddFrameAreas(const MIntArray* faces, std::vector<double>& frameAreas) const;
+	double		GetFacesArea(const MIntArray* faces, FrameStatistic statistic) const;
+
+	static void	GetStatistics(const std::vector<double>& frameAreas, double& minArea, double& meanArea, double& maxArea);
+	static double	GetStatistic(const std::vector<double>& frameAreas, FrameStatistic statistic);
+
+	void		Clear();
+
+private:
+	int					m_numFrames;
+	int					m_numFaces;
+	std::vector<double>	m_faceAreas;	// Frame by frame, m_numFaces per frame
+};
+
+#endif
+
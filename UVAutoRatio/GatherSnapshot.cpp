@@ -0,0 +1,382 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "GatherSnapshot.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char SnapshotMagic[8] = { 'U', 'V', 'A', 'R', 'S', 'N', 'A', 'P' };
+
+// Appends an array to the data section, padded so the next array stays aligned,
+// and returns its offset from the start of the data section
+static unsigned int
+AppendData(std::vector<char>& data, const void* source, size_t size)
+{
+	size_t offset = data.size();
+	size_t paddedSize = (size + 7) & ~(size_t)7;
+	data.resize(offset + paddedSize, 0);
+	if (source != NULL && size > 0)
+	{
+		memcpy(&data[offset], source, size);
+	}
+	return (unsigned int)offset;
+}
+
+static unsigned int
+AppendFloats(std::vector<char>& data, const MFloatArray& values)
+{
+	unsigned int offset = AppendData(data, NULL, values.length() * sizeof(float));
+	if (values.length() > 0)
+	{
+		values.get((float*)&data[offset]);
+	}
+	return offset;
+}
+
+static unsigned int
+AppendString(std::vector<char>& data, const MString& text)
+{
+	return AppendData(data, text.asChar(), text.length());
+}
+
+GatherSnapshot::GatherSnapshot()
+{
+	m_data = NULL;
+	m_size = 0;
+#ifdef WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#else
+	m_file = -1;
+#endif
+}
+
+GatherSnapshot::~GatherSnapshot()
+{
+	Close();
+}
+
+bool
+GatherSnapshot::Save(const MString& path, const std::vector<Mesh*>& meshes, OperationMode operationMode)
+{
+	std::vector<MeshRecord> meshRecords;
+	std::vector<JobRecord> jobRecords;
+	std::vector<char> data;
+	meshRecords.reserve(meshes.size());
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Mesh& mesh = *meshes[i];
+
+		MeshRecord meshRecord;
+		meshRecord.nameOffset = AppendString(data, mesh.name);
+		meshRecord.nameLength = mesh.name.length();
+		meshRecord.uvSetNameOffset = AppendString(data, mesh.requestedUVSetName);
+		meshRecord.uvSetNameLength = mesh.requestedUVSetName.length();
+		meshRecord.numUVs = mesh.uArray.length();
+		meshRecord.uOffset = AppendFloats(data, mesh.uArray);
+		meshRecord.vOffset = AppendFloats(data, mesh.vArray);
+		meshRecord.numUVIndices = (unsigned int)mesh.uvIndexBuffer.size();
+		meshRecord.uvIndexOffset = AppendData(data, meshRecord.numUVIndices ? &mesh.uvIndexBuffer[0] : NULL, meshRecord.numUVIndices * sizeof(int));
+		meshRecord.firstJob = (unsigned int)jobRecords.size();
+		meshRecord.numJobs = (unsigned int)mesh.m_jobs.size();
+		meshRecord.error = (int)mesh.error;
+		meshRecords.push_back(meshRecord);
+
+		for (size_t j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			const UVJob& job = *mesh.m_jobs[j];
+
+			JobRecord jobRecord;
+			jobRecord.surfaceArea = job.surfaceArea;
+			jobRecord.textureArea = job.textureArea;
+			jobRecord.centerU = job.centerU;
+			jobRecord.centerV = job.centerV;
+			jobRecord.uvWidth = job.uvWidth;
+			jobRecord.uvHeight = job.uvHeight;
+			jobRecord.error = (int)job.error;
+			jobRecord.meshShellNumber = 0;
+			jobRecord.firstUVIndex = 0;
+			jobRecord.numUVIndices = 0;
+			if (operationMode == UVShellLevel)
+			{
+				const ShellJob& shellJob = (const ShellJob&)job;
+				jobRecord.meshShellNumber = shellJob.meshShellNumber;
+				if (shellJob.uvIndices != NULL && meshRecord.numUVIndices > 0)
+				{
+					jobRecord.firstUVIndex = (unsigned int)(shellJob.uvIndices - &mesh.uvIndexBuffer[0]);
+					jobRecord.numUVIndices = shellJob.numIndices;
+				}
+			}
+			jobRecords.push_back(jobRecord);
+		}
+	}
+
+	// Data offsets become file offsets once the size of the records is known
+	size_t dataOffset = sizeof(Header) + meshRecords.size() * sizeof(MeshRecord) + jobRecords.size() * sizeof(JobRecord);
+	size_t fileSize = dataOffset + data.size();
+	if (fileSize > 0xffffffffu)
+		return false;
+
+	for (size_t i = 0; i < meshRecords.size(); i++)
+	{
+		MeshRecord& meshRecord = meshRecords[i];
+		meshRecord.nameOffset += (unsigned int)dataOffset;
+		meshRecord.uvSetNameOffset += (unsigned int)dataOffset;
+		meshRecord.uOffset += (unsigned int)dataOffset;
+		meshRecord.vOffset += (unsigned int)dataOffset;
+		meshRecord.uvIndexOffset += (unsigned int)dataOffset;
+	}
+
+	Header header;
+	memcpy(header.magic, SnapshotMagic, sizeof(header.magic));
+	header.version = Version;
+	header.operationMode = (unsigned int)operationMode;
+	header.numMeshes = (unsigned int)meshRecords.size();
+	header.numJobs = (unsigned int)jobRecords.size();
+	header.fileSize = (unsigned int)fileSize;
+	header.reserved = 0;
+
+	FILE* file = NULL;
+#ifdef WIN32
+	if (fopen_s(&file, path.asChar(), "wb") != 0)
+		file = NULL;
+#else
+	file = fopen(path.asChar(), "wb");
+#endif
+	if (file == NULL)
+		return false;
+
+	bool result = (fwrite(&header, sizeof(header), 1, file) == 1);
+	if (result && !meshRecords.empty())
+		result = (fwrite(&meshRecords[0], sizeof(MeshRecord), meshRecords.size(), file) == meshRecords.size());
+	if (result && !jobRecords.empty())
+		result = (fwrite(&jobRecords[0], sizeof(JobRecord), jobRecords.size(), file) == jobRecords.size());
+	if (result && !data.empty())
+		result = (fwrite(&data[0], 1, data.size(), file) == data.size());
+
+	fclose(file);
+	return result;
+}
+
+bool
+GatherSnapshot::Open(const MString& path)
+{
+	Close();
+
+	if (!Map(path))
+		return false;
+
+	// Check the header and that every record and array lies inside the file
+	bool isValid = (m_size >= sizeof(Header));
+	if (isValid)
+	{
+		const Header& header = *(const Header*)m_data;
+		isValid = (memcmp(header.magic, SnapshotMagic, sizeof(header.magic)) == 0 &&
+					header.version == Version &&
+					header.fileSize == m_size &&
+					(header.operationMode == ObjectLevel || header.operationMode == UVShellLevel));
+
+		size_t recordsSize = sizeof(Header) + (size_t)header.numMeshes * sizeof(MeshRecord) + (size_t)header.numJobs * sizeof(JobRecord);
+		isValid = isValid && (recordsSize <= m_size);
+
+		for (unsigned int i = 0; isValid && i < header.numMeshes; i++)
+		{
+			const MeshRecord& mesh = GetMesh(i);
+			isValid = ((size_t)mesh.nameOffset + mesh.nameLength <= m_size &&
+						(size_t)mesh.uvSetNameOffset + mesh.uvSetNameLength <= m_size &&
+						(size_t)mesh.uOffset + (size_t)mesh.numUVs * sizeof(float) <= m_size &&
+						(size_t)mesh.vOffset + (size_t)mesh.numUVs * sizeof(float) <= m_size &&
+						(size_t)mesh.uvIndexOffset + (size_t)mesh.numUVIndices * sizeof(int) <= m_size &&
+						(size_t)mesh.firstJob + mesh.numJobs <= header.numJobs);
+
+			for (unsigned int j = 0; isValid && j < mesh.numJobs; j++)
+			{
+				const JobRecord& job = GetJob(mesh.firstJob + j);
+				isValid = ((size_t)job.firstUVIndex + job.numUVIndices <= mesh.numUVIndices);
+			}
+
+			// The shell UV indices are used to index the UVs
+			const int* uvIndices = GetInts(mesh.uvIndexOffset);
+			for (unsigned int j = 0; isValid && j < mesh.numUVIndices; j++)
+			{
+				isValid = (uvIndices[j] >= 0 && (unsigned int)uvIndices[j] < mesh.numUVs);
+			}
+		}
+	}
+
+	if (!isValid)
+	{
+		Close();
+	}
+	return isValid;
+}
+
+void
+GatherSnapshot::Close()
+{
+	Unmap();
+}
+
+bool
+GatherSnapshot::IsOpen() const
+{
+	return (m_data != NULL);
+}
+
+OperationMode
+GatherSnapshot::GetOperationMode() const
+{
+	return (OperationMode)((const Header*)m_data)->operationMode;
+}
+
+unsigned int
+GatherSnapshot::GetNumMeshes() const
+{
+	return ((const Header*)m_data)->numMeshes;
+}
+
+const GatherSnapshot::MeshRecord&
+GatherSnapshot::GetMesh(unsigned int index) const
+{
+	const MeshRecord* meshes = (const MeshRecord*)(m_data + sizeof(Header));
+	return meshes[index];
+}
+
+const GatherSnapshot::JobRecord&
+GatherSnapshot::GetJob(unsigned int index) const
+{
+	const Header& header = *(const Header*)m_data;
+	const JobRecord* jobs = (const JobRecord*)(m_data + sizeof(Header) + header.numMeshes * sizeof(MeshRecord));
+	return jobs[index];
+}
+
+MString
+GatherSnapshot::GetString(unsigned int offset, unsigned int length) const
+{
+	return MString(m_data + offset, (int)length);
+}
+
+const float*
+GatherSnapshot::GetFloats(unsigned int offset) const
+{
+	return (const float*)(m_data + offset);
+}
+
+const int*
+GatherSnapshot::GetInts(unsigned int offset) const
+{
+	return (const int*)(m_data + offset);
+}
+
+#ifdef WIN32
+
+bool
+GatherSnapshot::Map(const MString& path)
+{
+	m_file = CreateFileA(path.asChar(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0 || size.QuadPart > 0xffffffff)
+	{
+		Unmap();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping != NULL)
+	{
+		m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (m_data == NULL)
+	{
+		Unmap();
+		return false;
+	}
+	m_size = (unsigned int)size.QuadPart;
+	return true;
+}
+
+void
+GatherSnapshot::Unmap()
+{
+	if (m_data != NULL)
+	{
+		UnmapViewOfFile(m_data);
+		m_data = NULL;
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+	m_size = 0;
+}
+
+#else
+
+bool
+GatherSnapshot::Map(const MString& path)
+{
+	m_file = open(path.asChar(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(m_file, &status) != 0 || status.st_size == 0 || (unsigned long long)status.st_size > 0xffffffffULL)
+	{
+		Unmap();
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		Unmap();
+		return false;
+	}
+	m_data = (const char*)data;
+	m_size = (unsigned int)status.st_size;
+	return true;
+}
+
+void
+GatherSnapshot::Unmap()
+{
+	if (m_data != NULL)
+	{
+		munmap((void*)m_data, m_size);
+		m_data = NULL;
+	}
+	if (m_file >= 0)
+	{
+		close(m_file);
+		m_file = -1;
+	}
+	m_size = 0;
+}
+
+#endif
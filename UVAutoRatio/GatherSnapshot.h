@@ -0,0 +1,115 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef GATHERSNAPSHOT_H
+#define GATHERSNAPSHOT_H
+
+#include <vector>
+#include "ShellProcessor.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+// A versioned binary dump of everything gather measured: the areas and
+// bounds of every job plus each mesh's UVs and shell UV indices.  Reading
+// a snapshot memory maps the file, so a run can be solved, laid out and
+// timed again without the scene.
+//
+// The file is the header, then a record per mesh, then a record per job,
+// then the arrays they point at.  Offsets are from the start of the file
+// and every array starts on an 8 byte boundary.
+class GatherSnapshot
+{
+public:
+	enum
+	{
+		Version = 1,
+	};
+
+	struct Header
+	{
+		char			magic[8];
+		unsigned int	version;
+		unsigned int	operationMode;
+		unsigned int	numMeshes;
+		unsigned int	numJobs;
+		unsigned int	fileSize;
+		unsigned int	reserved;
+	};
+
+	struct MeshRecord
+	{
+		unsigned int	nameOffset;
+		unsigned int	nameLength;
+		unsigned int	uvSetNameOffset;
+		unsigned int	uvSetNameLength;
+		unsigned int	uOffset;
+		unsigned int	vOffset;
+		unsigned int	numUVs;
+		unsigned int	uvIndexOffset;
+		unsigned int	numUVIndices;
+		unsigned int	firstJob;
+		unsigned int	numJobs;
+		int				error;
+	};
+
+	struct JobRecord
+	{
+		double			surfaceArea, textureArea;
+		double			centerU, centerV;
+		double			uvWidth, uvHeight;
+		int				error;
+		int				meshShellNumber;
+		unsigned int	firstUVIndex;
+		unsigned int	numUVIndices;
+	};
+
+	GatherSnapshot();
+	~GatherSnapshot();
+
+	// Writes the gathered data of the meshes, which must not have been released yet
+	static bool		Save(const MString& path, const std::vector<Mesh*>& meshes, OperationMode operationMode);
+
+	bool			Open(const MString& path);
+	void			Close();
+	bool			IsOpen() const;
+
+	OperationMode		GetOperationMode() const;
+	unsigned int		GetNumMeshes() const;
+	const MeshRecord&	GetMesh(unsigned int index) const;
+	const JobRecord&	GetJob(unsigned int index) const;
+	MString				GetString(unsigned int offset, unsigned int length) const;
+	const float*		GetFloats(unsigned int offset) const;
+	const int*			GetInts(unsigned int offset) const;
+
+private:
+	GatherSnapshot(const GatherSnapshot&);
+	GatherSnapshot& operator = (const GatherSnapshot&);
+
+	bool			Map(const MString& path);
+	void			Unmap();
+
+	const char*		m_data;
+	unsigned int	m_size;
+
+#ifdef WIN32
+	HANDLE			m_file;
+	HANDLE			m_mapping;
+#else
+	int				m_file;
+#endif
+};
+
+#endif
+
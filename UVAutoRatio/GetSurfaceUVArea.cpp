@@ -12,13 +12,16 @@
 //
 
 #include "MayaPCH.h"
+#include <maya/MAnimControl.h>
 #include "MayaUtility.h"
 #include "Utility.h"
+#include "ThreadUtility.h"
 #include "GetSurfaceUVArea.h"
 
 using namespace std;
 
 static const char* error_minimumSelection = "Something must be selected";
+static const char* error_frameRange = "The end frame must not be before the start frame";
 
 const char* GetSurfaceUVArea::GetSurfaceUVArea_Help[] = {
 	" GetSurfaceUVArea Help\n",
@@ -26,11 +29,75 @@ const char* GetSurfaceUVArea::GetSurfaceUVArea_Help[] = {
 	"\t-help       (-hlp) This gets printed\n",
 	"\t-uvSetName  (-us)  [string] The name of the UV set to use (optional)\n",
 	"\t-fallback   (-fb)  If the named UV set is not found in a mesh, use the default UV set instead of skipping it (optional)\n",
+	"\t-startFrame (-sf)  [double] Measure the surface area over a frame range starting at this frame, defaults to the playback start (optional)\n",
+	"\t-endFrame   (-ef)  [double] Measure the surface area over a frame range ending at this frame, defaults to the playback end (optional)\n",
+	"\t-frameStep  (-fst) [double] Frames between samples of the frame range (optional), default 1\n",
+	"\t-perObject  (-po)  Return the surface area, UV area and ratio of each object (optional)\n",
+	"\t-perShell   (-psh) Return the object index, shell, surface area, UV area and ratio of each UV shell (optional)\n",
+	"\t-objectNames (-on) Return the names of the objects -perObject and -perShell measure instead, in the same order, without measuring them (optional)\n",
 	"\n"
 };
 
 unsigned int GetSurfaceUVArea::helpLineCount = sizeof(GetSurfaceUVArea_Help)/sizeof(GetSurfaceUVArea_Help[0]);
 
+// Objects read from Maya before they are measured together, bounds the memory held for large scenes
+static const int ObjectBatchSize = 256;
+
+// Everything needed to measure one object away from the main thread.
+// The areas are per UV shell when measuring shells, otherwise there is one entry.
+struct ObjectAreas
+{
+	MDagPath		dagPath;
+	MeshFaceData	faceData;
+	MFloatArray		uArray, vArray;
+	MIntArray		faces;
+	MIntArray		faceGroups;
+	int				numGroups;
+
+	std::vector<double>	surfaceAreas;
+	std::vector<double>	uvAreas;
+	std::vector<int>	numFaces;
+};
+
+// Each thread pool task measures whole objects, so tasks never share an object
+static void
+MeasureObjectsRange(void* data, int begin, int end)
+{
+	ObjectAreas** objects = (ObjectAreas**)data;
+	for (int i = begin; i < end; i++)
+	{
+		ObjectAreas& object = *objects[i];
+		object.surfaceAreas.assign(object.numGroups, 0.0);
+		object.uvAreas.assign(object.numGroups, 0.0);
+		object.numFaces.assign(object.numGroups, 0);
+
+		int numFaces = (int)object.faces.length();
+		for (int j = 0; j < numFaces; j++)
+		{
+			int group = object.faceGroups[j];
+			if (group < 0)
+				continue;
+
+			double surfaceArea, uvArea;
+			GetFaceAreas(object.faceData, object.uArray, object.vArray, object.faces[j], surfaceArea, uvArea);
+			object.surfaceAreas[group] += surfaceArea;
+			object.uvAreas[group] += uvArea;
+			object.numFaces[group]++;
+		}
+	}
+}
+
+static double
+GetRatio(double surfaceArea, double uvArea)
+{
+	double ratio = 1.0;
+	if (surfaceArea != 0.0 && uvArea != 0.0)
+	{
+		ratio = surfaceArea / uvArea;
+	}
+	return ratio;
+}
+
 
 GetSurfaceUVArea::GetSurfaceUVArea()
 {
@@ -38,6 +105,13 @@ GetSurfaceUVArea::GetSurfaceUVArea()
 	m_isFallback = true;
 	m_isUVSetOverride = false;
 	m_reportZeroAreas = false;
+	m_isFrameRange = false;
+	m_startFrame = 0.0;
+	m_endFrame = 0.0;
+	m_frameStep = 1.0;
+	m_isPerObject = false;
+	m_isPerShell = false;
+	m_isObjectNames = false;
 }
 
 GetSurfaceUVArea::~GetSurfaceUVArea()
@@ -73,6 +147,12 @@ GetSurfaceUVArea::newSyntax()
 	syntax.addFlag("-fb", "-fallback");
 	syntax.addFlag("-za", "-zeroArea");
 	syntax.addFlag("-us", "-uvSetName",MSyntax::kString);
+	syntax.addFlag("-sf", "-startFrame", MSyntax::kDouble);
+	syntax.addFlag("-ef", "-endFrame", MSyntax::kDouble);
+	syntax.addFlag("-fst", "-frameStep", MSyntax::kDouble);
+	syntax.addFlag("-po", "-perObject");
+	syntax.addFlag("-psh", "-perShell");
+	syntax.addFlag("-on", "-objectNames");
 
 	syntax.useSelectionAsDefault(false);
 	syntax.enableQuery(false);
@@ -88,12 +168,31 @@ GetSurfaceUVArea::ParseArguments(const MArgList& args)
 	m_isHelp = argData.isFlagSet("-help");
 	m_isFallback = argData.isFlagSet("-fallback");
 	m_reportZeroAreas = argData.isFlagSet("-zeroArea");
+	m_isPerShell = argData.isFlagSet("-perShell");
+	m_isObjectNames = argData.isFlagSet("-objectNames");
+	m_isPerObject = argData.isFlagSet("-perObject") || m_isPerShell || m_isObjectNames;
 
 	if (getArgValue(argData, "-us", "-uvSetName", m_UVSetName))
 	{
 		m_isUVSetOverride = true;
 	}
 
+	// A frame range is used if either end of it is given, the other end comes from the playback range
+	m_startFrame = MAnimControl::minTime().as(MTime::uiUnit());
+	m_endFrame = MAnimControl::maxTime().as(MTime::uiUnit());
+	bool hasStart = getArgValue(argData, "-sf", "-startFrame", m_startFrame);
+	bool hasEnd = getArgValue(argData, "-ef", "-endFrame", m_endFrame);
+	m_isFrameRange = (hasStart || hasEnd);
+	if (m_isFrameRange)
+	{
+		getArgValue(argData, "-fst", "-frameStep", m_frameStep);
+		m_frameStep = ClampDouble(0.001, DBL_MAX, m_frameStep);
+		if (m_endFrame < m_startFrame)
+		{
+			return error_frameRange;
+		}
+	}
+
 	return NULL;
 }
 
@@ -182,9 +281,24 @@ GetSurfaceUVArea::doIt( const MArgList& args )
 		selection.add(selections[i]);
 	}
 
+	if (m_isPerObject)
+	{
+		MeasureObjects(selection);
+		return MS::kSuccess;
+	}
+
 	double uvArea = 0.0;
 	double surfaceArea = 0.0;
 
+	// Total surface area of the selection at each frame of the range
+	std::vector<MTime> times;
+	std::vector<double> frameAreas;
+	if (m_isFrameRange)
+	{
+		FrameAreaSampler::GetFrameTimes(m_startFrame, m_endFrame, m_frameStep, times);
+		frameAreas.assign(times.size(), 0.0);
+	}
+
 	// Process the selection
 	MItSelectionList iter(selection);
 	for ( ; !iter.isDone(); iter.next() )
@@ -205,6 +319,13 @@ GetSurfaceUVArea::doIt( const MArgList& args )
 			MFnMesh mesh(dagPath);
 			if (FindMeshUVSetName(mesh, m_isUVSetOverride, m_isFallback, &desiredUVSetName))
 			{
+				// Without its surface area over the frames, the mesh's UV area would skew the ratios
+				if (m_isFrameRange && !SampleFrames(dagPath, component, desiredUVSetName, times, frameAreas))
+				{
+					displayWarning("Could not measure " + dagPath.partialPathName() + " over the frame range, its topology changes, it is left out");
+					continue;
+				}
+
 				// Accumulate areas
 				uvArea += GetAreaFacesUV(dagPath, component, desiredUVSetName);
 				surfaceArea += GetAreaFacesSurface(dagPath, component, true);
@@ -212,10 +333,21 @@ GetSurfaceUVArea::doIt( const MArgList& args )
 		}
 	}
 
+	double minSurfaceArea = surfaceArea;
+	double maxSurfaceArea = surfaceArea;
+	if (m_isFrameRange)
+	{
+		FrameAreaSampler::GetStatistics(frameAreas, minSurfaceArea, surfaceArea, maxSurfaceArea);
+	}
+
 	double ratio = 1.0;
+	double minRatio = 1.0;
+	double maxRatio = 1.0;
 	if (surfaceArea != 0.0 && uvArea != 0.0)
 	{
 		ratio = surfaceArea / uvArea;
+		minRatio = minSurfaceArea / uvArea;
+		maxRatio = maxSurfaceArea / uvArea;
 	}
 
 	// Due to Maya's lack of precision when returning doubles, we need to convert to strings...
@@ -223,6 +355,13 @@ GetSurfaceUVArea::doIt( const MArgList& args )
 	appendToResult(surfaceArea);
 	appendToResult(uvArea);
 	appendToResult(ratio);
+	if (m_isFrameRange)
+	{
+		appendToResult(minSurfaceArea);
+		appendToResult(maxSurfaceArea);
+		appendToResult(minRatio);
+		appendToResult(maxRatio);
+	}
 
 /*
 	surfaceArea=0.00000001;
@@ -245,6 +384,234 @@ GetSurfaceUVArea::doIt( const MArgList& args )
 	return MS::kSuccess;
 }
 
+// Adds the surface area of the faces at each frame to frameAreas.
+// Only the points are read per frame, the triangulation is read once.
+bool
+GetSurfaceUVArea::SampleFrames(const MDagPath& dagPath, const MObject& component, const MString* uvSetName, const std::vector<MTime>& times, std::vector<double>& frameAreas)
+{
+	MStatus status;
+	MFnMesh mesh(dagPath, &status);
+	if (status != MS::kSuccess)
+		return false;
+
+	MeshFaceData faceData;
+	if (!faceData.Build(mesh, uvSetName) || !faceData.BuildTriangles(mesh))
+		return false;
+
+	FrameAreaSampler sampler;
+	if (!sampler.Sample(dagPath, faceData, times))
+		return false;
+
+	if (component.isNull())
+	{
+		sampler.AddFrameAreas(NULL, frameAreas);
+	}
+	else
+	{
+		MIntArray faces;
+		MFnSingleIndexedComponent faceComponent(component);
+		faceComponent.getElements(faces);
+		sampler.AddFrameAreas(&faces, frameAreas);
+	}
+	return true;
+}
+
+// Measures each object, or each UV shell, of the selection in one call.
+// Objects are read from Maya on the main thread in batches and each batch is measured in parallel.
+void
+GetSurfaceUVArea::MeasureObjects(const MSelectionList& selection)
+{
+	std::vector<MTime> times;
+	if (m_isFrameRange)
+	{
+		FrameAreaSampler::GetFrameTimes(m_startFrame, m_endFrame, m_frameStep, times);
+	}
+
+	MDoubleArray results;
+	MStringArray objectNames;
+
+	std::vector<ObjectAreas*> batch;
+	batch.reserve(ObjectBatchSize);
+
+	MItSelectionList iter(selection);
+	for ( ; !iter.isDone(); iter.next() )
+	{
+		MDagPath	dagPath;
+		MObject		component;
+
+		iter.getDagPath( dagPath, component );
+		if (dagPath.node().hasFn(MFn::kPolyMesh) || dagPath.node().hasFn(MFn::kMesh))
+		{
+			dagPath.extendToShape();
+
+			const MString* desiredUVSetName = NULL;
+			if (m_isUVSetOverride)
+			{
+				desiredUVSetName = &m_UVSetName;
+			}
+			MFnMesh mesh(dagPath);
+			if (!FindMeshUVSetName(mesh, m_isUVSetOverride, m_isFallback, &desiredUVSetName))
+				continue;
+
+			// Every object with the UV set has an index, so the names don't need the objects read
+			objectNames.append(dagPath.partialPathName());
+			if (m_isObjectNames)
+				continue;
+
+			// An object that can't be read has no faces, it keeps its place with no area and no shells
+			ObjectAreas* object = new ObjectAreas;
+			if (!GatherObject(dagPath, component, desiredUVSetName, *object))
+			{
+				delete object;
+				object = new ObjectAreas;
+				object->dagPath = dagPath;
+				object->numGroups = m_isPerShell ? 0 : 1;
+			}
+
+			batch.push_back(object);
+			if ((int)batch.size() == ObjectBatchSize)
+			{
+				MeasureBatch(batch, (int)objectNames.length() - ObjectBatchSize, times, results);
+			}
+		}
+	}
+	MeasureBatch(batch, (int)(objectNames.length() - batch.size()), times, results);
+
+	if (m_isObjectNames)
+	{
+		setResult(objectNames);
+	}
+	else
+	{
+		setResult(results);
+	}
+}
+
+// Reads the topology, UVs and the selected faces of one object, grouped by UV shell if needed
+bool
+GetSurfaceUVArea::GatherObject(const MDagPath& dagPath, const MObject& component, const MString* uvSetName, ObjectAreas& object) const
+{
+	MFnMesh mesh(dagPath);
+
+	object.dagPath = dagPath;
+	if (!object.faceData.Build(mesh, uvSetName) || !object.faceData.BuildTriangles(mesh))
+		return false;
+
+	if (mesh.getUVs(object.uArray, object.vArray, uvSetName) != MS::kSuccess)
+		return false;
+
+	if (component.isNull())
+	{
+		int numFaces = (int)object.faceData.faceVertexCounts.length();
+		object.faces.setLength(numFaces);
+		for (int i = 0; i < numFaces; i++)
+		{
+			object.faces[i] = i;
+		}
+	}
+	else
+	{
+		MFnSingleIndexedComponent faceComponents(component);
+		faceComponents.getElements(object.faces);
+	}
+
+	int numFaces = (int)object.faces.length();
+	object.faceGroups.setLength(numFaces);
+	object.numGroups = 1;
+	if (!m_isPerShell)
+	{
+		for (int i = 0; i < numFaces; i++)
+		{
+			object.faceGroups[i] = 0;
+		}
+		return true;
+	}
+
+	MString uvSet = uvSetName ? *uvSetName : GetCurrentUVSetName(mesh);
+	MIntArray uvShellIds;
+	unsigned int numShells = 0;
+	if (mesh.getUvShellsIds(uvShellIds, numShells, &uvSet) != MS::kSuccess)
+		return false;
+	object.numGroups = (int)numShells;
+
+	// The shell of a face is the shell of its first UV, faces without UVs aren't in a shell
+	const MeshFaceData& faceData = object.faceData;
+	for (int i = 0; i < numFaces; i++)
+	{
+		int face = object.faces[i];
+		object.faceGroups[i] = -1;
+		if (faceData.uvCounts[face] > 0)
+		{
+			object.faceGroups[i] = uvShellIds[faceData.uvIds[faceData.uvOffsets[face]]];
+		}
+	}
+	return true;
+}
+
+// Measures the batch on the thread pool, appends its results and releases it
+void
+GetSurfaceUVArea::MeasureBatch(std::vector<ObjectAreas*>& batch, int firstObject, const std::vector<MTime>& times, MDoubleArray& results)
+{
+	if (batch.empty())
+		return;
+
+	ParallelFor((int)batch.size(), 1, MeasureObjectsRange, &batch[0]);
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		ObjectAreas& object = *batch[i];
+
+		// Over a frame range the mean surface area replaces the current frame's,
+		// the mesh has to be evaluated on the main thread so this isn't done in parallel
+		FrameAreaSampler sampler;
+		if (!times.empty() && object.faces.length() > 0 && !sampler.Sample(object.dagPath, object.faceData, times))
+		{
+			displayWarning("Could not measure " + object.dagPath.partialPathName() + " over the frame range, its topology changes");
+		}
+
+		// Faces of each group, only needed to reduce the frame range
+		std::vector<MIntArray> groupFaces;
+		if (sampler.IsSampled())
+		{
+			groupFaces.resize(object.numGroups);
+			for (uint j = 0; j < object.faces.length(); j++)
+			{
+				if (object.faceGroups[j] >= 0)
+					groupFaces[object.faceGroups[j]].append(object.faces[j]);
+			}
+		}
+
+		int objectIndex = firstObject + (int)i;
+		for (int group = 0; group < object.numGroups; group++)
+		{
+			double surfaceArea = object.surfaceAreas[group];
+			double uvArea = object.uvAreas[group];
+			if (m_isPerShell && object.numFaces[group] == 0)
+				continue;
+
+			if (sampler.IsSampled())
+			{
+				surfaceArea = sampler.GetFacesArea(&groupFaces[group], FrameMean);
+			}
+
+			if (m_isPerShell)
+			{
+				results.append(objectIndex);
+				results.append(group);
+			}
+			results.append(surfaceArea);
+			results.append(uvArea);
+			results.append(GetRatio(surfaceArea, uvArea));
+		}
+	}
+
+	for (std::vector<ObjectAreas*>::reverse_iterator iter = batch.rbegin(); iter != batch.rend(); ++iter)
+	{
+		delete *iter;
+	}
+	batch.clear();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
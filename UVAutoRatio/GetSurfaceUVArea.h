@@ -14,8 +14,18 @@
 #ifndef GETSURFACEUVAREA_H
 #define GETSURFACEUVAREA_H
 
+#include "FrameAreaSampler.h"
+
+struct ObjectAreas;
+
 // Given a selection or a selection string argument, this command 
-// returns 2 doubles, the surface area and then UV area.
+// returns 3 doubles, the surface area, the UV area and their ratio.
+// Over a frame range the surface area and ratio are the means over the frames,
+// followed by the minimum and maximum surface area and the minimum and maximum ratio.
+//
+// With -perObject it returns the surface area, UV area and ratio of each object
+// instead, and with -perShell the object index, shell number, surface area,
+// UV area and ratio of each UV shell.  The objects are measured in parallel.
 //
 // All types of selections are supported, and are converted to faces internally.
 class GetSurfaceUVArea :
@@ -35,12 +45,23 @@ private:
 	MStatus		Initialise(const MArgList& args);
 	const char*	ParseArguments(const MArgList& args);
 	void		DisplayHelp() const;
+	bool		SampleFrames(const MDagPath& dagPath, const MObject& component, const MString* uvSetName, const std::vector<MTime>& times, std::vector<double>& frameAreas);
+	void		MeasureObjects(const MSelectionList& selection);
+	bool		GatherObject(const MDagPath& dagPath, const MObject& component, const MString* uvSetName, ObjectAreas& object) const;
+	void		MeasureBatch(std::vector<ObjectAreas*>& batch, int firstObject, const std::vector<MTime>& times, MDoubleArray& results);
 
 	bool		m_isHelp;
 	bool		m_isFallback;
 	bool		m_isUVSetOverride;
 	bool		m_reportZeroAreas;
 	MString		m_UVSetName;
+	bool		m_isFrameRange;
+	double		m_startFrame;
+	double		m_endFrame;
+	double		m_frameStep;
+	bool		m_isPerObject;
+	bool		m_isPerShell;
+	bool		m_isObjectNames;
 
 	// Help static string data
 	static const char* GetSurfaceUVArea_Help[];
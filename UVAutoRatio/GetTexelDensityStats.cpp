@@ -0,0 +1,480 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include <algorithm>
+#include "MayaUtility.h"
+#include "Utility.h"
+#include "ThreadUtility.h"
+#include "GetTexelDensityStats.h"
+
+using namespace std;
+
+static const char* error_numBins = "Number of histogram bins must be at least 1";
+static const char* error_outlierFactor = "Outlier factor must be greater than 1.0";
+
+// Area weighted percentiles returned for each mesh
+static const double Percentiles[] = { 0.05, 0.25, 0.5, 0.75, 0.95 };
+static const int NumPercentiles = sizeof(Percentiles)/sizeof(Percentiles[0]);
+
+// Faces measured per thread pool task
+static const int FaceGrainSize = 4096;
+
+const char* GetTexelDensityStats::GetTexelDensityStats_Help[] = {
+	" GetTexelDensityStats Help\n",
+	"\n",
+	"\t-help          (-hlp) This gets printed\n",
+	"\t-uvSetName     (-us)  [string] The name of the UV set to use (optional)\n",
+	"\t-fallback      (-fb)  If the named UV set is not found in a mesh, use the default UV set instead of skipping it (optional)\n",
+	"\t-bins          (-b)   [int] Number of histogram bins between the lowest and highest face ratio, default is 10 (optional)\n",
+	"\t-outlierFactor (-of)  [double] Faces and shells with a ratio more than this factor above or below the median are outliers, default is 2.0 (optional)\n",
+	"\t-meshNames     (-mn)  Return the names of the meshes instead, in the same order as the statistics, without measuring them (optional)\n",
+	"\n",
+	" Returns an array of doubles, with one block per mesh laid out as below, a mesh that can't be measured has no faces:\n",
+	"\tnumFaces surfaceArea uvArea ratio minRatio maxRatio\n",
+	"\tp5 p25 p50 p75 p95                       Area weighted ratio percentiles\n",
+	"\tnumBins bin0 .. binN                     Fraction of the surface area in each ratio bin\n",
+	"\tnumOutlierFaces face0 .. faceN           Outlier face indices, faces with surface area but no UV area are always outliers\n",
+	"\tnumOutlierShells shell0 .. shellN        Outlier UV shell indices\n",
+	"\n"
+};
+
+unsigned int GetTexelDensityStats::helpLineCount = sizeof(GetTexelDensityStats_Help)/sizeof(GetTexelDensityStats_Help[0]);
+
+// Shared with the thread pool tasks, every task writes to its own range of the face arrays
+struct MeasureFacesData
+{
+	const MeshFaceData*	faceData;
+	const MFloatArray*	uArray;
+	const MFloatArray*	vArray;
+	const MIntArray*	faces;
+	double*				faceSurfaceAreas;
+	double*				faceUVAreas;
+};
+
+static void
+MeasureFacesRange(void* data, int begin, int end)
+{
+	MeasureFacesData* measure = (MeasureFacesData*)data;
+	for (int i = begin; i < end; i++)
+	{
+		GetFaceAreas(*measure->faceData, *measure->uArray, *measure->vArray, (*measure->faces)[i], measure->faceSurfaceAreas[i], measure->faceUVAreas[i]);
+	}
+}
+
+struct FaceRatio
+{
+	double	ratio;
+	double	weight;
+
+	bool operator < (const FaceRatio& other) const
+	{
+		return ratio < other.ratio;
+	}
+};
+
+static bool
+IsOutlier(double ratio, double median, double factor)
+{
+	return (ratio > median * factor || ratio * factor < median);
+}
+
+GetTexelDensityStats::GetTexelDensityStats()
+{
+	m_isHelp = false;
+	m_isFallback = true;
+	m_isUVSetOverride = false;
+	m_isMeshNames = false;
+	m_numBins = 10;
+	m_outlierFactor = 2.0;
+}
+
+GetTexelDensityStats::~GetTexelDensityStats()
+{
+}
+
+void*
+GetTexelDensityStats::creator()
+{
+	return new GetTexelDensityStats;
+}
+
+bool
+GetTexelDensityStats::isUndoable() const
+{
+	return false;
+}
+
+bool
+GetTexelDensityStats::hasSyntax() const
+{
+	return true;
+}
+
+MSyntax
+GetTexelDensityStats::newSyntax()
+{
+	MStatus status;
+	MSyntax syntax;
+
+	// flags
+	syntax.addFlag("-hlp", "-help");
+	syntax.addFlag("-fb", "-fallback");
+	syntax.addFlag("-us", "-uvSetName", MSyntax::kString);
+	syntax.addFlag("-b", "-bins", MSyntax::kLong);
+	syntax.addFlag("-of", "-outlierFactor", MSyntax::kDouble);
+	syntax.addFlag("-mn", "-meshNames");
+
+	syntax.useSelectionAsDefault(false);
+	syntax.enableQuery(false);
+	syntax.enableEdit(false);
+	return syntax;
+}
+
+const char*
+GetTexelDensityStats::ParseArguments(const MArgList& args)
+{
+	MArgDatabase argData(syntax(), args);
+
+	m_isHelp = argData.isFlagSet("-help");
+	m_isFallback = argData.isFlagSet("-fallback");
+	m_isMeshNames = argData.isFlagSet("-meshNames");
+
+	if (getArgValue(argData, "-us", "-uvSetName", m_UVSetName))
+	{
+		m_isUVSetOverride = true;
+	}
+
+	getArgValue(argData, "-b", "-bins", m_numBins);
+	if (m_numBins < 1)
+	{
+		return error_numBins;
+	}
+
+	getArgValue(argData, "-of", "-outlierFactor", m_outlierFactor);
+	if (m_outlierFactor <= 1.0)
+	{
+		return error_outlierFactor;
+	}
+
+	return NULL;
+}
+
+MStatus
+GetTexelDensityStats::Initialise(const MArgList& args)
+{
+	clearResult();
+
+	// Parse arguments
+	const char* errorMessage = ParseArguments(args);
+
+	// Display help
+	if (m_isHelp)
+	{
+		DisplayHelp();
+		return MS::kSuccess;
+	}
+
+	if (errorMessage)
+	{
+		displayError(errorMessage);
+		return MS::kFailure;
+	}
+
+	return MS::kSuccess;
+}
+
+void
+GetTexelDensityStats::DisplayHelp() const
+{
+	for (unsigned int i=0; i<helpLineCount; i++)
+	{
+		appendToResult(GetTexelDensityStats_Help[i]);
+	}
+}
+
+MStatus
+GetTexelDensityStats::doIt( const MArgList& args )
+{
+	MStatus status;
+
+	status = Initialise(args);
+	if (status != MS::kSuccess || m_isHelp)
+	{
+		return status;
+	}
+
+	// Convert selection to internal faces
+	MStringArray selections;
+	MGlobal::executeCommand("polyListComponentConversion -fromUV -fromEdge -fromFace -fromVertex -toFace -internal;", selections);
+
+	MSelectionList selection;
+	for (unsigned int i = 0; i < selections.length(); i++)
+	{
+		selection.add(selections[i]);
+	}
+
+	MDoubleArray results;
+	MStringArray meshNames;
+
+	// Process the selection
+	MItSelectionList iter(selection);
+	for ( ; !iter.isDone(); iter.next() )
+	{
+		MDagPath	dagPath;
+		MObject		component;
+
+		iter.getDagPath( dagPath, component );
+		if (dagPath.node().hasFn(MFn::kPolyMesh) || dagPath.node().hasFn(MFn::kMesh))
+		{
+			dagPath.extendToShape();
+
+			const MString* desiredUVSetName = NULL;
+			if (m_isUVSetOverride)
+			{
+				desiredUVSetName = &m_UVSetName;
+			}
+			MFnMesh mesh(dagPath);
+			if (!FindMeshUVSetName(mesh, m_isUVSetOverride, m_isFallback, &desiredUVSetName))
+				continue;
+
+			// The names only need the meshes the statistics have a block for
+			if (m_isMeshNames)
+			{
+				meshNames.append(dagPath.partialPathName());
+				continue;
+			}
+
+			MIntArray faces, faceShells;
+			std::vector<double> faceSurfaceAreas, faceUVAreas;
+			int numShells = 0;
+			if (!MeasureFaces(dagPath, component, desiredUVSetName, faces, faceSurfaceAreas, faceUVAreas, faceShells, numShells))
+			{
+				// An empty block keeps the statistics in the same order as the names
+				faces.clear();
+				faceShells.clear();
+				faceSurfaceAreas.clear();
+				faceUVAreas.clear();
+				numShells = 0;
+			}
+			AppendStats(faces, faceSurfaceAreas, faceUVAreas, faceShells, numShells, results);
+		}
+	}
+
+	if (m_isMeshNames)
+	{
+		setResult(meshNames);
+	}
+	else
+	{
+		setResult(results);
+	}
+
+	return MS::kSuccess;
+}
+
+// Reads the mesh once and measures the selected faces on the thread pool
+bool
+GetTexelDensityStats::MeasureFaces(const MDagPath& dagPath, MObject& component, const MString* uvSetName, MIntArray& faces, std::vector<double>& faceSurfaceAreas, std::vector<double>& faceUVAreas, MIntArray& faceShells, int& numShells) const
+{
+	MFnMesh mesh(dagPath);
+
+	MeshFaceData faceData;
+	if (!faceData.Build(mesh, uvSetName) || !faceData.BuildTriangles(mesh))
+		return false;
+
+	MFloatArray uArray, vArray;
+	if (mesh.getUVs(uArray, vArray, uvSetName) != MS::kSuccess)
+		return false;
+
+	MString uvSet = uvSetName ? *uvSetName : GetCurrentUVSetName(mesh);
+	MIntArray uvShellIds;
+	unsigned int shellCount = 0;
+	if (mesh.getUvShellsIds(uvShellIds, shellCount, &uvSet) != MS::kSuccess)
+		return false;
+	numShells = (int)shellCount;
+
+	if (component.isNull())
+	{
+		int numFaces = (int)faceData.faceVertexCounts.length();
+		faces.setLength(numFaces);
+		for (int i = 0; i < numFaces; i++)
+		{
+			faces[i] = i;
+		}
+	}
+	else
+	{
+		MFnSingleIndexedComponent faceComponents(component);
+		faceComponents.getElements(faces);
+	}
+
+	int numFaces = (int)faces.length();
+	if (numFaces == 0)
+		return false;
+
+	// The shell of a face is the shell of its first UV
+	faceShells.setLength(numFaces);
+	for (int i = 0; i < numFaces; i++)
+	{
+		int face = faces[i];
+		faceShells[i] = -1;
+		if (faceData.uvCounts[face] > 0)
+		{
+			faceShells[i] = uvShellIds[faceData.uvIds[faceData.uvOffsets[face]]];
+		}
+	}
+
+	faceSurfaceAreas.assign(numFaces, 0.0);
+	faceUVAreas.assign(numFaces, 0.0);
+
+	MeasureFacesData measure;
+	measure.faceData = &faceData;
+	measure.uArray = &uArray;
+	measure.vArray = &vArray;
+	measure.faces = &faces;
+	measure.faceSurfaceAreas = &faceSurfaceAreas[0];
+	measure.faceUVAreas = &faceUVAreas[0];
+	ParallelFor(numFaces, FaceGrainSize, MeasureFacesRange, &measure);
+
+	return true;
+}
+
+// Works out the distribution of the measured face ratios and appends the mesh's block to the results
+void
+GetTexelDensityStats::AppendStats(const MIntArray& faces, const std::vector<double>& faceSurfaceAreas, const std::vector<double>& faceUVAreas, const MIntArray& faceShells, int numShells, MDoubleArray& results) const
+{
+	int numFaces = (int)faces.length();
+
+	// Faces without UV area have no ratio, so they are only counted as outliers if they have surface area
+	std::vector<FaceRatio> ratios;
+	ratios.reserve(numFaces);
+	double surfaceArea = 0.0, uvArea = 0.0, ratioWeight = 0.0;
+	for (int i = 0; i < numFaces; i++)
+	{
+		surfaceArea += faceSurfaceAreas[i];
+		uvArea += faceUVAreas[i];
+		if (faceUVAreas[i] > 0.0)
+		{
+			FaceRatio faceRatio;
+			faceRatio.ratio = faceSurfaceAreas[i] / faceUVAreas[i];
+			faceRatio.weight = faceSurfaceAreas[i];
+			ratios.push_back(faceRatio);
+			ratioWeight += faceRatio.weight;
+		}
+	}
+	std::sort(ratios.begin(), ratios.end());
+
+	double ratio = 1.0;
+	if (surfaceArea != 0.0 && uvArea != 0.0)
+	{
+		ratio = surfaceArea / uvArea;
+	}
+
+	double minRatio = 0.0, maxRatio = 0.0;
+	if (!ratios.empty())
+	{
+		minRatio = ratios.front().ratio;
+		maxRatio = ratios.back().ratio;
+	}
+
+	results.append((double)numFaces);
+	results.append(surfaceArea);
+	results.append(uvArea);
+	results.append(ratio);
+	results.append(minRatio);
+	results.append(maxRatio);
+
+	// Percentiles, the ratio below which the given fraction of the surface area lies
+	double percentileValues[NumPercentiles];
+	size_t ratioIndex = 0;
+	double cumulativeWeight = 0.0;
+	for (int i = 0; i < NumPercentiles; i++)
+	{
+		double targetWeight = Percentiles[i] * ratioWeight;
+		while (ratioIndex + 1 < ratios.size() && cumulativeWeight + ratios[ratioIndex].weight < targetWeight)
+		{
+			cumulativeWeight += ratios[ratioIndex].weight;
+			ratioIndex++;
+		}
+		percentileValues[i] = ratios.empty() ? 0.0 : ratios[ratioIndex].ratio;
+		results.append(percentileValues[i]);
+	}
+	double median = percentileValues[2];
+
+	// Histogram
+	std::vector<double> bins(m_numBins, 0.0);
+	double binSize = (maxRatio - minRatio) / m_numBins;
+	for (size_t i = 0; i < ratios.size(); i++)
+	{
+		int bin = 0;
+		if (binSize > 0.0)
+		{
+			bin = std::min((int)((ratios[i].ratio - minRatio) / binSize), m_numBins - 1);
+		}
+		bins[bin] += ratios[i].weight;
+	}
+	results.append((double)m_numBins);
+	for (int i = 0; i < m_numBins; i++)
+	{
+		results.append(ratioWeight > 0.0 ? bins[i] / ratioWeight : 0.0);
+	}
+
+	// Outlier faces
+	MIntArray outlierFaces;
+	for (int i = 0; i < numFaces; i++)
+	{
+		if (faceUVAreas[i] <= 0.0)
+		{
+			if (faceSurfaceAreas[i] > 0.0)
+				outlierFaces.append(faces[i]);
+		}
+		else if (IsOutlier(faceSurfaceAreas[i] / faceUVAreas[i], median, m_outlierFactor))
+		{
+			outlierFaces.append(faces[i]);
+		}
+	}
+	results.append((double)outlierFaces.length());
+	for (unsigned int i = 0; i < outlierFaces.length(); i++)
+	{
+		results.append((double)outlierFaces[i]);
+	}
+
+	// Outlier shells, measured from the selected faces of each shell
+	std::vector<double> shellSurface(numShells, 0.0), shellUV(numShells, 0.0);
+	for (int i = 0; i < numFaces; i++)
+	{
+		int shell = faceShells[i];
+		if (shell >= 0 && shell < numShells)
+		{
+			shellSurface[shell] += faceSurfaceAreas[i];
+			shellUV[shell] += faceUVAreas[i];
+		}
+	}
+	MIntArray outlierShells;
+	for (int i = 0; i < numShells; i++)
+	{
+		if (shellSurface[i] <= 0.0)
+			continue;
+
+		if (shellUV[i] <= 0.0 || IsOutlier(shellSurface[i] / shellUV[i], median, m_outlierFactor))
+		{
+			outlierShells.append(i);
+		}
+	}
+	results.append((double)outlierShells.length());
+	for (unsigned int i = 0; i < outlierShells.length(); i++)
+	{
+		results.append((double)outlierShells[i]);
+	}
+}
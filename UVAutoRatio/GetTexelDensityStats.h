@@ -0,0 +1,59 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef GETTEXELDENSITYSTATS_H
+#define GETTEXELDENSITYSTATS_H
+
+#include "Utility.h"
+
+// Given a selection, this command measures the surface/UV ratio of every
+// selected face and returns the distribution of that ratio per mesh as a
+// flat array of doubles: totals, area weighted percentiles, an area weighted
+// histogram and the faces and shells whose ratio is far from the median.
+//
+// All types of selections are supported, and are converted to faces internally.
+class GetTexelDensityStats :
+	public MPxCommand
+{
+public:
+	GetTexelDensityStats();
+	virtual     ~GetTexelDensityStats();
+
+	MStatus     doIt ( const MArgList& args );
+	bool        isUndoable() const;
+	bool		hasSyntax() const;
+	static void* creator();
+	static MSyntax newSyntax();
+
+private:
+	MStatus		Initialise(const MArgList& args);
+	const char*	ParseArguments(const MArgList& args);
+	void		DisplayHelp() const;
+
+	bool		MeasureFaces(const MDagPath& dagPath, MObject& component, const MString* uvSetName, MIntArray& faces, std::vector<double>& faceSurfaceAreas, std::vector<double>& faceUVAreas, MIntArray& faceShells, int& numShells) const;
+	void		AppendStats(const MIntArray& faces, const std::vector<double>& faceSurfaceAreas, const std::vector<double>& faceUVAreas, const MIntArray& faceShells, int numShells, MDoubleArray& results) const;
+
+	bool		m_isHelp;
+	bool		m_isFallback;
+	bool		m_isUVSetOverride;
+	bool		m_isMeshNames;
+	MString		m_UVSetName;
+	int			m_numBins;
+	double		m_outlierFactor;
+
+	// Help static string data
+	static const char* GetTexelDensityStats_Help[];
+	static unsigned int helpLineCount;
+};
+
+#endif
@@ -0,0 +1,296 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "MayaUtility.h"
+#include "Utility.h"
+#include "GetUVOverlaps.h"
+
+using namespace std;
+
+static const char* error_minArea = "Minimum area must not be negative";
+
+const char* GetUVOverlaps::GetUVOverlaps_Help[] = {
+	" GetUVOverlaps Help\n",
+	"\n",
+	"\t-help       (-hlp) This gets printed\n",
+	"\t-uvSetName  (-us)  [string] The name of the UV set to use (optional)\n",
+	"\t-fallback   (-fb)  If the named UV set is not found in a mesh, use the default UV set instead of skipping it (optional)\n",
+	"\t-minArea    (-ma)  [double] Ignore shell pairs that overlap by less than this UV area, default is 0.0 (optional)\n",
+	"\t-meshNames  (-mn)  Return the names of the meshes instead, in the order they are indexed by the overlaps, without reading their triangles (optional)\n",
+	"\n",
+	" Returns an array of doubles, five for each pair of overlapping UV shells:\n",
+	"\tmeshA shellA meshB shellB area\n",
+	"\n"
+};
+
+unsigned int GetUVOverlaps::helpLineCount = sizeof(GetUVOverlaps_Help)/sizeof(GetUVOverlaps_Help[0]);
+
+GetUVOverlaps::GetUVOverlaps()
+{
+	m_isHelp = false;
+	m_isFallback = true;
+	m_isUVSetOverride = false;
+	m_isMeshNames = false;
+	m_minArea = 0.0;
+}
+
+GetUVOverlaps::~GetUVOverlaps()
+{
+}
+
+void*
+GetUVOverlaps::creator()
+{
+	return new GetUVOverlaps;
+}
+
+bool
+GetUVOverlaps::isUndoable() const
+{
+	return false;
+}
+
+bool
+GetUVOverlaps::hasSyntax() const
+{
+	return true;
+}
+
+MSyntax
+GetUVOverlaps::newSyntax()
+{
+	MStatus status;
+	MSyntax syntax;
+
+	// flags
+	syntax.addFlag("-hlp", "-help");
+	syntax.addFlag("-fb", "-fallback");
+	syntax.addFlag("-us", "-uvSetName", MSyntax::kString);
+	syntax.addFlag("-ma", "-minArea", MSyntax::kDouble);
+	syntax.addFlag("-mn", "-meshNames");
+
+	syntax.useSelectionAsDefault(false);
+	syntax.enableQuery(false);
+	syntax.enableEdit(false);
+	return syntax;
+}
+
+const char*
+GetUVOverlaps::ParseArguments(const MArgList& args)
+{
+	MArgDatabase argData(syntax(), args);
+
+	m_isHelp = argData.isFlagSet("-help");
+	m_isFallback = argData.isFlagSet("-fallback");
+	m_isMeshNames = argData.isFlagSet("-meshNames");
+
+	if (getArgValue(argData, "-us", "-uvSetName", m_UVSetName))
+	{
+		m_isUVSetOverride = true;
+	}
+
+	getArgValue(argData, "-ma", "-minArea", m_minArea);
+	if (m_minArea < 0.0)
+	{
+		return error_minArea;
+	}
+
+	return NULL;
+}
+
+MStatus
+GetUVOverlaps::Initialise(const MArgList& args)
+{
+	clearResult();
+
+	// Parse arguments
+	const char* errorMessage = ParseArguments(args);
+
+	// Display help
+	if (m_isHelp)
+	{
+		DisplayHelp();
+		return MS::kSuccess;
+	}
+
+	if (errorMessage)
+	{
+		displayError(errorMessage);
+		return MS::kFailure;
+	}
+
+	return MS::kSuccess;
+}
+
+void
+GetUVOverlaps::DisplayHelp() const
+{
+	for (unsigned int i=0; i<helpLineCount; i++)
+	{
+		appendToResult(GetUVOverlaps_Help[i]);
+	}
+}
+
+MStatus
+GetUVOverlaps::doIt( const MArgList& args )
+{
+	MStatus status;
+
+	status = Initialise(args);
+	if (status != MS::kSuccess || m_isHelp)
+	{
+		return status;
+	}
+
+	// Convert selection to internal faces
+	MStringArray selections;
+	MGlobal::executeCommand("polyListComponentConversion -fromUV -fromEdge -fromFace -fromVertex -toFace -internal;", selections);
+
+	MSelectionList selection;
+	for (unsigned int i = 0; i < selections.length(); i++)
+	{
+		selection.add(selections[i]);
+	}
+
+	// All the selected triangles go in one tree so shells of different meshes are compared too
+	UVTriangleBVH tree;
+	MStringArray meshNames;
+	m_owners.clear();
+
+	MItSelectionList iter(selection);
+	for ( ; !iter.isDone(); iter.next() )
+	{
+		MDagPath	dagPath;
+		MObject		component;
+
+		iter.getDagPath( dagPath, component );
+		if (dagPath.node().hasFn(MFn::kPolyMesh) || dagPath.node().hasFn(MFn::kMesh))
+		{
+			dagPath.extendToShape();
+
+			const MString* desiredUVSetName = NULL;
+			if (m_isUVSetOverride)
+			{
+				desiredUVSetName = &m_UVSetName;
+			}
+			MFnMesh mesh(dagPath);
+			if (!FindMeshUVSetName(mesh, m_isUVSetOverride, m_isFallback, &desiredUVSetName))
+				continue;
+
+			// Every mesh with the UV set gets an index, one that can't be read just has no overlaps,
+			// so the names don't need the triangles
+			int meshIndex = (int)meshNames.length();
+			meshNames.append(dagPath.partialPathName());
+			if (!m_isMeshNames)
+			{
+				AddMeshTriangles(dagPath, component, desiredUVSetName, meshIndex, tree);
+			}
+		}
+	}
+
+	if (m_isMeshNames)
+	{
+		setResult(meshNames);
+		return MS::kSuccess;
+	}
+
+	tree.Build();
+	std::vector<UVOverlap> overlaps;
+	tree.FindOverlaps(overlaps);
+
+	MDoubleArray results;
+	for (size_t i = 0; i < overlaps.size(); i++)
+	{
+		const UVOverlap& overlap = overlaps[i];
+		if (overlap.area < m_minArea)
+			continue;
+
+		results.append((double)m_owners[overlap.ownerA].first);
+		results.append((double)m_owners[overlap.ownerA].second);
+		results.append((double)m_owners[overlap.ownerB].first);
+		results.append((double)m_owners[overlap.ownerB].second);
+		results.append(overlap.area);
+	}
+	setResult(results);
+
+	return MS::kSuccess;
+}
+
+// Adds the triangles of the selected faces, owned by their mesh and UV shell
+bool
+GetUVOverlaps::AddMeshTriangles(const MDagPath& dagPath, MObject& component, const MString* uvSetName, int meshIndex, UVTriangleBVH& tree)
+{
+	MFnMesh mesh(dagPath);
+
+	MeshFaceData faceData;
+	if (!faceData.Build(mesh, uvSetName, MSpace::kObject) || !faceData.BuildTriangles(mesh))
+		return false;
+
+	MFloatArray uArray, vArray;
+	if (mesh.getUVs(uArray, vArray, uvSetName) != MS::kSuccess)
+		return false;
+
+	MString uvSet = uvSetName ? *uvSetName : GetCurrentUVSetName(mesh);
+	MIntArray uvShellIds;
+	unsigned int shellCount = 0;
+	if (mesh.getUvShellsIds(uvShellIds, shellCount, &uvSet) != MS::kSuccess)
+		return false;
+
+	MIntArray faces;
+	if (component.isNull())
+	{
+		int numFaces = (int)faceData.faceVertexCounts.length();
+		faces.setLength(numFaces);
+		for (int i = 0; i < numFaces; i++)
+		{
+			faces[i] = i;
+		}
+	}
+	else
+	{
+		MFnSingleIndexedComponent faceComponents(component);
+		faceComponents.getElements(faces);
+	}
+
+	// Owners are numbered after the shells of the meshes already added
+	int firstOwner = (int)m_owners.size();
+	for (unsigned int i = 0; i < shellCount; i++)
+	{
+		m_owners.push_back(std::make_pair(meshIndex, (int)i));
+	}
+
+	for (unsigned int i = 0; i < faces.length(); i++)
+	{
+		int face = faces[i];
+		if (faceData.uvCounts[face] != faceData.faceVertexCounts[face])
+			continue;
+
+		int owner = firstOwner + uvShellIds[faceData.uvIds[faceData.uvOffsets[face]]];
+		for (int j = 0; j < faceData.triangleCounts[face]; j++)
+		{
+			int uvIds[3];
+			GetFaceTriangleUVIds(faceData, face, j, uvIds);
+
+			float2 uv[3];
+			for (int k = 0; k < 3; k++)
+			{
+				uv[k][0] = uArray[uvIds[k]];
+				uv[k][1] = vArray[uvIds[k]];
+			}
+			tree.AddTriangle(uv[0], uv[1], uv[2], owner);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,60 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef GETUVOVERLAPS_H
+#define GETUVOVERLAPS_H
+
+#include "Utility.h"
+#include "UVTriangleBVH.h"
+
+// Given a selection, this command finds the UV shells that overlap each
+// other in UV space, within and across meshes, and returns each overlapping
+// pair as a flat array of doubles: mesh and shell of both and the overlap area.
+//
+// All types of selections are supported, and are converted to faces internally.
+class GetUVOverlaps :
+	public MPxCommand
+{
+public:
+	GetUVOverlaps();
+	virtual     ~GetUVOverlaps();
+
+	MStatus     doIt ( const MArgList& args );
+	bool        isUndoable() const;
+	bool		hasSyntax() const;
+	static void* creator();
+	static MSyntax newSyntax();
+
+private:
+	MStatus		Initialise(const MArgList& args);
+	const char*	ParseArguments(const MArgList& args);
+	void		DisplayHelp() const;
+
+	bool		AddMeshTriangles(const MDagPath& dagPath, MObject& component, const MString* uvSetName, int meshIndex, UVTriangleBVH& tree);
+
+	bool		m_isHelp;
+	bool		m_isFallback;
+	bool		m_isUVSetOverride;
+	bool		m_isMeshNames;
+	MString		m_UVSetName;
+	double		m_minArea;
+
+	// Mesh index and shell of each triangle owner in the tree
+	std::vector<std::pair<int, int> >	m_owners;
+
+	// Help static string data
+	static const char* GetUVOverlaps_Help[];
+	static unsigned int helpLineCount;
+};
+
+#endif
@@ -84,6 +84,7 @@ using namespace std;
 #include <maya/MIntArray.h>
 #include <maya/MColorArray.h>
 #include <maya/MDoubleArray.h>
+#include <maya/MObjectArray.h>
 #include <maya/MPointArray.h>
 #include <maya/MFloatPoint.h>
 #include <maya/MFloatVector.h>
@@ -30,6 +30,24 @@ SetOptionVar(const MString& varName, const std::string& val)
 #endif
 }
 
+// Stops the viewports and UV editor redrawing while the scene is edited.  Returns false if it
+// wasn't changed, because it was already suspended or this Maya has no refresh -suspend.
+bool
+SuspendRefresh()
+{
+	int isSuspended = 0;
+	if (MGlobal::executeCommand("refresh -query -suspend", isSuspended) == MS::kSuccess && isSuspended != 0)
+		return false;
+
+	return (MGlobal::executeCommand("refresh -suspend true") == MS::kSuccess);
+}
+
+void
+ResumeRefresh()
+{
+	MGlobal::executeCommand("refresh -suspend false");
+}
+
 MString
 Convert(MStringArray& strings)
 {
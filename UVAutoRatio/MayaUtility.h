@@ -31,6 +31,9 @@ void		SetOptionVar(const MString& varName, const std::string& val);
 
 MString		Convert(MStringArray& strings);
 
+bool		SuspendRefresh();
+void		ResumeRefresh();
+
 bool		hasArg(const MArgDatabase& argData,const char* shortName,const char* longName);
 bool		getArgValue(const MArgDatabase& argData,const char* shortName,const char* longName,int& result);
 bool		getArgValue(const MArgDatabase& argData,const char* shortName,const char* longName,unsigned int& result);
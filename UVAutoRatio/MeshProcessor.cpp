@@ -14,21 +14,32 @@
 #include "MayaPCH.h"
 #include "Utility.h"
 #include "Timer.h"
+#include "UVKernels.h"
 #include "ShellProcessor.h"
 
+void
+MeshProcessor::GatherMesh(Mesh& /*mesh*/)
+{
+}
+
 void
 MeshProcessor::Gather(UVJob& job)
 {
 	MStatus status;
 
-	job.surfaceArea = GetAreaMeshSurface(job.mesh->dagPath, true);
+	// Measure each face when colouring or sharing surface areas between UV sets
+	bool isMeasured = IsMeasuringFaces(*job.mesh) && job.mesh->GatherFaceAreas(NULL, job.surfaceArea, job.textureArea);
+
+	if (!isMeasured)
+		job.surfaceArea = GetAreaMeshSurface(job.mesh->dagPath, true);
 	if (job.surfaceArea == 0.0)
 	{
 		job.error = ZERO_SURFACE_AREA;
 		return;
 	}
 
-	job.textureArea = GetAreaMeshUV(job.mesh->dagPath, &job.mesh->useUVSetName);
+	if (!isMeasured)
+		job.textureArea = GetAreaMeshUV(job.mesh->dagPath, &job.mesh->useUVSetName);
 	job.finalTextureArea = job.textureArea;
 	if (job.textureArea == 0.0)
 	{
@@ -36,8 +47,7 @@ MeshProcessor::Gather(UVJob& job)
 		return;
 	}
 
-	// Get the UV's
-	status = job.mesh->model->getUVs(job.mesh->uArray, job.mesh->vArray, &job.mesh->useUVSetName);
+	// The UV's have already been read by the mesh
 	assert(job.mesh->uArray.length() == job.mesh->vArray.length());
 	if (job.mesh->uArray.length() != job.mesh->vArray.length())
 	{
@@ -249,34 +259,26 @@ MeshProcessor::ScaleMeshUVs(UVJob& job, double scale)
 
 	assert(uArray.length() == vArray.length());
 
-	uint numSamples = uArray.length();
-	uint i = 0;
-
-	switch (m_params.m_scalingAxis)
+	int numSamples = (int)uArray.length();
+	if (numSamples > 0)
 	{
-	case Both:
-		for (i=0; i<numSamples; i++)
-		{
-			uArray[i] *= (float)scale;
-			vArray[i] *= (float)scale;
-		}
-		break;
-	case Horizontal:
-		for (i=0; i<numSamples; i++)
+		switch (m_params.m_scalingAxis)
 		{
-			uArray[i] *= (float)scale;
-		}
-		break;
-	case Vertical:
-		for (i=0; i<numSamples; i++)
-		{
-			vArray[i] *= (float)scale;
+		case Both:
+			KernelScale(&uArray[0], numSamples, (float)scale);
+			KernelScale(&vArray[0], numSamples, (float)scale);
+			break;
+		case Horizontal:
+			KernelScale(&uArray[0], numSamples, (float)scale);
+			break;
+		case Vertical:
+			KernelScale(&vArray[0], numSamples, (float)scale);
+			break;
 		}
-		break;
 	}
 
 	// set mesh UV's
-	status = job.mesh->model->setUVs(uArray, vArray, &job.mesh->useUVSetName);
+	status = job.mesh->model.setUVs(uArray, vArray, &job.mesh->useUVSetName);
 }
 
 void
@@ -291,45 +293,57 @@ MeshProcessor::ApplyScale(UVJob& job)
 	status = MGlobal::executeCommand("ConvertSelectionToUVs;");
 
 
-	// Execute scale command
-	static char text[1024];
-	/*sprintf_s(text, sizeof(text), "%lf  %.25f %.32f", job.centerU, job.centerU, job.centerU);
-	MGlobal::displayInfo(text);*/
-	//const char* command = "polyEditUV -relative true -pivotU %.20f -pivotV %.20f -scale true -scaleU %.20f -scaleV %.20f";
-	const char* command = "polyMoveUV -pivot %.20f %.20f -scale %.20f %.20f -translate %.20f %.20f";
-
-	double scaleU = job.finalScaleX;
-	double scaleV = job.finalScaleY;
-	switch (m_params.m_scalingAxis)
-	{
-	case Both:
-		break;
-	case Horizontal:
-		scaleV = 1.0;
-		break;
-	case Vertical:
-		scaleU = 1.0;
-		break;
-	}
-
-#ifdef WIN32
-	sprintf_s(text, sizeof(text), command, job.centerU, job.centerV, scaleU, scaleV, job.offsetU, job.offsetV);
-#else
-	sprintf(text, command, job.centerU, job.centerV, scaleU, scaleV, job.offsetU, job.offsetV);
-#endif
+	// Execute scale command on the selected UVs
+	MString command = GetMoveUVCommand(job, MString());
 
 	if (m_undoHistory != NULL)
 	{
 		MDGModifier* modifier = new MDGModifier;
 		m_undoHistory->push_back(modifier);
-		status = modifier->commandToExecute(text);
+		status = modifier->commandToExecute(command);
 		status = modifier->doIt();
 	}
 	else
 	{
-		MGlobal::executeCommand(text);
+		MGlobal::executeCommand(command);
 	}
 
 	job.completed = true;
 }
 
+// The iterations scale the mesh UVs and read the area back
+bool
+MeshProcessor::IsSolveThreadSafe() const
+{
+	return false;
+}
+
+bool
+MeshProcessor::GetApplyComponents(const UVJob& job, MString& components) const
+{
+	if (!job.mesh->dagPath.isValid())
+		return false;
+
+	components = job.mesh->dagPath.fullPathName() + ".map[*]";
+	return true;
+}
+
+bool
+MeshProcessor::TransformUVs(UVJob& job, MFloatArray& uArray, MFloatArray& vArray)
+{
+	if (job.finalScaleX == 1.0 && job.finalScaleY == 1.0 && job.offsetU == 0.0 && job.offsetV == 0.0)
+		return true;
+
+	double scaleU, scaleV;
+	GetAxisScale(job, scaleU, scaleV);
+
+	int numUVs = (int)uArray.length();
+	if (numUVs > 0)
+	{
+		KernelTransform(&uArray[0], numUVs, job.centerU, scaleU, job.offsetU);
+		KernelTransform(&vArray[0], numUVs, job.centerV, scaleV, job.offsetV);
+	}
+
+	return true;
+}
+
@@ -0,0 +1,83 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <vector>
+#include <new>
+
+// Allocates objects in contiguous blocks and releases them all at once.
+// Used for the per-command Mesh and job records, which are created while
+// building the task list and all destroyed together when the command ends.
+template <class T>
+class ObjectPool
+{
+public:
+	ObjectPool(size_t blockSize = 256)
+	{
+		m_blockSize = blockSize;
+		m_numObjects = 0;
+	}
+
+	~ObjectPool()
+	{
+		Clear();
+	}
+
+	// Returns a default constructed object
+	T* Allocate()
+	{
+		size_t indexInBlock = m_numObjects % m_blockSize;
+		if (indexInBlock == 0)
+		{
+			m_blocks.push_back((T*)::operator new(sizeof(T) * m_blockSize));
+		}
+
+		T* object = new (m_blocks.back() + indexInBlock) T();
+		m_numObjects++;
+		return object;
+	}
+
+	// Destroys every object in reverse order of creation and frees the blocks
+	void Clear()
+	{
+		while (m_numObjects > 0)
+		{
+			m_numObjects--;
+			T* object = m_blocks[m_numObjects / m_blockSize] + (m_numObjects % m_blockSize);
+			object->~T();
+		}
+
+		for (size_t i = 0; i < m_blocks.size(); i++)
+		{
+			::operator delete(m_blocks[i]);
+		}
+		m_blocks.clear();
+	}
+
+	size_t Size() const
+	{
+		return m_numObjects;
+	}
+
+private:
+	ObjectPool(const ObjectPool&);
+	ObjectPool& operator = (const ObjectPool&);
+
+	std::vector<T*>	m_blocks;
+	size_t			m_blockSize;
+	size_t			m_numObjects;
+};
+
+#endif
@@ -13,41 +13,250 @@
 
 #include "MayaPCH.h"
 #include "Utility.h"
-#include "UVAutoRatioPro.h"
 #include "ShellProcessor.h"
+#include "ProgressService.h"
+#include "UVUndoJournal.h"
+#include "UVKernels.h"
 
 Mesh::Mesh()
 {
-	model = NULL;
 	error = OK;
+	hasFaceData = false;
+	isUVSetOverride = false;
+	uvSetGroup = 0;
+	surfaceMesh = NULL;
+	frameAreas = NULL;
+	frameStatistic = FrameMean;
 	m_jobs.reserve(32);
 }
 
 Mesh::~Mesh()
 {
-	if (model != NULL)
+	delete frameAreas;
+	frameAreas = NULL;
+
+	// The jobs are released in bulk by the pools that own them
+	m_jobs.clear();
+}
+
+void
+Mesh::ResetUVs()
+{
+	MStatus status;
+	status = model.setUVs(uArray, vArray, &useUVSetName);
+	//CHECK_MSTATUS(status);
+}
+
+bool
+Mesh::GatherFaceData()
+{
+	if (!hasFaceData)
+	{
+		hasFaceData = faceData.Build(model, &useUVSetName);
+	}
+	return hasFaceData;
+}
+
+bool
+Mesh::GatherFaceTriangles()
+{
+	if (!GatherFaceData())
+		return false;
+
+	if (faceData.triangleCounts.length() != faceData.faceVertexCounts.length())
+	{
+		if (!faceData.BuildTriangles(model))
+			return false;
+	}
+	return true;
+}
+
+// Measures the faces (all of them if faces is NULL) from the flat topology,
+// keeping the surface area of each face so the heatmap doesn't measure it again
+bool
+Mesh::GatherFaceAreas(const MIntArray* faces, double& surfaceArea, double& uvArea)
+{
+	surfaceArea = 0.0;
+	uvArea = 0.0;
+
+	if (!GatherFaceTriangles())
+		return false;
+
+	std::vector<double>& surfaceAreas = GetFaceSurfaceAreas();
+	int numMeshFaces = (int)faceData.faceVertexCounts.length();
+	if ((int)surfaceAreas.size() != numMeshFaces)
 	{
-		delete model;
-		model = NULL;
+		surfaceAreas.assign(numMeshFaces, -1.0);
 	}
 
-	// Delete all jobs
+	// The UV triangles of the fully mapped faces are collected and measured together
+	std::vector<int> corners;
+	int numFaces = faces ? (int)faces->length() : numMeshFaces;
+	for (int i = 0; i < numFaces; i++)
 	{
-		std::vector<UVJob*>::reverse_iterator riter;
-		for ( riter = m_jobs.rbegin(); riter != m_jobs.rend(); ++riter )
+		int face = faces ? (*faces)[i] : i;
+
+		if (surfaceAreas[face] < 0.0)
+		{
+			surfaceAreas[face] = GetFaceSurfaceArea(faceData, faceData.points, face);
+		}
+		surfaceArea += surfaceAreas[face];
+
+		if (faceData.uvCounts[face] == faceData.faceVertexCounts[face])
 		{
-			delete (*riter);
+			int numTriangles = faceData.triangleCounts[face];
+			for (int j = 0; j < numTriangles; j++)
+			{
+				int uvIds[3];
+				GetFaceTriangleUVIds(faceData, face, j, uvIds);
+				corners.insert(corners.end(), uvIds, uvIds + 3);
+			}
 		}
-		m_jobs.clear();
 	}
+
+	if (!corners.empty())
+	{
+		uvArea = KernelSumTriangleAreas2D(GetFloatArrayData(uArray), GetFloatArrayData(vArray), &corners[0], (int)corners.size() / 3);
+	}
+
+	// The UVs don't deform, so only the surface area comes from the frame range
+	FrameAreaSampler* sampler = GetFrameAreas();
+	if (sampler != NULL && sampler->IsSampled())
+	{
+		surfaceArea = sampler->GetFacesArea(faces, frameStatistic);
+	}
+	return true;
+}
+
+std::vector<double>&
+Mesh::GetFaceSurfaceAreas()
+{
+	return surfaceMesh ? surfaceMesh->faceSurfaceAreas : faceSurfaceAreas;
+}
+
+FrameAreaSampler*
+Mesh::GetFrameAreas()
+{
+	return surfaceMesh ? surfaceMesh->frameAreas : frameAreas;
+}
+
+// Measures every face over the frame range, once for all the UV sets of the mesh
+bool
+Mesh::GatherFrameAreas(const UVAutoRatioProParams& params)
+{
+	frameStatistic = params.m_frameStatistic;
+
+	Mesh& owner = surfaceMesh ? *surfaceMesh : *this;
+	if (owner.frameAreas != NULL)
+		return owner.frameAreas->IsSampled();
+
+	if (!GatherFaceTriangles())
+		return false;
+
+	std::vector<MTime> times;
+	FrameAreaSampler::GetFrameTimes(params.m_startFrame, params.m_endFrame, params.m_frameStep, times);
+
+	owner.frameAreas = new FrameAreaSampler;
+	return owner.frameAreas->Sample(dagPath, faceData, times);
 }
 
+// Groups the UV indices by shell into the index buffer and points each shell job at its own
 void
-Mesh::ResetUVs()
+Mesh::BuildUVIndices(const MIntArray& uvShellIDs, unsigned int numShells)
 {
 	MStatus status;
-	status = model->setUVs(uArray, vArray, &useUVSetName);
-	//CHECK_MSTATUS(status);
+
+	// shellOffsets[n] is where the indices of shell n start
+	std::vector<int> shellOffsets(numShells + 1, 0);
+	unsigned int numUVs = uvShellIDs.length();
+	for (unsigned int k = 0; k < numUVs; k++)
+	{
+		int shellIndex = uvShellIDs[k];
+		if (shellIndex >= 0 && shellIndex < (int)numShells)
+		{
+			shellOffsets[shellIndex + 1]++;
+		}
+	}
+	for (unsigned int k = 0; k < numShells; k++)
+	{
+		shellOffsets[k + 1] += shellOffsets[k];
+	}
+
+	uvIndexBuffer.resize(shellOffsets[numShells]);
+	{
+		std::vector<int> writePositions(shellOffsets.begin(), shellOffsets.end() - 1);
+		for (unsigned int k = 0; k < numUVs; k++)
+		{
+			int shellIndex = uvShellIDs[k];
+			if (shellIndex >= 0 && shellIndex < (int)numShells)
+			{
+				uvIndexBuffer[writePositions[shellIndex]++] = (int)k;
+			}
+		}
+	}
+
+	for (uint i = 0; i < m_jobs.size(); i++)
+	{
+		ShellJob& job = (ShellJob&)*m_jobs[i];
+		int shellIndex = job.meshShellNumber;
+		if (shellIndex < 0 || shellIndex >= (int)numShells)
+			continue;
+
+		int numIndices = shellOffsets[shellIndex + 1] - shellOffsets[shellIndex];
+		if (numIndices > 0)
+		{
+			job.uvIndices = &uvIndexBuffer[shellOffsets[shellIndex]];
+			job.numIndices = numIndices;
+
+			MFnSingleIndexedComponent uvComponents;
+			job.uvComponentObject = uvComponents.create(MFn::kMeshMapComponent, &status);
+			MIntArray elements(job.uvIndices, numIndices);
+			uvComponents.addElements(elements);
+		}
+	}
+}
+
+// Reads the shell of each UV from the current UV set, which must be the one gathered
+bool
+Mesh::BuildUVIndices()
+{
+	MIntArray uvShellIDs;
+	unsigned int numShells = 0;
+	if (model.getUvShellsIds(uvShellIDs, numShells) != MS::kSuccess)
+		return false;
+
+	BuildUVIndices(uvShellIDs, numShells);
+	return true;
+}
+
+// Frees the UV copies, topology and face areas, leaving only the per-job results
+// needed by layout, normalise and apply, and the UV indices if apply is still to come
+void
+Mesh::ReleaseGatherData(bool isUVIndexKept)
+{
+	uArray.clear();
+	vArray.clear();
+	faceData.Clear();
+	hasFaceData = false;
+
+	// Shared with the other UV sets of the mesh, they measure again if they need them
+	std::vector<double> emptyAreas;
+	GetFaceSurfaceAreas().swap(emptyAreas);
+
+	Mesh& owner = surfaceMesh ? *surfaceMesh : *this;
+	delete owner.frameAreas;
+	owner.frameAreas = NULL;
+
+	for (uint i = 0; i < m_jobs.size(); i++)
+	{
+		m_jobs[i]->ReleaseGatherData(isUVIndexKept);
+	}
+
+	if (!isUVIndexKept)
+	{
+		std::vector<int> empty;
+		uvIndexBuffer.swap(empty);
+	}
 }
 
 void
@@ -56,16 +265,17 @@ Mesh::Gather(Processor& processor, bool isUVSetOverride, bool isFallback, const
 	MStatus status;
 
 	// Mesh data
-	model = new MFnMesh(dagPath, &status);
+	status = model.setObject(dagPath);
 	if (status != MS::kSuccess)
 	{
 		error = INVALID_MESH;
 		return;
 	}
-	name = model->name();
+	name = model.name();
+	pathName = dagPath.fullPathName();
 
 	// Find the UV set to use
-	UVSetResult uvSetResult = FindUVSet(*model, isUVSetOverride, isFallback, UVSetName);
+	UVSetResult uvSetResult = FindUVSet(model, isUVSetOverride, isFallback, UVSetName);
 	if (uvSetResult == NONE)
 	{
 		error = UVSET_NOTFOUND;
@@ -73,7 +283,7 @@ Mesh::Gather(Processor& processor, bool isUVSetOverride, bool isFallback, const
 	}
 	else
 	{
-		currentUVSetName = GetCurrentUVSetName(*model);
+		currentUVSetName = GetCurrentUVSetName(model);
 
 		switch (uvSetResult)
 		{
@@ -82,42 +292,60 @@ Mesh::Gather(Processor& processor, bool isUVSetOverride, bool isFallback, const
 			break;
 		case OVERRIDE:
 			useUVSetName = UVSetName;
-			model->setCurrentUVSetName(useUVSetName);
+			model.setCurrentUVSetName(useUVSetName);
 			break;
 		case NONE:
 			break;
 		}
 	}
 
-	UVAutoRatioPro::SetNumSubTasks((int)m_jobs.size(), "Jobs");
+	// Get the UV's, these are shared by all the jobs of the mesh
+	status = model.getUVs(uArray, vArray, &useUVSetName);
+
+	processor.GatherMesh(*this);
+
+	if (processor.m_params.m_isFrameRange)
+	{
+		if (!GatherFrameAreas(processor.m_params))
+		{
+			MGlobal::displayWarning("UVAR: " + name + " could not be measured over the frame range, using the current frame");
+		}
+	}
+
+	processor.m_progress->SetNumSubTasks((int)m_jobs.size(), "Jobs");
 	for (uint i = 0; i < m_jobs.size(); i++)
 	{
-		if (UVAutoRatioPro::IsProgressCancelled())
+		if (processor.m_progress->Poll())
 			break;
 
-		UVAutoRatioPro::StepJobProgress();
+		processor.m_progress->Step();
 
 		UVJob& job = *m_jobs[i];
 		processor.Gather(job);
 	}
+
+	// Other UV sets of this mesh are gathered as their own records, each has
+	// to find the set that was current before the run
+	RestoreUVSet();
 }
 
 void
 Mesh::FindScale(Processor& processor, double goalRatio, double threshold)
 {
-	// if an alternative uvset was used, restore the previous one
-	if (useUVSetName != currentUVSetName)
+	// Only the iterative solvers read the UV area back from the mesh
+	bool isUVSetChanged = (useUVSetName != currentUVSetName && !processor.IsSolveThreadSafe());
+	if (isUVSetChanged)
 	{
-		model->setCurrentUVSetName(useUVSetName);
+		model.setCurrentUVSetName(useUVSetName);
 	}
 
-	UVAutoRatioPro::SetNumSubTasks((int)m_jobs.size(), "Jobs");
+	processor.m_progress->SetNumSubTasks((int)m_jobs.size(), "Jobs");
 	for (uint i = 0; i < m_jobs.size(); i++)
 	{
-		if (UVAutoRatioPro::IsProgressCancelled())
+		if (processor.m_progress->Poll())
 			break;
 
-		UVAutoRatioPro::StepJobProgress();
+		processor.m_progress->Step();
 
 		UVJob& job = *m_jobs[i];
 		if (!job.error)
@@ -131,18 +359,83 @@ Mesh::FindScale(Processor& processor, double goalRatio, double threshold)
 			}
 		}
 	}
+
+	if (isUVSetChanged)
+	{
+		RestoreUVSet();
+	}
 }
 
 void
 Mesh::ApplyScale(Processor& processor)
 {
-	UVAutoRatioPro::SetNumSubTasks((int)m_jobs.size(), "Jobs");
+	processor.m_progress->SetNumSubTasks((int)m_jobs.size(), "Jobs");
+
+	// Without construction history the new UVs can be written straight to the mesh
+	// in one go and journalled for undo, instead of adding a polyMoveUV per job
+	if (processor.m_undoJournal != NULL && !HasConstructionHistory())
+	{
+		MStatus status;
+		MFloatArray originalU, originalV;
+		status = model.getUVs(originalU, originalV, &useUVSetName);
+		if (status == MS::kSuccess)
+		{
+			MFloatArray newU, newV;
+			newU.copy(originalU);
+			newV.copy(originalV);
+
+			bool isTransformed = true;
+			for (uint i = 0; i < m_jobs.size() && isTransformed; i++)
+			{
+				UVJob& job = *m_jobs[i];
+				if (!job.error)
+				{
+					isTransformed = processor.TransformUVs(job, newU, newV);
+				}
+			}
+
+			if (isTransformed && !processor.m_progress->Poll())
+			{
+				status = model.setUVs(newU, newV, &useUVSetName);
+				if (status == MS::kSuccess)
+				{
+					processor.m_undoJournal->Record(dagPath, useUVSetName, originalU, originalV, newU, newV);
+
+					for (uint i = 0; i < m_jobs.size(); i++)
+					{
+						processor.m_progress->Step();
+						if (!m_jobs[i]->error)
+						{
+							m_jobs[i]->completed = true;
+						}
+					}
+
+					RestoreUVSet();
+					return;
+				}
+			}
+		}
+	}
+
+	// polyMoveUV and ConvertSelectionToUVs only work on the current UV set
+	if (useUVSetName != currentUVSetName)
+	{
+		model.setCurrentUVSetName(useUVSetName);
+	}
+
+	if (processor.m_params.m_isBatchApply)
+	{
+		ApplyBatched(processor);
+		RestoreUVSet();
+		return;
+	}
+
 	for (uint i = 0; i < m_jobs.size(); i++)
 	{
-		if (UVAutoRatioPro::IsProgressCancelled())
+		if (processor.m_progress->Poll())
 			break;
 
-		UVAutoRatioPro::StepJobProgress();
+		processor.m_progress->Step();
 
 		UVJob& job = *m_jobs[i];
 		if (!job.error)
@@ -154,13 +447,147 @@ Mesh::ApplyScale(Processor& processor)
 		}
 	}
 
-	// if an alternative uvset was used, restore the previous one
+	RestoreUVSet();
+}
+
+// Queues the polyMoveUV of every job in one modifier and runs them together, so nothing is
+// selected and the mesh is evaluated once at the end.  If cancelled nothing is applied.
+void
+Mesh::ApplyBatched(Processor& processor)
+{
+	MDGModifier* modifier = new MDGModifier;
+	std::vector<UVJob*> queuedJobs;
+	std::vector<UVJob*> selectedJobs;
+	for (uint i = 0; i < m_jobs.size(); i++)
+	{
+		if (processor.m_progress->Poll())
+		{
+			delete modifier;
+			return;
+		}
+
+		processor.m_progress->Step();
+
+		UVJob& job = *m_jobs[i];
+		if (job.error || (job.finalScaleX == 1.0 && job.finalScaleY == 1.0 && job.offsetU == 0.0 && job.offsetV == 0.0))
+			continue;
+
+		MString components;
+		if (processor.GetApplyComponents(job, components))
+		{
+			modifier->commandToExecute(processor.GetMoveUVCommand(job, components));
+			queuedJobs.push_back(&job);
+		}
+		else
+		{
+			selectedJobs.push_back(&job);
+		}
+	}
+
+	if (queuedJobs.empty())
+	{
+		delete modifier;
+	}
+	else
+	{
+		if (modifier->doIt() == MS::kSuccess)
+		{
+			for (size_t i = 0; i < queuedJobs.size(); i++)
+			{
+				queuedJobs[i]->completed = true;
+			}
+		}
+
+		if (processor.m_undoHistory != NULL)
+			processor.m_undoHistory->push_back(modifier);
+		else
+			delete modifier;
+	}
+
+	// Jobs whose UVs were released by streaming are selected as usual
+	for (size_t i = 0; i < selectedJobs.size(); i++)
+	{
+		if (processor.m_progress->Poll())
+			break;
+
+		processor.ApplyScale(*selectedJobs[i]);
+	}
+}
+
+// if an alternative uvset was used, restore the previous one
+void
+Mesh::RestoreUVSet()
+{
 	if (useUVSetName != currentUVSetName)
 	{
-		model->setCurrentUVSetName(currentUVSetName);
+		model.setCurrentUVSetName(currentUVSetName);
 	}
 }
 
+bool
+Mesh::HasConstructionHistory() const
+{
+	MStatus status;
+	MFnDependencyNode node(dagPath.node(), &status);
+	if (status != MS::kSuccess)
+		return true;
+
+	MPlug inMeshPlug = node.findPlug("inMesh", &status);
+	if (status != MS::kSuccess)
+		return true;
+
+	return inMeshPlug.isConnected();
+}
+
+void
+Processor::GetAxisScale(const UVJob& job, double& scaleU, double& scaleV) const
+{
+	scaleU = job.finalScaleX;
+	scaleV = job.finalScaleY;
+	switch (m_params.m_scalingAxis)
+	{
+	case Both:
+		break;
+	case Horizontal:
+		scaleV = 1.0;
+		break;
+	case Vertical:
+		scaleU = 1.0;
+		break;
+	}
+}
+
+MString
+Processor::GetMoveUVCommand(const UVJob& job, const MString& components) const
+{
+	const char* command = "polyMoveUV -pivot %.20f %.20f -scale %.20f %.20f -translate %.20f %.20f ";
+
+	double scaleU, scaleV;
+	GetAxisScale(job, scaleU, scaleV);
+
+	char text[512];
+#ifdef WIN32
+	sprintf_s(text, sizeof(text), command, job.centerU, job.centerV, scaleU, scaleV, job.offsetU, job.offsetV);
+#else
+	sprintf(text, command, job.centerU, job.centerV, scaleU, scaleV, job.offsetU, job.offsetV);
+#endif
+	return MString(text) + components;
+}
+
+bool
+Processor::IsMeasuringFaces(const Mesh& mesh) const
+{
+	return m_params.m_isColour || m_params.m_isFrameRange || mesh.surfaceMesh != NULL;
+}
+
+// Same transform as "polyMoveUV -pivot -scale -translate"
+void
+Processor::TransformUV(const UVJob& job, double scaleU, double scaleV, float& u, float& v) const
+{
+	u = (float)((u - job.centerU) * scaleU + job.centerU + job.offsetU);
+	v = (float)((v - job.centerV) * scaleV + job.centerV + job.offsetV);
+}
+
 UVJob::UVJob()
 {
 	error = OK;
@@ -176,6 +603,8 @@ UVJob::UVJob()
 	offsetU = offsetV = 0.0;
 
 	mesh = NULL;
+	layoutShape = NULL;
+	udimTile = -1;
 }
 
 
@@ -183,6 +612,11 @@ UVJob::~UVJob()
 {
 }
 
+void
+UVJob::ReleaseGatherData(bool /*isUVIndexKept*/)
+{
+}
+
 MeshJob::MeshJob() : UVJob()
 {
 }
@@ -195,23 +629,26 @@ ShellJob::ShellJob() : UVJob()
 {
 	meshShellNumber = 0;
 	uvIndices = NULL;
-	uvComponents = NULL;
 	numIndices = 0;
+	contentHash = 0;
+	checkHash = 0;
+	anchorU = anchorV = 0.0f;
+	cacheEntry = NULL;
+	isCacheHit = false;
 }
 
 ShellJob::~ShellJob()
 {
-	if (uvIndices != NULL)
-	{
-		delete [] uvIndices;
-		uvIndices = NULL;
-	}
+}
 
-	if (uvComponents != NULL)
+void
+ShellJob::ReleaseGatherData(bool isUVIndexKept)
+{
+	if (!isUVIndexKept)
 	{
-		delete uvComponents;
-		uvComponents = NULL;
+		uvIndices = NULL;
 	}
+	uvComponentObject = MObject::kNullObj;
 }
 
 
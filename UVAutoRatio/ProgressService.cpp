@@ -0,0 +1,167 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "ThreadUtility.h"
+#include "ProgressService.h"
+
+ProgressService::ProgressService()
+{
+	m_hasWindow = false;
+	m_phaseMessage = "";
+	m_subTaskName = "";
+	AtomicSet(&m_phase, 0);
+	AtomicSet(&m_subTasks, 0);
+	AtomicSet(&m_subTasksDone, 0);
+	AtomicSet(&m_cancelled, 0);
+	AtomicSet(&m_finished, 0);
+}
+
+// Only shown in interactive sessions
+void
+ProgressService::StartWindow()
+{
+	if (MGlobal::mayaState() != MGlobal::kInteractive)
+		return;
+
+	MProgressWindow::reserve();
+	MProgressWindow::setTitle("UVAutoRatio");
+	MProgressWindow::setProgressMin(0);
+	MProgressWindow::setProgressMax(NumPhases * PhaseSize);
+	MProgressWindow::setInterruptable(true);
+	MProgressWindow::startProgress();
+
+	m_hasWindow = true;
+	m_sampleTimer.reset();
+	UpdateWindow();
+}
+
+void
+ProgressService::EndWindow()
+{
+	if (m_hasWindow)
+	{
+		MProgressWindow::endProgress();
+		m_hasWindow = false;
+	}
+}
+
+void
+ProgressService::SetPhase(int phase, const char* message)
+{
+	m_phaseMessage = message;
+	m_subTaskName = "";
+	AtomicSet(&m_subTasks, 0);
+	AtomicSet(&m_subTasksDone, 0);
+	AtomicSet(&m_phase, phase);
+
+	if (m_hasWindow)
+	{
+		m_sampleTimer.reset();
+		UpdateWindow();
+	}
+}
+
+void
+ProgressService::SetNumSubTasks(int tasks, const char* name)
+{
+	m_subTaskName = name;
+	AtomicSet(&m_subTasksDone, 0);
+	AtomicSet(&m_subTasks, tasks);
+}
+
+void
+ProgressService::Step()
+{
+	AtomicIncrement(&m_subTasksDone);
+}
+
+void
+ProgressService::Cancel()
+{
+	AtomicSet(&m_cancelled, 1);
+}
+
+bool
+ProgressService::IsCancelled() const
+{
+	return (m_cancelled != 0);
+}
+
+bool
+ProgressService::Poll()
+{
+	if (m_hasWindow && m_sampleTimer.getTime() >= (float)SampleInterval)
+	{
+		m_sampleTimer.reset();
+
+		if (MProgressWindow::isCancelled())
+		{
+			Cancel();
+		}
+		UpdateWindow();
+	}
+
+	return IsCancelled();
+}
+
+void
+ProgressService::SetFinished()
+{
+	AtomicSet(&m_finished, 1);
+}
+
+bool
+ProgressService::IsFinished() const
+{
+	return (m_finished != 0);
+}
+
+int
+ProgressService::GetProgress() const
+{
+	int progress = m_phase * PhaseSize;
+	int tasks = m_subTasks;
+	if (tasks > 0)
+	{
+		int done = m_subTasksDone;
+		if (done > tasks)
+			done = tasks;
+		progress += (int)(((double)done * PhaseSize) / (double)tasks);
+	}
+	return progress;
+}
+
+void
+ProgressService::UpdateWindow()
+{
+	int progress = GetProgress();
+	MProgressWindow::setProgress(progress);
+
+	// Update percentage display
+	int percent = (progress * 100) / (NumPhases * PhaseSize);
+	MString message = "";
+	message += percent;
+	message += "%   ";
+	message += m_phaseMessage;
+	int done = m_subTasksDone;
+	if (done > 0)
+	{
+		message += done;
+		message += "/";
+		message += m_subTasks;
+		message += " ";
+		message += m_subTaskName;
+	}
+	MProgressWindow::setProgressStatus(message);
+}
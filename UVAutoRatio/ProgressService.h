@@ -0,0 +1,68 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef PROGRESSSERVICE_H
+#define PROGRESSSERVICE_H
+
+#include "Timer.h"
+
+// Progress and cancellation of one run of the command.
+// Step() and IsCancelled() only touch atomic counters so any thread may call them.
+// Poll() is for the main thread, it copies the counters to the progress window and
+// checks the window's cancel button, but no more often than every SampleInterval ms.
+class ProgressService
+{
+public:
+	enum
+	{
+		PhaseSize = 1000,
+		NumPhases = 6,
+		SampleInterval = 100,
+	};
+
+	ProgressService();
+
+	void	StartWindow();
+	void	EndWindow();
+
+	void	SetPhase(int phase, const char* message);
+	void	SetNumSubTasks(int tasks, const char* name);
+	void	Step();
+
+	void	Cancel();
+	bool	IsCancelled() const;
+	bool	Poll();
+
+	void	SetFinished();
+	bool	IsFinished() const;
+
+	// 0 to NumPhases * PhaseSize
+	int		GetProgress() const;
+
+private:
+	void	UpdateWindow();
+
+	bool			m_hasWindow;
+	Timer			m_sampleTimer;
+
+	const char*		m_phaseMessage;
+	const char*		m_subTaskName;
+
+	volatile int	m_phase;
+	volatile int	m_subTasks;
+	volatile int	m_subTasksDone;
+	volatile int	m_cancelled;
+	volatile int	m_finished;
+};
+
+#endif
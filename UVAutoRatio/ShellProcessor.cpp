@@ -12,10 +12,13 @@
 //
 
 #include "MayaPCH.h"
+#include <algorithm>
+#include <string>
 #include "Utility.h"
 #include "Timer.h"
-#include "UVAutoRatioPro.h"
+#include "UVKernels.h"
 #include "ShellProcessor.h"
+#include "ProgressService.h"
 
 // Scales the mesh UV's by a factor
 // Note: if the mesh has history that modifies the UV's, this operation will be overridden
@@ -33,39 +36,26 @@ ShellProcessor::ScaleMeshUVs(ShellJob& job, double scale)
 	vArray.copy(job.mesh->vArray);
 	assert(uArray.length() == vArray.length());
 	int i = 0;
+	for (i = 0; i < job.numIndices; i++)
+	{
+		assert((unsigned int)job.uvIndices[i] < uArray.length());
+	}
 
 	// scale UV's
 	//if (!aboutCenter)
+	if (job.numIndices > 0)
 	{		
 		switch (m_params.m_scalingAxis)
 		{
 		case Both:
-			for (i = 0; i < job.numIndices; i++)
-			{
-				unsigned int index = job.uvIndices[i];
-				assert(index < uArray.length());
-
-				uArray[index] *= (float)scale;
-				vArray[index] *= (float)scale;
-			}
+			KernelScaleIndexed(&uArray[0], job.uvIndices, job.numIndices, (float)scale);
+			KernelScaleIndexed(&vArray[0], job.uvIndices, job.numIndices, (float)scale);
 			break;
 		case Horizontal:
-			for (i = 0; i < job.numIndices; i++)
-			{
-				unsigned int index = job.uvIndices[i];
-				assert(index < uArray.length());
-
-				uArray[index] *= (float)scale;
-			}
+			KernelScaleIndexed(&uArray[0], job.uvIndices, job.numIndices, (float)scale);
 			break;
 		case Vertical:
-			for (i = 0; i < job.numIndices; i++)
-			{
-				unsigned int index = job.uvIndices[i];
-				assert(index < uArray.length());
-
-				vArray[index] *= (float)scale;
-			}
+			KernelScaleIndexed(&vArray[0], job.uvIndices, job.numIndices, (float)scale);
 			break;
 		}
 	}
@@ -92,7 +82,7 @@ ShellProcessor::ScaleMeshUVs(ShellJob& job, double scale)
 	}*/
 
 	// set mesh UV's
-	status = job.mesh->model->setUVs(uArray, vArray, &job.mesh->useUVSetName);
+	status = job.mesh->model.setUVs(uArray, vArray, &job.mesh->useUVSetName);
 }
 
 
@@ -200,6 +190,34 @@ ShellProcessor::FindScale(UVJob& uvjob)
 {
 	ShellJob& job = (ShellJob&)uvjob;
 
+	// Identical shells converge to the same scale, so only solve the first one
+	ShellCacheEntry* entry = job.cacheEntry;
+	if (entry != NULL && entry->hasScale)
+	{
+		job.error = entry->scaleError;
+		job.finalScaleX = entry->finalScaleX;
+		job.finalScaleY = entry->finalScaleY;
+		job.finalTextureArea = entry->finalTextureArea;
+		job.iterationsPerformed = entry->iterationsPerformed;
+		return;
+	}
+
+	FindScaleUncached(job);
+
+	if (entry != NULL)
+	{
+		entry->hasScale = true;
+		entry->scaleError = job.error;
+		entry->finalScaleX = job.finalScaleX;
+		entry->finalScaleY = job.finalScaleY;
+		entry->finalTextureArea = job.finalTextureArea;
+		entry->iterationsPerformed = job.iterationsPerformed;
+	}
+}
+
+void
+ShellProcessor::FindScaleUncached(ShellJob& job)
+{
 	bool fast = true;
 
 	if (m_params.m_scalingAxis != Both)
@@ -272,6 +290,16 @@ ShellProcessor::FindScale(UVJob& uvjob)
 	}
 }
 
+// Streamed runs group the UV indices of a mesh only when its chunk is gathered
+void
+ShellProcessor::GatherMesh(Mesh& mesh)
+{
+	if (mesh.uvIndexBuffer.empty())
+	{
+		mesh.BuildUVIndices();
+	}
+}
+
 void
 ShellProcessor::Gather(UVJob& uvjob)
 {
@@ -279,24 +307,94 @@ ShellProcessor::Gather(UVJob& uvjob)
 
 	ShellJob& job = (ShellJob&)uvjob;
 
-	job.uvComponents = new MFnSingleIndexedComponent(job.uvComponentObject);
+	// The UV indices are grouped into the mesh's index buffer before its jobs are gathered
+	if (job.uvIndices == NULL || job.numIndices <= 0)
+	{
+		job.error = INVALID_MESH;
+		return;
+	}
+
+	// Get face components from UV components
+	UVToFaceComponents(job.mesh->dagPath, job.uvComponentObject, job.faceComponentObject);
+
+	// The UV's have already been read by the mesh
+	assert(job.mesh->uArray.length() == job.mesh->vArray.length());
+	if (job.mesh->uArray.length() != job.mesh->vArray.length())
+	{
+		job.error = U_V_LISTS_DIFFERENT_LENGTHS;
+		return;
+	}
 
-	// Get UV indices
+	// Shells with the same content as an earlier shell reuse its results
+	int numFaces = 0;
+	if (m_params.m_isShellCache && HashShell(job, numFaces))
 	{
-		job.numIndices = job.uvComponents->elementCount();
-		job.uvIndices = new int[job.numIndices];
-		for (int i = 0; i < job.numIndices; i++)
+		ShellCache::iterator iter = m_shellCache.find(job.contentHash);
+		if (iter == m_shellCache.end())
 		{
-			int index = job.uvComponents->element(i);
-			job.uvIndices[i] = index;
+			GatherAreas(job);
+
+			ShellCacheEntry entry;
+			entry.checkHash = job.checkHash;
+			entry.numFaces = numFaces;
+			entry.numUVs = job.numIndices;
+			entry.gatherError = job.error;
+			entry.surfaceArea = job.surfaceArea;
+			entry.textureArea = job.textureArea;
+			entry.uvWidth = job.uvWidth;
+			entry.uvHeight = job.uvHeight;
+			entry.centerU = job.centerU - job.anchorU;
+			entry.centerV = job.centerV - job.anchorV;
+			entry.hasScale = false;
+			entry.scaleError = OK;
+			entry.finalScaleX = entry.finalScaleY = 1.0;
+			entry.finalTextureArea = 0.0;
+			entry.iterationsPerformed = 0;
+
+			iter = m_shellCache.insert(ShellCache::value_type(job.contentHash, entry)).first;
+			job.cacheEntry = &iter->second;
+			return;
+		}
+
+		ShellCacheEntry& entry = iter->second;
+		if (entry.checkHash == job.checkHash && entry.numFaces == numFaces && entry.numUVs == job.numIndices)
+		{
+			job.cacheEntry = &entry;
+			job.isCacheHit = true;
+			job.error = entry.gatherError;
+			job.surfaceArea = entry.surfaceArea;
+			job.textureArea = entry.textureArea;
+			job.finalTextureArea = entry.textureArea;
+			job.uvWidth = entry.uvWidth;
+			job.uvHeight = entry.uvHeight;
+			job.centerU = job.anchorU + entry.centerU;
+			job.centerV = job.anchorV + entry.centerV;
+			return;
 		}
 	}
 
-	// Get face components from UV components
-	UVToFaceComponents(job.mesh->dagPath, job.uvComponentObject, job.faceComponentObject);
+	GatherAreas(job);
+}
+
+void
+ShellProcessor::GatherAreas(ShellJob& job)
+{
+	// Get area, measuring each face when colouring or sharing surface areas between UV sets
+	bool isMeasured = false;
+	if (IsMeasuringFaces(*job.mesh) && !job.faceComponentObject.isNull())
+	{
+		MIntArray faces;
+		MFnSingleIndexedComponent faceComponents(job.faceComponentObject);
+		faceComponents.getElements(faces);
+		isMeasured = job.mesh->GatherFaceAreas(&faces, job.surfaceArea, job.textureArea);
+	}
+	if (!isMeasured)
+	{
+		job.textureArea = GetAreaFacesUV(job.mesh->dagPath, job.faceComponentObject, &job.mesh->useUVSetName);
+		if (job.textureArea != 0.0)
+			job.surfaceArea = GetAreaFacesSurface(job.mesh->dagPath, job.faceComponentObject, true);
+	}
 
-	// Get area
-	job.textureArea = GetAreaFacesUV(job.mesh->dagPath, job.faceComponentObject, &job.mesh->useUVSetName);
 	job.finalTextureArea = job.textureArea;
 	if (job.textureArea == 0.0)
 	{
@@ -304,22 +402,12 @@ ShellProcessor::Gather(UVJob& uvjob)
 		return;
 	}
 
-	job.surfaceArea = GetAreaFacesSurface(job.mesh->dagPath, job.faceComponentObject, true);
 	if (job.surfaceArea == 0.0)
 	{
 		job.error = ZERO_SURFACE_AREA;
 		return;
 	}
 
-	// Get the UV's
-	status = job.mesh->model->getUVs(job.mesh->uArray, job.mesh->vArray, &job.mesh->useUVSetName);
-	assert(job.mesh->uArray.length() == job.mesh->vArray.length());
-	if (job.mesh->uArray.length() != job.mesh->vArray.length())
-	{
-		job.error = U_V_LISTS_DIFFERENT_LENGTHS;
-		return;
-	}
-
 	// Find the UV center, width & height
 	double minU, maxU, minV, maxV;
 	GetMinMaxValues(job.mesh->uArray, job.uvIndices, job.numIndices, minU, maxU);
@@ -330,6 +418,91 @@ ShellProcessor::Gather(UVJob& uvjob)
 	job.uvHeight = maxV - minV;
 }
 
+// Adds a value to both of the shell's hashes
+static inline void
+HashShellValue(UVHash& hash, UVHash& check, int value)
+{
+	HashCombine(hash, value);
+	HashCombineCheck(check, (UVHash)(UVHashCell)value);
+}
+
+static inline void
+HashShellValue(UVHash& hash, UVHash& check, double value, double resolution)
+{
+	UVHash cell = QuantizeHash(value, resolution);
+	HashCombine64(hash, cell);
+	HashCombineCheck(check, cell);
+}
+
+// Hashes the topology, UV's and local geometry of a shell.
+// Everything is made relative to the first face-vertex of the shell so that
+// copies which have been moved in 3D or UV space still hash the same.
+bool
+ShellProcessor::HashShell(ShellJob& job, int& numFaces)
+{
+	const double uvResolution = 1.0e-6;
+	const double pointResolution = 1.0e-4;
+
+	Mesh& mesh = *job.mesh;
+	if (job.faceComponentObject.isNull() || !mesh.GatherFaceData())
+		return false;
+
+	MIntArray faces;
+	MFnSingleIndexedComponent faceComponents(job.faceComponentObject);
+	faceComponents.getElements(faces);
+	numFaces = (int)faces.length();
+	if (numFaces == 0)
+		return false;
+
+	const MeshFaceData& data = mesh.faceData;
+	int firstFace = faces[0];
+	if (data.uvCounts[firstFace] == 0)
+		return false;
+
+	int anchorVertex = data.vertexIds[data.faceVertexOffsets[firstFace]];
+	int anchorUV = data.uvIds[data.uvOffsets[firstFace]];
+	const MPoint& anchorPoint = data.points[anchorVertex];
+	job.anchorU = mesh.uArray[anchorUV];
+	job.anchorV = mesh.vArray[anchorUV];
+
+	UVHash hash = UVHashSeed;
+	UVHash check = 0;
+	HashShellValue(hash, check, numFaces);
+	HashShellValue(hash, check, job.numIndices);
+	for (int i = 0; i < numFaces; i++)
+	{
+		int face = faces[i];
+		int count = data.faceVertexCounts[face];
+
+		// Faces that aren't fully mapped can't be compared
+		if (data.uvCounts[face] != count)
+			return false;
+
+		HashShellValue(hash, check, count);
+
+		int vertexOffset = data.faceVertexOffsets[face];
+		int uvOffset = data.uvOffsets[face];
+		for (int k = 0; k < count; k++)
+		{
+			int vertex = data.vertexIds[vertexOffset + k];
+			int uv = data.uvIds[uvOffset + k];
+			const MPoint& point = data.points[vertex];
+
+			HashShellValue(hash, check, vertex - anchorVertex);
+			HashShellValue(hash, check, uv - anchorUV);
+			HashShellValue(hash, check, mesh.uArray[uv] - job.anchorU, uvResolution);
+			HashShellValue(hash, check, mesh.vArray[uv] - job.anchorV, uvResolution);
+			HashShellValue(hash, check, point.x - anchorPoint.x, pointResolution);
+			HashShellValue(hash, check, point.y - anchorPoint.y, pointResolution);
+			HashShellValue(hash, check, point.z - anchorPoint.z, pointResolution);
+		}
+	}
+
+	job.contentHash = hash;
+	job.checkHash = check;
+	return true;
+}
+
 void
 ShellProcessor::ApplyScale(UVJob& uvjob)
 {
@@ -345,48 +518,26 @@ ShellProcessor::ApplyScale(UVJob& uvjob)
 	status = MGlobal::select(job.mesh->dagPath, job.faceComponentObject);
 	status = MGlobal::executeCommand("ConvertSelectionToUVs;");
 
-	if (UVAutoRatioPro::IsProgressCancelled())
+	if (m_progress->Poll())
 		return;
 
-	// Execute UV scale MEL command
-	//const char* command = "polyEditUV -relative true -pivotU %.20f -pivotV %.20f -scale true -scaleU %.20f -scaleV %.20f -uValue %.20f -vValue %.20f";
-	const char* command = "polyMoveUV -pivot %.20f %.20f -scale %.20f %.20f -translate %.20f %.20f";
-
-	double scaleU = job.finalScaleX;
-	double scaleV = job.finalScaleY;
-	switch (m_params.m_scalingAxis)
-	{
-	case Both:
-		break;
-	case Horizontal:
-		scaleV = 1.0;
-		break;
-	case Vertical:
-		scaleU = 1.0;
-		break;
-	}
-
-	static char text[2048];
-#ifdef WIN32
-	sprintf_s(text, sizeof(text), command, job.centerU, job.centerV, scaleU, scaleV, job.offsetU, job.offsetV);
-#else
-	sprintf(text, command, job.centerU, job.centerV, scaleU, scaleV, job.offsetU, job.offsetV);
-#endif
+	// Execute UV scale MEL command on the selected UVs
+	MString command = GetMoveUVCommand(job, MString());
 
 	if (m_undoHistory != NULL)
 	{
 		MDGModifier* modifier = new MDGModifier;
 		m_undoHistory->push_back(modifier);
-		status = modifier->commandToExecute(text);
+		status = modifier->commandToExecute(command);
 		status = modifier->doIt();
 	}
 	else
 	{
-		MGlobal::executeCommand(text);
+		MGlobal::executeCommand(command);
 	}
 
 /*
-	if (UVAutoRatioPro::IsProgressCancelled())
+	if (m_progress->Poll())
 		return;
 
 	if (job.offsetU != 0.0 || job.offsetV != 0.0)
@@ -413,4 +564,87 @@ ShellProcessor::ApplyScale(UVJob& uvjob)
 	}
 */
 	job.completed = true;
-}
\ No newline at end of file
+}
+// Only the fast path is worked out from the gathered areas alone,
+// restricting the axis falls back to scaling the mesh and reading the area back
+bool
+ShellProcessor::IsSolveThreadSafe() const
+{
+	return (m_params.m_scalingAxis == Both);
+}
+
+// The shell's UV ids as runs, such as |pCube1|pCubeShape1.map[0:11] |pCube1|pCubeShape1.map[14]
+bool
+ShellProcessor::GetApplyComponents(const UVJob& uvjob, MString& components) const
+{
+	const ShellJob& job = (const ShellJob&)uvjob;
+	if (job.uvIndices == NULL || job.numIndices <= 0 || !job.mesh->dagPath.isValid())
+		return false;
+
+	std::vector<int> uvIds(job.uvIndices, job.uvIndices + job.numIndices);
+	std::sort(uvIds.begin(), uvIds.end());
+
+	std::string path = job.mesh->dagPath.fullPathName().asChar();
+	std::string text;
+	char run[64];
+	int first = uvIds[0];
+	for (int i = 1; i <= job.numIndices; i++)
+	{
+		if (i < job.numIndices && uvIds[i] <= uvIds[i - 1] + 1)
+			continue;
+
+		int last = uvIds[i - 1];
+#ifdef WIN32
+		if (first == last)
+			sprintf_s(run, sizeof(run), ".map[%i] ", first);
+		else
+			sprintf_s(run, sizeof(run), ".map[%i:%i] ", first, last);
+#else
+		if (first == last)
+			sprintf(run, ".map[%i] ", first);
+		else
+			sprintf(run, ".map[%i:%i] ", first, last);
+#endif
+		text += path;
+		text += run;
+
+		if (i < job.numIndices)
+			first = uvIds[i];
+	}
+
+	components = text.c_str();
+	return true;
+}
+
+bool
+ShellProcessor::TransformUVs(UVJob& uvjob, MFloatArray& uArray, MFloatArray& vArray)
+{
+	ShellJob& job = (ShellJob&)uvjob;
+
+	if (job.finalScaleX == 1.0 && job.finalScaleY == 1.0 && job.offsetU == 0.0 && job.offsetV == 0.0)
+		return true;
+
+	// The shell's UV indices are gone once its gather data has been released
+	if (job.uvIndices == NULL)
+		return false;
+
+	double scaleU, scaleV;
+	GetAxisScale(job, scaleU, scaleV);
+
+	// Checked before any are moved, so a bad index leaves the UVs untouched
+	uint numUVs = uArray.length();
+	for (int i = 0; i < job.numIndices; i++)
+	{
+		uint index = (uint)job.uvIndices[i];
+		if (index >= numUVs)
+			return false;
+	}
+
+	if (job.numIndices > 0)
+	{
+		KernelTransformIndexed(&uArray[0], job.uvIndices, job.numIndices, job.centerU, scaleU, job.offsetU);
+		KernelTransformIndexed(&vArray[0], job.uvIndices, job.numIndices, job.centerV, scaleV, job.offsetV);
+	}
+
+	return true;
+}
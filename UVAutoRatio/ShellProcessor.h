@@ -16,6 +16,9 @@
 
 #include <iostream>
 #include <vector>
+#include <map>
+#include "Utility.h"
+#include "FrameAreaSampler.h"
 
 enum OperationMode
 {
@@ -30,6 +33,43 @@ enum ScaleDirection
 	Vertical
 };
 
+enum LayoutScope
+{
+	LayoutGlobal,		// All the shells of a UV set in one layout
+	LayoutPerMesh,		// Each mesh on its own
+	LayoutClustered,	// Each mesh on its own, then the meshes as rigid clusters
+};
+
+enum LayoutMethod
+{
+	LayoutSprings,		// Push overlapping shells apart
+	LayoutBitmapPack,	// Pack the rasterised shells into an atlas
+};
+
+enum UdimMode
+{
+	UdimNone,			// All the shells in one space
+	UdimByMaterial,		// A tile for each shading group
+	UdimByMesh,			// A tile for each mesh
+	UdimByArea,			// Shells dealt out to tiles so each holds about the same area
+};
+
+enum ResultFormat
+{
+	ResultText,			// A line of text for each job
+	ResultArray,		// The numbers of each job as a double array, and the JSON file if there is one
+	ResultJson,			// Every job written to a JSON file
+};
+
+enum AsyncAction
+{
+	AsyncNone,
+	AsyncStart,
+	AsyncCommit,
+	AsyncCancel,
+	AsyncQuery,
+};
+
 struct UVAutoRatioProParams
 {
 	bool			m_isHelp;
@@ -38,10 +78,13 @@ struct UVAutoRatioProParams
 	bool			m_isVerbose;
 	bool			m_isShowTiming;
 	MString			m_UVSetName;
+	MStringArray	m_UVSetNames;
+	bool			m_isAllUVSets;
 	bool			m_isUVSetOverride;
 	bool			m_isFallback;
 	bool			m_skipScaling;
 	bool			m_isColour;
+	double			m_colourRatio;
 	int				m_maxIterations;
 	OperationMode	m_operationMode;
 	bool			m_layoutShells;
@@ -49,8 +92,34 @@ struct UVAutoRatioProParams
 	bool			m_normaliseKeepAspectRatio;
 	ScaleDirection	m_scalingAxis;
 	uint			m_layoutIterations;
+	uint			m_streamChunkSize;
 	double			m_layoutMinDistance;
 	double			m_layoutStep;
+	uint			m_layoutSeed;
+	LayoutScope		m_layoutScope;
+	bool			m_isLayoutWarmStart;
+	bool			m_isLayoutClearWarmStart;
+	LayoutMethod	m_layoutMethod;
+	int				m_layoutPackResolution;
+	bool			m_isLayoutFitTile;
+	UdimMode		m_layoutUdim;
+	int				m_layoutUdimTiles;
+	double			m_layoutUdimBudget;
+	bool			m_layoutShapes;
+	bool			m_isShellCache;
+	bool			m_isMoveUVHistory;
+	bool			m_isBatchApply;
+	bool			m_isFrameRange;
+	double			m_startFrame;
+	double			m_endFrame;
+	double			m_frameStep;
+	FrameStatistic	m_frameStatistic;
+	MString			m_saveSnapshotPath;
+	MString			m_loadSnapshotPath;
+	ResultFormat	m_resultFormat;
+	MString			m_resultPath;
+	AsyncAction		m_asyncAction;
+	bool			m_isBenchmarkKernels;
 
 	UVAutoRatioProParams& 		operator = (const UVAutoRatioProParams& src)
 	{
@@ -59,21 +128,50 @@ struct UVAutoRatioProParams
 		m_threshold = src.m_threshold;
 		m_isVerbose = src.m_isVerbose;
 		m_UVSetName = src.m_UVSetName;
+		m_UVSetNames = src.m_UVSetNames;
+		m_isAllUVSets = src.m_isAllUVSets;
 		m_isUVSetOverride = src.m_isUVSetOverride;
 		m_isFallback = src.m_isFallback;
 		m_skipScaling = src.m_skipScaling;
 		m_isColour = src.m_isColour;
+		m_colourRatio = src.m_colourRatio;
 		m_maxIterations = src.m_maxIterations;
 		m_operationMode = src.m_operationMode;
 		m_layoutShells = src.m_layoutShells;
 		m_layoutIterations = src.m_layoutIterations;
 		m_scalingAxis = src.m_scalingAxis;
 		m_layoutStep = src.m_layoutStep;
+		m_layoutSeed = src.m_layoutSeed;
+		m_layoutScope = src.m_layoutScope;
+		m_isLayoutWarmStart = src.m_isLayoutWarmStart;
+		m_isLayoutClearWarmStart = src.m_isLayoutClearWarmStart;
+		m_layoutMethod = src.m_layoutMethod;
+		m_layoutPackResolution = src.m_layoutPackResolution;
+		m_isLayoutFitTile = src.m_isLayoutFitTile;
+		m_layoutUdim = src.m_layoutUdim;
+		m_layoutUdimTiles = src.m_layoutUdimTiles;
+		m_layoutUdimBudget = src.m_layoutUdimBudget;
+		m_layoutShapes = src.m_layoutShapes;
 
 		m_isShowTiming = src.m_isShowTiming;
 		m_normalise = src.m_normalise;
 		m_normaliseKeepAspectRatio = src.m_normaliseKeepAspectRatio;
 		m_layoutMinDistance = src.m_layoutMinDistance;
+		m_isShellCache = src.m_isShellCache;
+		m_streamChunkSize = src.m_streamChunkSize;
+		m_isMoveUVHistory = src.m_isMoveUVHistory;
+		m_isBatchApply = src.m_isBatchApply;
+		m_isFrameRange = src.m_isFrameRange;
+		m_startFrame = src.m_startFrame;
+		m_endFrame = src.m_endFrame;
+		m_frameStep = src.m_frameStep;
+		m_frameStatistic = src.m_frameStatistic;
+		m_saveSnapshotPath = src.m_saveSnapshotPath;
+		m_loadSnapshotPath = src.m_loadSnapshotPath;
+		m_resultFormat = src.m_resultFormat;
+		m_resultPath = src.m_resultPath;
+		m_asyncAction = src.m_asyncAction;
+		m_isBenchmarkKernels = src.m_isBenchmarkKernels;
 
 		return *this;
 	}
@@ -95,6 +193,9 @@ enum JobError
 
 class UVJob;
 class Processor;
+class UVUndoJournal;
+class ProgressService;
+class UVTriangleBVH;
 
 class Mesh
 {
@@ -104,22 +205,59 @@ public:
 	Mesh();
 	~Mesh();
 
-	MFnMesh*	model;
+	MFnMesh		model;
 	MDagPath	dagPath;
 	MString		name;
+	MString		pathName;	// Full DAG path, read on the main thread so the layout can key on it
 
 	MFloatArray uArray, vArray;
 
+	// UV indices of every shell in the mesh grouped by shell,
+	// shell jobs point at their range in here
+	std::vector<int>	uvIndexBuffer;
+
 	MString		currentUVSetName, useUVSetName;
 
+	// The UV set this mesh was added for, a mesh is added once per UV set processed
+	MString		requestedUVSetName;
+	bool		isUVSetOverride;
+	int			uvSetGroup;
+
 	JobError	error;
 
-	std::vector<UVJob*>		m_jobs;
+	std::vector<UVJob*>		m_jobs;		// Owned by the command's job pools
+
+	// Flat topology, only read when shells need to be hashed or faces measured
+	MeshFaceData	faceData;
+	bool			hasFaceData;
 
+	// Surface area of each face measured during gather for the heatmap, negative if not measured.
+	// When several UV sets of a mesh are processed they all use the areas of surfaceMesh.
+	std::vector<double>	faceSurfaceAreas;
+	Mesh*				surfaceMesh;
+
+	std::vector<double>&	GetFaceSurfaceAreas();
+
+	// Surface area of each face over the frame range, shared through surfaceMesh like faceSurfaceAreas
+	FrameAreaSampler*	frameAreas;
+	FrameStatistic		frameStatistic;
+
+	FrameAreaSampler*	GetFrameAreas();
+	bool	GatherFrameAreas(const UVAutoRatioProParams& params);
+
+	bool	GatherFaceData();
+	bool	GatherFaceTriangles();
+	bool	GatherFaceAreas(const MIntArray* faces, double& surfaceArea, double& uvArea);
 	void	Gather(Processor& processor, bool isUVSetOverride, bool isFallback, const MString& UVSetName);
 	void	FindScale(Processor& processor, double goalRatio, double threshold);
 	void	ApplyScale(Processor& processor);
+	void	ApplyBatched(Processor& processor);
 	void	ResetUVs();
+	void	RestoreUVSet();
+	bool	HasConstructionHistory() const;
+	bool	BuildUVIndices();
+	void	BuildUVIndices(const MIntArray& uvShellIDs, unsigned int numShells);
+	void	ReleaseGatherData(bool isUVIndexKept);
 };
 
 class UVJob
@@ -129,6 +267,7 @@ public:
 	virtual ~UVJob();
 
 	virtual MString		GetName() const=0;
+	virtual void		ReleaseGatherData(bool isUVIndexKept);
 
 	JobError	error;
 
@@ -143,6 +282,12 @@ public:
 
 	Mesh*		mesh;
 
+	// Triangles relative to the center for layout, owned by the command
+	UVTriangleBVH*	layoutShape;
+
+	// UDIM tile counted from 1001 that -layoutUdim packs the job into, -1 until it is assigned
+	int			udimTile;
+
 	bool		completed;
 };
 
@@ -155,21 +300,48 @@ public:
 	MString		GetName() const;
 };
 
+struct ShellCacheEntry;
+
 class ShellJob : public UVJob
 {
 public:
 	ShellJob();
 	virtual ~ShellJob();
 
-	int							meshShellNumber;
-	int*						uvIndices;
-	int							numIndices;
-	MFnSingleIndexedComponent*	uvComponents;
+	int				meshShellNumber;
+	int*			uvIndices;		// Points into the mesh's uvIndexBuffer
+	int				numIndices;
 
 	MObject			uvComponentObject;
 	MObject			faceComponentObject;
 
+	// Content hash of the shell, identical shells share their results
+	UVHash				contentHash;
+	UVHash				checkHash;
+	float				anchorU, anchorV;
+	ShellCacheEntry*	cacheEntry;
+	bool				isCacheHit;
+
 	MString		GetName() const;
+	void		ReleaseGatherData(bool isUVIndexKept);
+};
+
+// Results for one unique shell, reused by every shell with the same content hash.
+// The center is stored relative to the anchor UV so translated copies can share it.
+struct ShellCacheEntry
+{
+	UVHash		checkHash;
+	int			numFaces, numUVs;
+	JobError	gatherError;
+	double		surfaceArea, textureArea;
+	double		uvWidth, uvHeight;
+	double		centerU, centerV;
+
+	bool		hasScale;
+	JobError	scaleError;
+	double		finalScaleX, finalScaleY;
+	double		finalTextureArea;
+	int			iterationsPerformed;
 };
 
 class Processor
@@ -177,18 +349,50 @@ class Processor
 public:
 	UVAutoRatioProParams m_params;
 	std::vector<MDGModifier*>* m_undoHistory;
+	UVUndoJournal* m_undoJournal;
+	ProgressService* m_progress;
+
+	// The processors are deleted through this class, and the shell processor owns its cache
+	virtual ~Processor() {}
 
+	// Reads what the mesh's jobs share, with the mesh's UV set current, before they are gathered
+	virtual void		GatherMesh(Mesh& mesh)=0;
 	virtual void		Gather(UVJob& job)=0;
 	virtual void		FindScale(UVJob& job)=0;
 	virtual void		ApplyScale(UVJob& job)=0;
+
+	// Applies the job's scale and offset to the mesh's UV arrays in memory,
+	// returns false if the job must be applied with ApplyScale instead
+	virtual bool		TransformUVs(UVJob& job, MFloatArray& uArray, MFloatArray& vArray)=0;
+
+	// Whether FindScale only works on the gathered data, so it can run away from the main thread
+	virtual bool		IsSolveThreadSafe() const=0;
+
+	// Names the UVs the job moves so it can be applied without selecting them,
+	// returns false if they aren't known any more and ApplyScale must select them
+	virtual bool		GetApplyComponents(const UVJob& job, MString& components) const=0;
+
+	// polyMoveUV of the job's scale and offset on the components
+	MString				GetMoveUVCommand(const UVJob& job, const MString& components) const;
+
+	// Whether gather measures each face, for the heatmap, the frame range or to share surface areas between UV sets
+	bool				IsMeasuringFaces(const Mesh& mesh) const;
+
+protected:
+	void		GetAxisScale(const UVJob& job, double& scaleU, double& scaleV) const;
+	void		TransformUV(const UVJob& job, double scaleU, double scaleV, float& u, float& v) const;
 };
 
 class MeshProcessor : public Processor
 {
 public:
+	void		GatherMesh(Mesh& mesh);
 	void		Gather(UVJob& job);
 	void		FindScale(UVJob& job);
 	void		ApplyScale(UVJob& job);
+	bool		TransformUVs(UVJob& job, MFloatArray& uArray, MFloatArray& vArray);
+	bool		IsSolveThreadSafe() const;
+	bool		GetApplyComponents(const UVJob& job, MString& components) const;
 
 private:
 	double		FindScaleFactor(double shapeArea, double targetArea, double width, double height) const;
@@ -199,14 +403,25 @@ private:
 class ShellProcessor : public Processor
 {
 public:
+	void		GatherMesh(Mesh& mesh);
 	void		Gather(UVJob& job);
 	void		FindScale(UVJob& job);
 	void		ApplyScale(UVJob& job);
+	bool		TransformUVs(UVJob& job, MFloatArray& uArray, MFloatArray& vArray);
+	bool		IsSolveThreadSafe() const;
+	bool		GetApplyComponents(const UVJob& job, MString& components) const;
 
 private:
+	bool		HashShell(ShellJob& job, int& numFaces);
+	void		GatherAreas(ShellJob& job);
+	void		FindScaleUncached(ShellJob& job);
+
 	double		FindScaleFactor(double shapeArea, double targetArea, double width, double height) const;
 	void		ScaleMeshUVs(ShellJob& job, double scale);
 	JobError	FindScale(ShellJob& job, double threshold, double& finalScale, double& finalTextureArea, int& iterationsPerformed);
+
+	typedef std::map<UVHash, ShellCacheEntry> ShellCache;
+	ShellCache	m_shellCache;
 };
 
 #endif
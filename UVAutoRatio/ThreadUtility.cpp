@@ -0,0 +1,93 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "ThreadUtility.h"
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <vector>
+#if UVAR_THREADED
+#include <maya/MThreadPool.h>
+#endif
+
+void
+ThreadSleep(unsigned int milliseconds)
+{
+#ifdef WIN32
+	Sleep(milliseconds);
+#else
+	usleep(milliseconds * 1000);
+#endif
+}
+
+#if UVAR_THREADED
+struct ParallelForRange
+{
+	ParallelForFunc	func;
+	void*			data;
+	int				begin, end;
+};
+
+static MThreadRetVal
+ParallelForTask(void* data)
+{
+	ParallelForRange* range = (ParallelForRange*)data;
+	range->func(range->data, range->begin, range->end);
+	return 0;
+}
+
+static void
+ParallelForRegion(void* data, MThreadRootTask* root)
+{
+	std::vector<ParallelForRange>& ranges = *(std::vector<ParallelForRange>*)data;
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		MThreadPool::createTask(ParallelForTask, &ranges[i], root);
+	}
+	MThreadPool::executeAndJoin(root);
+}
+#endif
+
+void
+ParallelFor(int count, int grainSize, ParallelForFunc func, void* data)
+{
+	if (count <= 0)
+		return;
+	if (grainSize < 1)
+		grainSize = 1;
+
+#if UVAR_THREADED
+	if (count > grainSize && MThreadPool::init() == MS::kSuccess)
+	{
+		std::vector<ParallelForRange> ranges;
+		for (int begin = 0; begin < count; begin += grainSize)
+		{
+			ParallelForRange range;
+			range.func = func;
+			range.data = data;
+			range.begin = begin;
+			range.end = (count - begin > grainSize) ? begin + grainSize : count;
+			ranges.push_back(range);
+		}
+
+		MThreadPool::newParallelRegion(ParallelForRegion, &ranges);
+		MThreadPool::release();
+		return;
+	}
+#endif
+
+	func(data, 0, count);
+}
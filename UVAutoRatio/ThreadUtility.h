@@ -0,0 +1,58 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef THREADUTILITY_H
+#define THREADUTILITY_H
+
+// Maya's threading API first shipped with Maya 2008
+#if MAYA2008 || MAYA2009 || MAYA2010 || MAYA2011 || MAYA2012 || MAYA2013 || MAYA20135 || MAYA2014 || MAYA2015 || MAYA2016
+#define UVAR_THREADED 1
+#include <maya/MThreadAsync.h>
+#include <maya/MAtomic.h>
+#else
+#define UVAR_THREADED 0
+#endif
+
+void	ThreadSleep(unsigned int milliseconds);
+
+// Calls func on ranges [begin, end) of at most grainSize items that together
+// cover [0, count).  When threaded the ranges run on Maya's thread pool and
+// this returns once they have all finished, otherwise they run in order here.
+typedef void (*ParallelForFunc)(void* data, int begin, int end);
+
+void	ParallelFor(int count, int grainSize, ParallelForFunc func, void* data);
+
+// Plain aligned int reads are atomic on every platform Maya runs on,
+// the writes go through MAtomic so they are seen by the other threads
+inline void
+AtomicSet(volatile int* variable, int value)
+{
+#if UVAR_THREADED
+	MAtomic::set(variable, value);
+#else
+	*variable = value;
+#endif
+}
+
+// Returns the new value
+inline int
+AtomicIncrement(volatile int* variable)
+{
+#if UVAR_THREADED
+	return MAtomic::preIncrement(variable);
+#else
+	return ++(*variable);
+#endif
+}
+
+#endif
@@ -14,14 +14,21 @@
 #include "MayaPCH.h"
 #include "GetUVShellSelectionStrings.h"
 #include "GetSurfaceUVArea.h"
+#include "GetTexelDensityStats.h"
+#include "GetUVOverlaps.h"
 #include "UVAutoRatioPro.h"
+#include "UVTexelDensityNode.h"
+#include "UVKernels.h"
 #include "UVAutoRatioPlugin.h"
 
 UVAutoRatioPlugin::UVAutoRatioPlugin(const MayaPluginParams& params) : MayaPlugin(params)
 {
 	m_UVAutoRatioProCreated = false;
 	m_GetSurfaceUVAreaCreated = false;
+	m_GetTexelDensityStatsCreated = false;
+	m_GetUVOverlapsCreated = false;
 	m_GetUVShellSelectionStringsCreated = false;
+	m_UVTexelDensityNodeCreated = false;
 }
 
 void
@@ -29,6 +36,9 @@ UVAutoRatioPlugin::LoadUserPlugins(MFnPlugin& plugin)
 {
 	MStatus status;
 
+	// Pick the array kernels for this CPU before any command can run
+	InitialiseKernels();
+
 	// Register the command
 	if (!m_UVAutoRatioProCreated)
 	{
@@ -51,6 +61,28 @@ UVAutoRatioPlugin::LoadUserPlugins(MFnPlugin& plugin)
 		m_GetSurfaceUVAreaCreated = true;
 	}
 
+	// Register the command
+	if (!m_GetTexelDensityStatsCreated)
+	{
+		status = plugin.registerCommand("GetTexelDensityStats", GetTexelDensityStats::creator, GetTexelDensityStats::newSyntax);
+		if (MStatus::kSuccess != status)
+		{
+			status.perror("registerCommand GetTexelDensityStats failed");
+		}
+		m_GetTexelDensityStatsCreated = true;
+	}
+
+	// Register the command
+	if (!m_GetUVOverlapsCreated)
+	{
+		status = plugin.registerCommand("GetUVOverlaps", GetUVOverlaps::creator, GetUVOverlaps::newSyntax);
+		if (MStatus::kSuccess != status)
+		{
+			status.perror("registerCommand GetUVOverlaps failed");
+		}
+		m_GetUVOverlapsCreated = true;
+	}
+
 	// Register the command
 	if (!m_GetUVShellSelectionStringsCreated)
 	{
@@ -62,6 +94,17 @@ UVAutoRatioPlugin::LoadUserPlugins(MFnPlugin& plugin)
 		m_GetUVShellSelectionStringsCreated = true;
 	}
 
+	// Register the node
+	if (!m_UVTexelDensityNodeCreated)
+	{
+		status = plugin.registerNode(UVTexelDensityNode::typeName, UVTexelDensityNode::typeId, UVTexelDensityNode::creator, UVTexelDensityNode::initialize);
+		if (MStatus::kSuccess != status)
+		{
+			status.perror("registerNode uvTexelDensity failed");
+		}
+		m_UVTexelDensityNodeCreated = true;
+	}
+
 	//
 	//status = plugin.registerNode( Cas_checkerBoxNode::typeName, Cas_checkerBoxNode::typeId, Cas_checkerBoxNode::creator	, Cas_checkerBoxNode::initialize ,	MPxNode::kLocatorNode );
 	//MCheckStatus(status,"registerCommand Cas_checkerBoxNode failed");
@@ -72,6 +115,21 @@ UVAutoRatioPlugin::UnloadUserPlugins(MFnPlugin& plugin)
 {
 	MStatus status;
 
+	// Don't leave a worker running code that is about to be unloaded
+	UVAutoRatioPro::ShutdownAsync();
+	UVAutoRatioPro::ClearLayoutStates();
+
+	// Unregister node
+	if (m_UVTexelDensityNodeCreated)
+	{
+		status = plugin.deregisterNode(UVTexelDensityNode::typeId);
+		if (MStatus::kSuccess != status)
+		{
+			status.perror("deregisterNode uvTexelDensity failed");
+		}
+		m_UVTexelDensityNodeCreated = false;
+	}
+
 	// Unregister command
 	if (m_GetUVShellSelectionStringsCreated)
 	{
@@ -83,6 +141,28 @@ UVAutoRatioPlugin::UnloadUserPlugins(MFnPlugin& plugin)
 		m_GetUVShellSelectionStringsCreated = false;
 	}
 
+	// Unregister command
+	if (m_GetUVOverlapsCreated)
+	{
+		status = plugin.deregisterCommand("GetUVOverlaps");
+		if (MStatus::kSuccess != status)
+		{
+			status.perror("deregisterCommand GetUVOverlaps failed");
+		}
+		m_GetUVOverlapsCreated = false;
+	}
+
+	// Unregister command
+	if (m_GetTexelDensityStatsCreated)
+	{
+		status = plugin.deregisterCommand("GetTexelDensityStats");
+		if (MStatus::kSuccess != status)
+		{
+			status.perror("deregisterCommand GetTexelDensityStats failed");
+		}
+		m_GetTexelDensityStatsCreated = false;
+	}
+
 	// Unregister command
 	if (m_GetSurfaceUVAreaCreated)
 	{
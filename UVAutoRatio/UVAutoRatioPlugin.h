@@ -30,7 +30,10 @@ protected:
 private:
 	bool			m_GetUVShellSelectionStringsCreated;
 	bool			m_GetSurfaceUVAreaCreated;
+	bool			m_GetTexelDensityStatsCreated;
+	bool			m_GetUVOverlapsCreated;
 	bool			m_UVAutoRatioProCreated;
+	bool			m_UVTexelDensityNodeCreated;
 };
 
 #endif
@@ -12,9 +12,12 @@
 //
 
 #include "MayaPCH.h"
+#include <algorithm>
+#include <string>
 #include "MayaUtility.h"
 #include "Utility.h"
 #include "UVSpringLayout.h"
+#include "UVBitmapPacker.h"
 #include "UVAutoRatioPro.h"
 
 using namespace std;
@@ -24,14 +27,26 @@ static const char* error_minimumSelection = "At least 1 mesh must be selected";
 static const char* error_unknownOpMode = "Unknown operation mode";
 static const char* error_componentConversionError = "Unexpected result during component conversion";
 
-int	UVAutoRatioPro::m_subTasks = 0;
-int	UVAutoRatioPro::m_subTasksLeft = 0;
-double UVAutoRatioPro::m_subTaskJump = 0;
-MString UVAutoRatioPro::m_subTaskName;
-int	UVAutoRatioPro::m_totalJobs = 0;
-double UVAutoRatioPro::m_progress = 0.0;
-double UVAutoRatioPro::m_progressStep = 0.0;
-MString UVAutoRatioPro::m_progressMessage;
+UVAutoRatioPro* UVAutoRatioPro::m_asyncRun = NULL;
+UVAutoRatioPro::LayoutStateMap UVAutoRatioPro::m_layoutStates;
+
+// Boxes within this fraction of their last size resume from their last position
+static const double LayoutResumeTolerance = 1.0e-4;
+
+// The warm start states are forgotten once there are this many, so a long session
+// laying out many different scenes doesn't keep growing them
+static const size_t MaxLayoutStates = 250000;
+
+// The per-mesh layouts are run on the thread pool this many meshes at a time.  The main
+// thread is blocked while they run, so it only polls the progress window for Esc between them.
+static const int LayoutMeshChunkSize = 32;
+
+// UDIM tiles run 1001 to 1010 along the first row, then 1011 starts the next
+static const int UdimColumns = 10;
+
+// When the tiles don't all fit at the scale of the fullest one they try again this much smaller
+static const double UdimFitShrink = 0.97;
+static const int UdimFitRetries = 8;
 
 MStatus
 UVAutoRatioPro::doIt(const MArgList& args)
@@ -42,14 +57,49 @@ UVAutoRatioPro::doIt(const MArgList& args)
 
 	status = Initialise(args);
 
-	if (status == MS::kSuccess)
+	if (status == MS::kSuccess && m_params.m_isLayoutClearWarmStart)
+	{
+		// A background layout may be reading the states
+		status = CheckNoAsyncRun();
+		if (status == MS::kSuccess)
+			ClearLayoutStates();
+	}
+	else if (status == MS::kSuccess && m_params.m_isBenchmarkKernels)
 	{
-		status = ProcessMeshes();
+		RunKernelBenchmark();
+	}
+	else if (status == MS::kSuccess)
+	{
+		switch (m_params.m_asyncAction)
+		{
+		case AsyncNone:
+			status = CheckNoAsyncRun();
+			if (status == MS::kSuccess)
+			{
+				if (m_params.m_loadSnapshotPath.length() > 0)
+					status = ReplaySnapshot();
+				else
+					status = ProcessMeshes();
+			}
+			break;
+		case AsyncStart:
+			status = StartAsync();
+			break;
+		case AsyncCommit:
+			status = CommitAsync();
+			break;
+		case AsyncCancel:
+			status = CancelAsync();
+			break;
+		case AsyncQuery:
+			QueryAsync();
+			break;
+		}
 	}
 
 	RestoreSelection();
 
-	MProgressWindow::endProgress();
+	m_progress.EndWindow();
 
 	return status;
 }
@@ -76,7 +126,8 @@ UVAutoRatioPro::Initialise(const MArgList& args)
 	}
 
 	// Check we have enough objects selected
-	if (m_savedSelection.length() < 1)
+	bool isSelectionUsed = (m_params.m_asyncAction == AsyncNone || m_params.m_asyncAction == AsyncStart) && !m_params.m_isBenchmarkKernels && !m_params.m_isLayoutClearWarmStart;
+	if (isSelectionUsed && m_savedSelection.length() < 1)
 	{
 		displayError(error_minimumSelection);
 		return MS::kFailure;
@@ -85,9 +136,12 @@ UVAutoRatioPro::Initialise(const MArgList& args)
 	return MS::kSuccess;
 }
 
+// Colours the faces of every mesh by their ratio relative to the reference
+// ratio, or to the average ratio of their shell or mesh if there isn't one
 void
 UVAutoRatioPro::TestColourFaces()
 {
+	FaceHeatmap heatmap;
 	for (uint i = 0; i < m_meshes.size(); i++)
 	{
 		if (MGlobal::mayaState() == MGlobal::kInteractive)
@@ -99,157 +153,55 @@ UVAutoRatioPro::TestColourFaces()
 		Mesh& mesh = *m_meshes[i];
 		if (!mesh.error)
 		{
-			for (uint j = 0; j < mesh.m_jobs.size(); j++)
-			{
-				ShellJob& job = (ShellJob&)(*mesh.m_jobs[j]);
-				if (!job.error)
-				{
-					ColourFaces(mesh.dagPath, job.faceComponentObject, &mesh.useUVSetName);
-				}
-			}
+			ColourFaces(mesh, heatmap);
 		}
 	}
 }
 
 void
-UVAutoRatioPro::ColourFaces(const MDagPath& dagPath, MObject& component, const MString* uvSetName)
+UVAutoRatioPro::ColourFaces(Mesh& mesh, FaceHeatmap& heatmap)
 {
 	MStatus status;
 
-	// Build palette
-	MColorArray colorPalette;
-	{
-		MColor startCol(0.0f, 0.0f, 1.0f, 1.0f);
-		MColor endCol(0.0f, 1.0f, 0.0f, 1.0f);
-		for (int i = 0; i < 32; i++)
-		{
-			float t = (float)i / 32.0f;
-			MColor col = Lerp(startCol, endCol, t);
-			colorPalette.append(col);
-		}
-	}
-	{
-		MColor startCol(0.0f, 1.0f, 0.0f, 1.0f);
-		MColor endCol(1.0f, 0.0f, 0.0f, 1.0f);
-		for (int i = 0; i < 32; i++)
-		{
-			float t = (float)i / 32.0f;
-			MColor col = Lerp(startCol, endCol, t);
-			colorPalette.append(col);
-		}
-	}	
-
-	int faceCount = 0;
-	double totalRatio = 0.0;
-	MColorArray finalColors;
-	MIntArray faceIndices;
-	MDoubleArray faceRatios;
-
-	MItMeshPolygon iter(dagPath, component, &status);
-	finalColors.setLength(iter.count());
-	faceIndices.setLength(iter.count());
-	faceRatios.setLength(iter.count());
-	for ( ; !iter.isDone(); iter.next() ) 
-	{
-		double area3d = 0.0;
-
-		MPointArray points;
-		MIntArray vertexList;
-		status = iter.getTriangles(points, vertexList, MSpace::kWorld);
-		int numTriangles = points.length() / 3;
-		for (int i = 0; i < numTriangles; i++)
-		{
-			MPoint a, b, c;
-			int indexA = (i*3+0);
-			int indexB = (i*3+1);
-			int indexC = (i*3+2);
-			a = points[indexA];
-			b = points[indexB];
-			c = points[indexC];
-
-			double la = a.distanceTo(b);
-			double lb = a.distanceTo(c);
-			double lc = b.distanceTo(c);
-			la = MDistance::internalToUI(la);
-			lb = MDistance::internalToUI(lb);
-			lc = MDistance::internalToUI(lc);
-			double areaSquared = GetTriangleAreaSquared(la, lb, lc);
-			if (areaSquared > 0)
-				area3d += sqrt(areaSquared);
-		}
-
-		double area2d = 0.0;
-
-		MIntArray polygonToFaceVertexIndexMap;
-		iter.getVertices(polygonToFaceVertexIndexMap);
-
-		int numTrianglesInPoly=0;
-		iter.numTriangles(numTrianglesInPoly);
-		for (int j=0; j<numTrianglesInPoly; j++)
-		{
-			MPointArray			unTweakedTrianglePoints;
-			MIntArray			meshVertexIndices;	// index's into the meshes vertex list!
-			iter.getTriangle(j,unTweakedTrianglePoints,meshVertexIndices,MSpace::kObject); 
-
-			// convert mesh-relative vertex index into polygon-relative
-			int polygonVertexIndex[3];
-			for (int k=0; k<3; k++)
-			{
-				for (uint kk=0; kk<polygonToFaceVertexIndexMap.length(); kk++)
-				{
-					if (polygonToFaceVertexIndexMap[kk]==meshVertexIndices[k])
-					{
-						polygonVertexIndex[k]=kk;
-						break;
-					}
-				}
-			}
-
-			float2 uv1, uv2, uv3;
-			iter.getUV(polygonVertexIndex[0], uv1, uvSetName);
-			iter.getUV(polygonVertexIndex[1], uv2, uvSetName);
-			iter.getUV(polygonVertexIndex[2], uv3, uvSetName);
-
-			area2d += GetTriangleArea2D(uv1, uv2, uv3);
-		}
+	// Applying doesn't change the topology, only the UVs need reading again
+	if (!mesh.GatherFaceTriangles())
+		return;
 
-		double ratio = 0.0;
-		if (area2d > 0.0)
-		{
-			ratio = (area3d / area2d);
-			totalRatio += ratio;
-		}
-		
-		faceRatios[faceCount] = ratio;
-		faceIndices[faceCount] = iter.index();
-		faceCount++;
-	}
+	MFloatArray uArray, vArray;
+	status = mesh.model.getUVs(uArray, vArray, &mesh.useUVSetName);
+	if (status != MS::kSuccess)
+		return;
 
-	double averageRatio = totalRatio / (double)faceCount;
-	double distance = averageRatio * 0.8;
-	double minRatio = averageRatio - distance;
-	double maxRatio = averageRatio + distance;
+	heatmap.Clear();
 
-	for (int i = 0; i < faceCount; i++)
+	MIntArray faces;
+	std::vector<double> ratios;
+	for (uint j = 0; j < mesh.m_jobs.size(); j++)
 	{
-		double ratio = faceRatios[i];
-		ratio = max(min(ratio, maxRatio), minRatio);
+		UVJob& job = *mesh.m_jobs[j];
+		if (job.error)
+			continue;
 
-		if (ratio > minRatio)
+		if (m_params.m_operationMode == UVShellLevel)
 		{
-			double t = (ratio - minRatio) / (maxRatio - minRatio);
-			int paletteIndex = (int)(t * 63.0);
-
-			finalColors[i] = colorPalette[paletteIndex];;
+			MFnSingleIndexedComponent faceComponents(((ShellJob&)job).faceComponentObject);
+			faceComponents.getElements(faces);
 		}
 		else
 		{
-			finalColors[i] = MColor(0.0f, 0.0f, 0.0f, 1.0f);
-		}		
+			int numFaces = (int)mesh.faceData.faceVertexCounts.length();
+			faces.setLength(numFaces);
+			for (int k = 0; k < numFaces; k++)
+			{
+				faces[k] = k;
+			}
+		}
+
+		FaceHeatmap::MeasureRatios(mesh.faceData, uArray, vArray, mesh.GetFaceSurfaceAreas(), faces, ratios);
+		heatmap.AddFaces(faces, ratios, m_params.m_colourRatio);
 	}
 
-	MFnMesh mesh(dagPath);
-	mesh.setFaceColors(finalColors, faceIndices);
+	heatmap.Apply(mesh.model);
 }
 
 MStatus
@@ -263,37 +215,21 @@ UVAutoRatioPro::ProcessMeshes()
 		OutputText("UVAutoRatio 2.0 Pro: Building Task List...");
 	}
 
-	if (MGlobal::mayaState() == MGlobal::kInteractive)
-	{
-		MProgressWindow::reserve();
-		MProgressWindow::setTitle("UVAutoRatio");
-		MProgressWindow::setProgressMin(0);
-		MProgressWindow::setProgressMax(6000);
-		MProgressWindow::setInterruptable(true);
-	}
-
 	m_masterTimer.reset();
 
-	MProgressWindow::startProgress();
+	m_progress.StartWindow();
 
-	m_progressMessage = "Inspecting Selection...";
-	SetProgress(0);
+	m_progress.SetPhase(0, "Inspecting Selection...");
 	status = BuildDataLists();
 
 	if (status == MS::kSuccess)
 	{
-		// Count how many jobs there are to compute step size for progress meter
-		{
-			m_totalJobs = 0;
-			for (uint i = 0; i < m_meshes.size(); i++)
-			{
-				Mesh& mesh = *m_meshes[i];
-				for (uint j = 0; j < mesh.m_jobs.size(); j++)
-				{
-					m_totalJobs++;
-				}
-			}
-		}
+		CountJobs();
+
+		// Layout and normalise need every job at once, otherwise streamed chunks
+		// can be applied as soon as they are solved
+		bool isStreamed = (m_params.m_streamChunkSize > 0);
+		bool isAppliedInChunks = isStreamed && !m_params.m_layoutShells && !m_params.m_normalise;
 
 		// Gather Data
 		if (!IsProgressCancelled())
@@ -302,25 +238,35 @@ UVAutoRatioPro::ProcessMeshes()
 			{
 				OutputText("UVAutoRatio 2.0 Pro: Gathering Data...");
 			}
-			m_progressMessage = "Gathering Data...";
-			SetProgress(1000);
+			m_progress.SetPhase(1, "Gathering Data...");
 
-			GatherData();
+			if (isStreamed)
+			{
+				GatherStreamed(isAppliedInChunks);
+			}
+			else
+			{
+				GatherData(0, (uint)m_meshes.size());
+			}
+		}
+
+		if (!IsProgressCancelled() && m_params.m_saveSnapshotPath.length() > 0)
+		{
+			SaveSnapshot();
 		}
 
 		// Find Scale
-		if (!IsProgressCancelled())
+		if (!IsProgressCancelled() && !isStreamed)
 		{
 			if (m_params.m_isVerbose)
 			{
 				OutputText("UVAutoRatio 2.0 Pro: Calculating Scale...");
 			}
-			m_progressMessage = "Calculating Scale...";
-			SetProgress(2000);
+			m_progress.SetPhase(2, "Calculating Scale...");
 
 			if (!m_params.m_skipScaling)
 			{
-				FindScales();
+				FindScales(0, (uint)m_meshes.size());
 			}
 		}
 
@@ -333,10 +279,22 @@ UVAutoRatioPro::ProcessMeshes()
 				{
 					OutputText("UVAutoRatio 2.0 Pro: Solving Overlaps...");
 				}
-				m_progressMessage = "Solving Overlaps...";
-				SetProgress(3000);
+				m_progress.SetPhase(3, "Solving Overlaps...");
 
+				if (m_params.m_layoutShapes)
+				{
+					BuildLayoutShapes();
+				}
+				if (m_params.m_layoutUdim == UdimByMaterial)
+				{
+					GatherUdimMaterials();
+				}
 				LayoutShells();
+
+				if (m_params.m_isLayoutFitTile)
+				{
+					setResult(m_fitTileRatios);
+				}
 			}
 		}
 		
@@ -349,8 +307,7 @@ UVAutoRatioPro::ProcessMeshes()
 				{
 					OutputText("UVAutoRatio 2.0 Pro: Normalising...");
 				}
-				m_progressMessage = "Normalising...";
-				SetProgress(4000);
+				m_progress.SetPhase(4, "Normalising...");
 
 				Normalise();
 			}
@@ -363,18 +320,19 @@ UVAutoRatioPro::ProcessMeshes()
 			{
 				OutputText("UVAutoRatio 2.0 Pro: Applying...");
 			}
-			m_progressMessage = "Applying...";
-			SetProgress(5000);
+			m_progress.SetPhase(5, "Applying...");
 
-			ApplyScales();
+			if (!isAppliedInChunks)
+			{
+				ApplyScales(0, (uint)m_meshes.size());
+			}
 
 			if (m_params.m_isColour)
 			{
 				TestColourFaces();
 			}
 
-			m_progressMessage = "Finito!";
-			SetProgress(6000);
+			m_progress.SetPhase(6, "Finito!");
 		}
 
 	}
@@ -383,7 +341,7 @@ UVAutoRatioPro::ProcessMeshes()
 	// Display Stats
 	if (status == MS::kSuccess)
 	{
-		if (m_params.m_isVerbose)
+		if (m_params.m_isVerbose || m_params.m_resultFormat != ResultText)
 		{
 			// If the operation was canceled mark jobs not processed so they appear in the warning list
 			if (IsProgressCancelled())
@@ -400,86 +358,32 @@ UVAutoRatioPro::ProcessMeshes()
 				}
 			}
 		}
-		DisplayStats(!m_params.m_isVerbose);
-		if (m_params.m_isShowTiming)
-			DisplayTimingStats();
+		OutputResults();
 	}
 
 	return status;
 }
 
-bool
-UVAutoRatioPro::IsProgressCancelled()
+// Count how many jobs there are to compute step size for progress meter
+void
+UVAutoRatioPro::CountJobs()
 {
-	if (MGlobal::mayaState() != MGlobal::kInteractive)
+	m_totalJobs = 0;
+	for (uint i = 0; i < m_meshes.size(); i++)
 	{
-		return false;
+		Mesh& mesh = *m_meshes[i];
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			m_totalJobs++;
+		}
 	}
-
-	return MProgressWindow::isCancelled();
-}
-
-void
-UVAutoRatioPro::SetProgress(int value)
-{
-	if (MGlobal::mayaState() != MGlobal::kInteractive)
-		return;
-
-	MProgressWindow::setProgress(value);
-	m_subTasks = 0;
-	m_subTasksLeft = 0;
-	m_progress = 0.0;
-	UpdateProgress();
-}
-
-void
-UVAutoRatioPro::UpdateProgress()
-{
-	if (MGlobal::mayaState() != MGlobal::kInteractive)
-		return;
-
-	// Update percentage display
-	int pRange = MProgressWindow::progressMax() - MProgressWindow::progressMin();
-	int percent = ((MProgressWindow::progress() - MProgressWindow::progressMin()) * 100) / pRange;
-	MString message = "";
-	message += percent;
-	message += "%   ";
-	message += m_progressMessage;
-	if (m_subTasksLeft > 0)
-	{
-		message += m_subTasksLeft;
-		message += "/";
-		message += m_subTasks;
-		message += " ";
-		message += m_subTaskName;
-	}
-	MProgressWindow::setProgressStatus(message);
-}
-
-void
-UVAutoRatioPro::SetNumSubTasks(int tasks, const MString& name)
-{
-	m_subTasks = tasks;
-	m_subTasksLeft = 0;
-	m_subTaskJump = (1000.0 / (double)tasks);
-	m_subTaskName = name;
 }
 
-void
-UVAutoRatioPro::StepJobProgress()
+// Called from the loops that drive the run, on a background run this only reads the flag
+bool
+UVAutoRatioPro::IsProgressCancelled()
 {
-	m_subTasksLeft++;
-	m_progress += m_subTaskJump;
-	if (m_progress >= 1.0)
-	{
-		// Advance progress bar
-		int step = (int)floor(m_progress);
-		MProgressWindow::advanceProgress(step);
-		m_progress -= (double)step;
-
-		// Update percentage display
-		UpdateProgress();
-	}
+	return m_progress.Poll();
 }
 
 MStatus
@@ -506,31 +410,69 @@ UVAutoRatioPro::BuildDataLists()
 	}
 	m_loadTime = m_timer.getTime();
 
+	m_activeProcessor->m_progress = &m_progress;
 	m_activeProcessor->m_undoHistory = &m_undos;
+	m_activeProcessor->m_undoJournal = m_params.m_isMoveUVHistory ? NULL : &m_undoJournal;
 	m_activeProcessor->m_params = m_params;
 	return MS::kSuccess;
 }
 
 void
-UVAutoRatioPro::GatherData()
+UVAutoRatioPro::GatherData(uint first, uint last)
 {
 	m_timer.reset();
-	for (uint i = 0; i < m_meshes.size(); i++)
+	for (uint i = first; i < last; i++)
 	{
 		if (IsProgressCancelled())
 			break;
 
 		Mesh& mesh = *m_meshes[i];
-		mesh.Gather(*m_activeProcessor, m_params.m_isUVSetOverride, m_params.m_isFallback, m_params.m_UVSetName);
+		mesh.Gather(*m_activeProcessor, mesh.isUVSetOverride, IsFallbackAllowed(), mesh.requestedUVSetName);
+	}
+	m_gatherTime += m_timer.getTime();
+}
+
+// Gathers and solves the meshes a chunk at a time, releasing each chunk's
+// UV data before moving on so that memory use doesn't grow with the selection.
+// Only the per-job results are kept for the layout, normalise and apply passes.
+void
+UVAutoRatioPro::GatherStreamed(bool applyChunks)
+{
+	uint numMeshes = (uint)m_meshes.size();
+	uint chunkSize = m_params.m_streamChunkSize;
+	for (uint first = 0; first < numMeshes; first += chunkSize)
+	{
+		if (IsProgressCancelled())
+			break;
+
+		uint last = Min(first + chunkSize, numMeshes);
+
+		GatherData(first, last);
+
+		if (!m_params.m_skipScaling)
+		{
+			FindScales(first, last);
+		}
+
+		if (applyChunks)
+		{
+			ApplyScales(first, last);
+		}
+
+		// Meshes applied later by the layout or normalise keep their UV indices,
+		// so they are still journalled or batched instead of selected
+		for (uint i = first; i < last; i++)
+		{
+			m_meshes[i]->ReleaseGatherData(!applyChunks);
+		}
 	}
-	m_gatherTime = m_timer.getTime();
 }
 
 void
-UVAutoRatioPro::FindScales()
+UVAutoRatioPro::FindScales(uint first, uint last)
 {
 	m_timer.reset();
-	for (uint i = 0; i < m_meshes.size(); i++)
+	for (uint i = first; i < last; i++)
 	{
 		if (IsProgressCancelled())
 			break;
@@ -541,171 +483,1007 @@ UVAutoRatioPro::FindScales()
 			mesh.FindScale(*m_activeProcessor, m_params.m_goalRatio, m_params.m_threshold);
 		}
 	}
-	m_processTime = m_timer.getTime();
+	m_processTime += m_timer.getTime();
 }
 
+// Reads the gathered triangles of every job into a tree centered on the job,
+// on the main thread as it reads the face components.  Meshes whose UVs have
+// already been released keep laying out by their bounding boxes only.
 void
-UVAutoRatioPro::LayoutShells()
+UVAutoRatioPro::BuildLayoutShapes()
 {
-	m_timer.reset();
-
-	UVSpringLayout* layout = new UVSpringLayout();
-
-	//float progressBase = (float)MProgressWindow::progress();
-	//float progressTotal = 1000.0f;
-	//float progressMesh = progressTotal / (float)m_meshes.size();
-	//float progressStep = iterations / 100.0f;
-
-	float iterationSteps = m_params.m_layoutIterations / 100.0f;
-	int numSubTasks = (int)(iterationSteps * m_meshes.size());
-	UVAutoRatioPro::SetNumSubTasks(numSubTasks, "Jobs");
-
-	enum OverlapFixMode
+	MIntArray faces;
+	for (uint i = 0; i < m_meshes.size(); i++)
 	{
-		Global,
-		PerMesh,
-	};
-
-	OverlapFixMode mode = Global;
+		Mesh& mesh = *m_meshes[i];
+		if (mesh.error || mesh.uArray.length() == 0 || !mesh.GatherFaceTriangles())
+			continue;
 
-	if (true)//mode == Global)
-	{
-		// Add boxes
-		uint i = 0;
-		for (i = 0; i < m_meshes.size(); i++)
+		const MeshFaceData& data = mesh.faceData;
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
 		{
-			if (IsProgressCancelled())
-				break;
+			UVJob& job = *mesh.m_jobs[j];
+			if (job.error || job.layoutShape)
+				continue;
 
-			Mesh& mesh = *m_meshes[i];
-			if (!mesh.error)
+			if (m_params.m_operationMode == UVShellLevel)
+			{
+				MFnSingleIndexedComponent faceComponents(((ShellJob&)job).faceComponentObject);
+				faceComponents.getElements(faces);
+			}
+			else
 			{
-				// Add all the shells of a mesh to the layout class
-				for (uint j = 0; j < mesh.m_jobs.size(); j++)
+				int numFaces = (int)data.faceVertexCounts.length();
+				faces.setLength(numFaces);
+				for (int k = 0; k < numFaces; k++)
 				{
-					UVJob& job = (UVJob&)(*mesh.m_jobs[j]);
-					if (!job.error)
-					{
-						double2 center;
-						center[0] = job.centerU;
-						center[1] = job.centerV;
-						layout->AddBox(job.uvWidth * job.finalScaleX + m_params.m_layoutMinDistance, 
-									   job.uvHeight * job.finalScaleY + m_params.m_layoutMinDistance, center);
-					}
+					faces[k] = k;
 				}
 			}
-		}
 
-		// Iterate!
-		int itCount = 0;
-		for (i =0; i < m_params.m_layoutIterations; i++)
-		{
-			if (!layout->Step(m_params.m_layoutStep))
-				break;
-
-			itCount++;
-			if (itCount >= 100)
+			UVTriangleBVH* shape = new UVTriangleBVH();
+			for (uint k = 0; k < faces.length(); k++)
 			{
-				itCount = 0;
-				UVAutoRatioPro::StepJobProgress();
-				if (IsProgressCancelled())
-					break;
-			}
-		}
-
-		// Retrieve results
-		int index = 0;
-		for (i = 0; i < m_meshes.size(); i++)
-		{
-			if (IsProgressCancelled())
-				break;
+				int face = faces[k];
+				if (data.uvCounts[face] != data.faceVertexCounts[face])
+					continue;
 
-			Mesh& mesh = *m_meshes[i];
-			if (!mesh.error)
-			{
-				for (uint j = 0; j < mesh.m_jobs.size(); j++)
+				for (int t = 0; t < data.triangleCounts[face]; t++)
 				{
-					UVJob& job = (UVJob&)(*mesh.m_jobs[j]);
-					if (!job.error)
+					int uvIds[3];
+					GetFaceTriangleUVIds(data, face, t, uvIds);
+
+					float2 uv[3];
+					for (int c = 0; c < 3; c++)
 					{
-						double2 position;
-						layout->GetPosition(index, position);
-						job.offsetU = position[0] - job.centerU;
-						job.offsetV = position[1] - job.centerV;
-						index++;
+						uv[c][0] = (float)(mesh.uArray[uvIds[c]] - job.centerU);
+						uv[c][1] = (float)(mesh.vArray[uvIds[c]] - job.centerV);
 					}
+					shape->AddTriangle(uv[0], uv[1], uv[2], 0);
 				}
 			}
+			shape->Build();
+
+			m_layoutShapes.push_back(shape);
+			job.layoutShape = shape;
 		}
 	}
-	else
+}
+
+void
+UVAutoRatioPro::LayoutShells()
+{
+	m_timer.reset();
+	AtomicSet(&m_numResumedBoxes, 0);
+	for (uint i = 0; i < m_uvSetGroups.length(); i++)
+	{
+		if (IsProgressCancelled())
+			break;
+
+		LayoutUVSetGroup((int)i);
+	}
+
+	if (m_params.m_isLayoutWarmStart && !IsProgressCancelled())
 	{
-		uint i = 0;
-		for (i = 0; i < m_meshes.size(); i++)
+		StoreLayoutStates();
+
+		// Nothing can be written to the script editor from a background run
+		if (m_params.m_isVerbose && !m_isSolvingInBackground)
 		{
-			if (IsProgressCancelled())
-				break;
+			const char* resumeMessage = "UVAR: Layout resumed %i unchanged shells from the last run";
+#ifdef WIN32
+			sprintf_s(m_text, sizeof(m_text), resumeMessage, m_numResumedBoxes);
+#else
+			sprintf(m_text,                   resumeMessage, m_numResumedBoxes);
+#endif
+			OutputText(m_text);
+		}
+	}
+	m_layoutTime = m_timer.getTime();
+}
 
-			Mesh& mesh = *m_meshes[i];
-			if (!mesh.error)
+// The content hash of a shell changes when it is scaled, so the state is kept by
+// where the job is in the mesh and checked against the box size instead.
+// Shape names aren't unique, so the mesh is found by its full path.
+UVHash
+UVAutoRatioPro::GetLayoutKey(const Mesh& mesh, uint jobIndex) const
+{
+	UVHash hash = UVHashSeed;
+	const MString& uvSetName = m_uvSetGroups[mesh.uvSetGroup];
+	const char* text = mesh.pathName.asChar();
+	for (uint i = 0; i < mesh.pathName.length(); i++)
+	{
+		HashCombine(hash, text[i]);
+	}
+	HashCombine(hash, -1);
+	text = uvSetName.asChar();
+	for (uint i = 0; i < uvSetName.length(); i++)
+	{
+		HashCombine(hash, text[i]);
+	}
+	HashCombine(hash, (int)mesh.m_jobs.size());
+	HashCombine(hash, (int)jobIndex);
+	return hash;
+}
+
+void
+UVAutoRatioPro::ClearLayoutStates()
+{
+	m_layoutStates.clear();
+}
+
+void
+UVAutoRatioPro::StoreLayoutStates()
+{
+	if (m_layoutStates.size() >= MaxLayoutStates)
+	{
+		ClearLayoutStates();
+	}
+
+	for (size_t i = 0; i < m_meshes.size(); i++)
+	{
+		const Mesh& mesh = *m_meshes[i];
+		if (mesh.error)
+			continue;
+
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			const UVJob& job = *mesh.m_jobs[j];
+			if (!job.error)
 			{
-				uint j = 0;
+				LayoutState& state = m_layoutStates[GetLayoutKey(mesh, j)];
+				state.u = job.centerU + job.offsetU;
+				state.v = job.centerV + job.offsetV;
+				state.width = job.uvWidth * job.finalScaleX + m_params.m_layoutMinDistance;
+				state.height = job.uvHeight * job.finalScaleY + m_params.m_layoutMinDistance;
+			}
+		}
+	}
+}
 
-				// Add all the shells of a mesh to the layout class
-				for (j = 0; j < mesh.m_jobs.size(); j++)
-				{
-					UVJob& job = (UVJob&)(*mesh.m_jobs[j]);
-					if (!job.error)
-					{
-						double2 center;
-						center[0] = job.centerU;
-						center[1] = job.centerV;
-						layout->AddBox(job.uvWidth * job.finalScaleX + m_params.m_layoutMinDistance, job.uvHeight * job.finalScaleY + m_params.m_layoutMinDistance, center);
-					}
-				}
+// Results of the per-mesh layouts, each task only writes to the entries of its own meshes
+struct MeshLayoutData
+{
+	UVAutoRatioPro*					command;
+	int								first;		// Index of the chunk's first mesh
+	std::vector<Mesh*>*				meshes;
+	std::vector<int>*				numSteps;
+	std::vector<LayoutExitReason>*	exitReasons;
+};
 
-				// Iterate!
-				int itCount = 0;
-				for (j = 0; j < m_params.m_layoutIterations; j++)
-				{
-					if (!layout->Step(m_params.m_layoutStep))
-						break;
+void
+UVAutoRatioPro::LayoutMeshesRange(void* data, int begin, int end)
+{
+	MeshLayoutData& layoutData = *(MeshLayoutData*)data;
+	for (int i = layoutData.first + begin; i < layoutData.first + end; i++)
+	{
+		if (layoutData.command->m_progress.IsCancelled())
+			break;
 
-					itCount++;
-					if (itCount >= 100)
-					{
-						itCount = 0;
-						UVAutoRatioPro::StepJobProgress();
-						if (IsProgressCancelled())
-							break;
-					}
-				}
+		UVSpringLayout layout;
+		Mesh& mesh = *(*layoutData.meshes)[i];
+		layoutData.command->AddLayoutBoxes(layout, mesh);
+		layoutData.command->StepLayout(layout, false);
+		int index = 0;
+		layoutData.command->GetLayoutOffsets(layout, mesh, index);
+
+		(*layoutData.numSteps)[i] = layout.GetNumSteps();
+		(*layoutData.exitReasons)[i] = layout.GetExitReason();
+	}
+}
+
+void
+UVAutoRatioPro::LayoutUVSetGroup(int uvSetGroup)
+{
+	//float progressBase = (float)MProgressWindow::progress();
+	//float progressTotal = 1000.0f;
+	//float progressMesh = progressTotal / (float)m_meshes.size();
+	//float progressStep = iterations / 100.0f;
+
+	float iterationSteps = m_params.m_layoutIterations / 100.0f;
+	int numSubTasks = (int)(iterationSteps * m_meshes.size());
+	m_progress.SetNumSubTasks(numSubTasks, "Jobs");
+
+	if (m_params.m_layoutMethod == LayoutBitmapPack)
+	{
+		if (m_params.m_layoutUdim != UdimNone)
+			PackUVSetGroupTiles(uvSetGroup);
+		else
+			PackUVSetGroup(uvSetGroup);
+		return;
+	}
+
+	if (m_params.m_layoutScope != LayoutGlobal)
+	{
+		LayoutUVSetGroupPerMesh(uvSetGroup);
+		return;
+	}
+
+	UVSpringLayout* layout = new UVSpringLayout();
+
+	// Add boxes
+	uint i = 0;
+	for (i = 0; i < m_meshes.size(); i++)
+	{
+		if (IsProgressCancelled())
+			break;
+
+		Mesh& mesh = *m_meshes[i];
+		if (!mesh.error && mesh.uvSetGroup == uvSetGroup)
+		{
+			// Add all the shells of a mesh to the layout class
+			AddLayoutBoxes(*layout, mesh);
+		}
+	}
+
+	// Iterate!
+	StepLayout(*layout, true);
+
+	// Nothing can be written to the script editor from a background run
+	if (m_params.m_isVerbose && !m_isSolvingInBackground && !IsProgressCancelled())
+	{
+		const char* layoutMessage = "UVAR: Layout of uvset '%s' %s after %i steps";
+		const char* exitReason = UVSpringLayout::GetExitReasonName(layout->GetExitReason());
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), layoutMessage, m_uvSetGroups[uvSetGroup].asChar(), exitReason, layout->GetNumSteps());
+#else
+		sprintf(m_text,                   layoutMessage, m_uvSetGroups[uvSetGroup].asChar(), exitReason, layout->GetNumSteps());
+#endif
+		OutputText(m_text);
+	}
+
+	// Retrieve results
+	int index = 0;
+	for (i = 0; i < m_meshes.size(); i++)
+	{
+		if (IsProgressCancelled())
+			break;
+
+		Mesh& mesh = *m_meshes[i];
+		if (!mesh.error && mesh.uvSetGroup == uvSetGroup)
+		{
+			GetLayoutOffsets(*layout, mesh, index);
+		}
+	}
+
+	delete layout;
+	layout = NULL;
+}
+
+// Each mesh is laid out on its own, so the shells of one mesh can overlap another's.
+// The meshes are independent so their layouts run at the same time on the thread pool,
+// a chunk of meshes at a time so that Esc is seen between the chunks.
+void
+UVAutoRatioPro::LayoutUVSetGroupPerMesh(int uvSetGroup)
+{
+	std::vector<Mesh*> meshes;
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (!mesh.error && mesh.uvSetGroup == uvSetGroup && !mesh.m_jobs.empty())
+		{
+			meshes.push_back(&mesh);
+		}
+	}
+	if (meshes.empty())
+		return;
+
+	std::vector<int> numSteps(meshes.size(), 0);
+	std::vector<LayoutExitReason> exitReasons(meshes.size(), LayoutRunning);
+
+	MeshLayoutData layoutData;
+	layoutData.command = this;
+	layoutData.meshes = &meshes;
+	layoutData.numSteps = &numSteps;
+	layoutData.exitReasons = &exitReasons;
+
+	int numMeshes = (int)meshes.size();
+	for (int first = 0; first < numMeshes; first += LayoutMeshChunkSize)
+	{
+		if (IsProgressCancelled())
+			break;
+
+		layoutData.first = first;
+		ParallelFor(Min(LayoutMeshChunkSize, numMeshes - first), 1, LayoutMeshesRange, &layoutData);
+	}
+
+	// Nothing can be written to the script editor from a background run
+	if (m_params.m_isVerbose && !m_isSolvingInBackground && !IsProgressCancelled())
+	{
+		int numSeparated = 0;
+		int maxSteps = 0;
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			if (exitReasons[i] == LayoutSeparated)
+				numSeparated++;
+			if (numSteps[i] > maxSteps)
+				maxSteps = numSteps[i];
+		}
+
+		const char* layoutMessage = "UVAR: Layout of uvset '%s' separated %i of %i meshes, taking up to %i steps";
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), layoutMessage, m_uvSetGroups[uvSetGroup].asChar(), numSeparated, (int)meshes.size(), maxSteps);
+#else
+		sprintf(m_text,                   layoutMessage, m_uvSetGroups[uvSetGroup].asChar(), numSeparated, (int)meshes.size(), maxSteps);
+#endif
+		OutputText(m_text);
+	}
+
+	if (m_params.m_layoutScope == LayoutClustered && !IsProgressCancelled())
+	{
+		LayoutMeshClusters(uvSetGroup, meshes);
+	}
+}
+
+// Lays out the bounds of each mesh's shells as one box, then moves all the shells of a mesh with its box.
+// The layout only has a box per mesh instead of per shell, which is far cheaper than a global layout.
+void
+UVAutoRatioPro::LayoutMeshClusters(int uvSetGroup, const std::vector<Mesh*>& meshes)
+{
+	UVSpringLayout layout;
+	std::vector<double> clusterCenterU, clusterCenterV;
+	std::vector<Mesh*> clusterMeshes;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		Mesh& mesh = *meshes[i];
+
+		bool hasBounds = false;
+		double minU = 0.0, minV = 0.0, maxU = 0.0, maxV = 0.0;
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			const UVJob& job = *mesh.m_jobs[j];
+			if (!job.error)
+			{
+				double halfWidth = 0.5 * (job.uvWidth * job.finalScaleX + m_params.m_layoutMinDistance);
+				double halfHeight = 0.5 * (job.uvHeight * job.finalScaleY + m_params.m_layoutMinDistance);
+				double u = job.centerU + job.offsetU;
+				double v = job.centerV + job.offsetV;
+				if (!hasBounds)
+				{
+					minU = u - halfWidth;
+					maxU = u + halfWidth;
+					minV = v - halfHeight;
+					maxV = v + halfHeight;
+					hasBounds = true;
+				}
+				else
+				{
+					minU = Min(minU, u - halfWidth);
+					maxU = Max(maxU, u + halfWidth);
+					minV = Min(minV, v - halfHeight);
+					maxV = Max(maxV, v + halfHeight);
+				}
+			}
+		}
+
+		if (hasBounds)
+		{
+			double2 center;
+			center[0] = 0.5 * (minU + maxU);
+			center[1] = 0.5 * (minV + maxV);
+			layout.AddBox(maxU - minU, maxV - minV, center);
+
+			clusterCenterU.push_back(center[0]);
+			clusterCenterV.push_back(center[1]);
+			clusterMeshes.push_back(&mesh);
+		}
+	}
+
+	StepLayout(layout, true);
+
+	// Nothing can be written to the script editor from a background run
+	if (m_params.m_isVerbose && !m_isSolvingInBackground && !IsProgressCancelled())
+	{
+		const char* layoutMessage = "UVAR: Layout of the %i mesh clusters of uvset '%s' %s after %i steps";
+		const char* exitReason = UVSpringLayout::GetExitReasonName(layout.GetExitReason());
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), layoutMessage, (int)clusterMeshes.size(), m_uvSetGroups[uvSetGroup].asChar(), exitReason, layout.GetNumSteps());
+#else
+		sprintf(m_text,                   layoutMessage, (int)clusterMeshes.size(), m_uvSetGroups[uvSetGroup].asChar(), exitReason, layout.GetNumSteps());
+#endif
+		OutputText(m_text);
+	}
+
+	for (size_t i = 0; i < clusterMeshes.size(); i++)
+	{
+		double2 position;
+		layout.GetPosition((uint)i, position);
+		double moveU = position[0] - clusterCenterU[i];
+		double moveV = position[1] - clusterCenterV[i];
+
+		Mesh& mesh = *clusterMeshes[i];
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			UVJob& job = *mesh.m_jobs[j];
+			if (!job.error)
+			{
+				job.offsetU += moveU;
+				job.offsetV += moveV;
+			}
+		}
+	}
+}
+
+// Packs the shells into an atlas starting at the lower left corner of their current bounds.
+// The margin is the minimum distance, packed shells don't need the spring layout's extra space.
+void
+UVAutoRatioPro::PackUVSetGroup(int uvSetGroup)
+{
+	UVBitmapPacker packer;
+	packer.SetResolution(m_params.m_layoutPackResolution);
+	packer.SetMargin(m_params.m_layoutMinDistance);
+
+	bool hasBounds = false;
+	double minU = 0.0, minV = 0.0;
+	uint i = 0;
+	for (i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (mesh.error || mesh.uvSetGroup != uvSetGroup)
+			continue;
+
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			UVJob& job = *mesh.m_jobs[j];
+			if (!job.error)
+			{
+				if (job.layoutShape)
+				{
+					job.layoutShape->Scale(job.finalScaleX, job.finalScaleY);
+				}
+				double width = job.uvWidth * job.finalScaleX;
+				double height = job.uvHeight * job.finalScaleY;
+				packer.AddShape(width, height, job.layoutShape);
+
+				double left = job.centerU - 0.5 * width;
+				double bottom = job.centerV - 0.5 * height;
+				minU = hasBounds ? Min(minU, left) : left;
+				minV = hasBounds ? Min(minV, bottom) : bottom;
+				hasBounds = true;
+			}
+		}
+	}
+
+	if (!hasBounds || IsProgressCancelled())
+		return;
+
+	if (m_params.m_isLayoutFitTile)
+	{
+		double scale = packer.FitToTile(0.0, 0.0, 1.0);
+		if (scale > 0.0)
+		{
+			ScalePackedJobs(uvSetGroup, scale);
+		}
+		else
+		{
+			// The minimum distance alone doesn't leave room for them, pack them as they are instead
+			if (!m_isSolvingInBackground)
+			{
+				MGlobal::displayWarning("UVAR: The shells of uvset '" + m_uvSetGroups[uvSetGroup] + "' can't be fitted to the tile with the minimum distance, packing them unscaled");
+			}
+			packer.Pack(minU, minV);
+			ScalePackedJobs(uvSetGroup, 1.0);
+		}
+	}
+	else
+	{
+		packer.Pack(minU, minV);
+	}
+
+	// Nothing can be written to the script editor from a background run
+	if (m_params.m_isVerbose && !m_isSolvingInBackground)
+	{
+		double packedWidth, packedHeight;
+		packer.GetPackedSize(packedWidth, packedHeight);
+
+		const char* packMessage = "UVAR: Packed uvset '%s' into %.4f x %.4f";
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), packMessage, m_uvSetGroups[uvSetGroup].asChar(), packedWidth, packedHeight);
+#else
+		sprintf(m_text,                   packMessage, m_uvSetGroups[uvSetGroup].asChar(), packedWidth, packedHeight);
+#endif
+		OutputText(m_text);
+	}
+
+	int index = 0;
+	for (i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (mesh.error || mesh.uvSetGroup != uvSetGroup)
+			continue;
+
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			UVJob& job = *mesh.m_jobs[j];
+			if (!job.error)
+			{
+				double2 position;
+				packer.GetPosition(index, position);
+				job.offsetU = position[0] - job.centerU;
+				job.offsetV = position[1] - job.centerV;
+				index++;
+			}
+		}
+	}
+}
+
+// Scales the jobs fitted to the tile and records the 2D : 3D ratio they reached
+void
+UVAutoRatioPro::ScalePackedJobs(int uvSetGroup, double scale)
+{
+	double surfaceArea = 0.0;
+	double textureArea = 0.0;
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (mesh.error || mesh.uvSetGroup != uvSetGroup)
+			continue;
+
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			UVJob& job = *mesh.m_jobs[j];
+			if (!job.error)
+			{
+				if (job.layoutShape)
+				{
+					job.layoutShape->Scale(scale, scale);
+				}
+				job.finalScaleX *= scale;
+				job.finalScaleY *= scale;
+				job.finalTextureArea *= scale * scale;
+
+				surfaceArea += job.surfaceArea;
+				textureArea += job.textureArea * job.finalScaleX * job.finalScaleY;
+			}
+		}
+	}
+
+	double ratio = 0.0;
+	if (surfaceArea > 0.0)
+	{
+		ratio = textureArea / surfaceArea;
+	}
+	m_fitTileRatios.append(ratio);
+
+	// Nothing can be written to the script editor from a background run
+	if (m_params.m_isVerbose && !m_isSolvingInBackground)
+	{
+		const char* fitMessage = "UVAR: Fitted uvset '%s' to the tile at %.4f times the size, 2D : 3D ratio %g, %g UV units per unit length";
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), fitMessage, m_uvSetGroups[uvSetGroup].asChar(), scale, ratio, sqrt(ratio));
+#else
+		sprintf(m_text,                   fitMessage, m_uvSetGroups[uvSetGroup].asChar(), scale, ratio, sqrt(ratio));
+#endif
+		OutputText(m_text);
+	}
+}
+
+// Reads the shading group of each job's first face for -layoutUdim material, on the main thread
+// as it reads the scene.  Jobs whose faces can't be read, as in a snapshot, share a tile with their mesh.
+void
+UVAutoRatioPro::GatherUdimMaterials()
+{
+	typedef std::map<std::string, int> TileKeyMap;
+	std::vector<TileKeyMap> tileKeys(m_uvSetGroups.length());
+	MObjectArray shaders;
+	MIntArray shaderIndices;
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (mesh.error)
+			continue;
+
+		bool hasShaders = mesh.dagPath.isValid() &&
+			mesh.model.getConnectedShaders(mesh.dagPath.instanceNumber(), shaders, shaderIndices) == MS::kSuccess;
+
+		TileKeyMap& keys = tileKeys[mesh.uvSetGroup];
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			UVJob& job = *mesh.m_jobs[j];
+			if (job.error)
+				continue;
+
+			int face = 0;
+			if (m_params.m_operationMode == UVShellLevel)
+			{
+				const ShellJob& shellJob = (const ShellJob&)job;
+				face = -1;
+				if (!shellJob.faceComponentObject.isNull())
+				{
+					MFnSingleIndexedComponent faceComponents(shellJob.faceComponentObject);
+					if (faceComponents.elementCount() > 0)
+						face = faceComponents.element(0);
+				}
+			}
+
+			// Node names can't start with a pipe, so a mesh's key never matches a shading group
+			std::string key = std::string("|") + mesh.name.asChar();
+			if (hasShaders && face >= 0 && face < (int)shaderIndices.length())
+			{
+				int shader = shaderIndices[face];
+				key = (shader >= 0) ? MFnDependencyNode(shaders[shader]).name().asChar() : "";
+			}
+
+			TileKeyMap::iterator it = keys.find(key);
+			if (it == keys.end())
+			{
+				int tile = (int)keys.size();
+				it = keys.insert(std::make_pair(key, tile)).first;
+			}
+			job.udimTile = it->second;
+		}
+	}
+}
+
+// Largest boxes first, so dealing each to the emptiest tile leaves them evenly filled
+struct LargerJobArea
+{
+	const std::vector<double>* areas;
+
+	bool operator () (int a, int b) const
+	{
+		if ((*areas)[a] != (*areas)[b])
+			return (*areas)[a] > (*areas)[b];
+		return a < b;
+	}
+};
+
+// Collects the jobs of the UV set and sets the tile of each, returns the number of tiles
+int
+UVAutoRatioPro::AssignUdimTiles(int uvSetGroup, std::vector<UVJob*>& jobs)
+{
+	int meshTile = 0;
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (mesh.error || mesh.uvSetGroup != uvSetGroup)
+			continue;
+
+		bool hasJobs = false;
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			UVJob& job = *mesh.m_jobs[j];
+			if (!job.error)
+			{
+				if (m_params.m_layoutUdim == UdimByMesh)
+					job.udimTile = meshTile;
+				jobs.push_back(&job);
+				hasJobs = true;
+			}
+		}
+		if (hasJobs)
+			meshTile++;
+	}
+	if (jobs.empty())
+		return 0;
+
+	int numTiles = 0;
+	if (m_params.m_layoutUdim == UdimByArea)
+	{
+		std::vector<double> areas(jobs.size());
+		std::vector<int> order(jobs.size());
+		double totalArea = 0.0;
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			const UVJob& job = *jobs[i];
+			areas[i] = (job.uvWidth * job.finalScaleX + m_params.m_layoutMinDistance) * (job.uvHeight * job.finalScaleY + m_params.m_layoutMinDistance);
+			order[i] = (int)i;
+			totalArea += areas[i];
+		}
+
+		numTiles = m_params.m_layoutUdimTiles;
+		if (numTiles == 0)
+		{
+			numTiles = ClampInt(1, 1000, (int)ceil(totalArea / m_params.m_layoutUdimBudget));
+		}
+
+		LargerJobArea larger;
+		larger.areas = &areas;
+		std::sort(order.begin(), order.end(), larger);
+
+		std::vector<double> tileAreas(numTiles, 0.0);
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			int tile = 0;
+			for (int t = 1; t < numTiles; t++)
+			{
+				if (tileAreas[t] < tileAreas[tile])
+					tile = t;
+			}
+			tileAreas[tile] += areas[order[i]];
+			jobs[order[i]]->udimTile = tile;
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			UVJob& job = *jobs[i];
+			if (job.udimTile < 0)
+				job.udimTile = 0;
+			if (m_params.m_layoutUdimTiles > 0)
+				job.udimTile %= m_params.m_layoutUdimTiles;
+			numTiles = std::max(numTiles, job.udimTile + 1);
+		}
+	}
+	return numTiles;
+}
+
+// The packers of the tiles, each task only packs and writes the scale of its own tiles.
+// A negative scale packs unbounded, zero fits to the tile and a positive one packs at that scale.
+struct TilePackData
+{
+	UVAutoRatioPro*					command;
+	std::vector<UVBitmapPacker*>*	packers;
+	std::vector<int>*				numJobs;
+	std::vector<double>*			scales;
+	double							scale;
+};
+
+void
+UVAutoRatioPro::PackTilesRange(void* data, int begin, int end)
+{
+	TilePackData& packData = *(TilePackData*)data;
+	for (int i = begin; i < end; i++)
+	{
+		if (packData.command->m_progress.IsCancelled())
+			break;
+
+		// Tiles already packed at the scale are left as they are
+		double& tileScale = (*packData.scales)[i];
+		if ((*packData.numJobs)[i] == 0 || (packData.scale > 0.0 && tileScale == packData.scale))
+			continue;
+
+		UVBitmapPacker& packer = *(*packData.packers)[i];
+		double originU = (double)(i % UdimColumns);
+		double originV = (double)(i / UdimColumns);
+		if (packData.scale < 0.0)
+		{
+			packer.Pack(originU, originV);
+			tileScale = 1.0;
+		}
+		else if (packData.scale == 0.0)
+		{
+			tileScale = packer.FitToTile(originU, originV, 1.0);
+		}
+		else
+		{
+			tileScale = packer.PackToTile(originU, originV, 1.0, packData.scale) ? packData.scale : 0.0;
+		}
+		packData.command->m_progress.Step();
+	}
+}
+
+// Deals the shells out to UDIM tiles and packs each tile on its own, several at once.
+// With -layoutFitTile every tile is packed at the scale of the fullest one, so the
+// texel density stays the same across the tiles.
+void
+UVAutoRatioPro::PackUVSetGroupTiles(int uvSetGroup)
+{
+	std::vector<UVJob*> jobs;
+	int numTiles = AssignUdimTiles(uvSetGroup, jobs);
+	if (numTiles == 0 || IsProgressCancelled())
+		return;
+
+	std::vector<UVBitmapPacker*> packers(numTiles);
+	std::vector<int> numJobs(numTiles, 0);
+	std::vector<double> scales(numTiles, 0.0);
+	size_t i = 0;
+	int t = 0;
+	for (t = 0; t < numTiles; t++)
+	{
+		packers[t] = new UVBitmapPacker();
+		packers[t]->SetResolution(m_params.m_layoutPackResolution);
+		packers[t]->SetMargin(m_params.m_layoutMinDistance);
+	}
+	for (i = 0; i < jobs.size(); i++)
+	{
+		UVJob& job = *jobs[i];
+		if (job.layoutShape)
+		{
+			job.layoutShape->Scale(job.finalScaleX, job.finalScaleY);
+		}
+		packers[job.udimTile]->AddShape(job.uvWidth * job.finalScaleX, job.uvHeight * job.finalScaleY, job.layoutShape);
+		numJobs[job.udimTile]++;
+	}
+
+	TilePackData packData;
+	packData.command = this;
+	packData.packers = &packers;
+	packData.numJobs = &numJobs;
+	packData.scales = &scales;
+	packData.scale = -1.0;
+
+	if (m_params.m_isLayoutFitTile)
+	{
+		packData.scale = 0.0;
+		ParallelFor(numTiles, 1, PackTilesRange, &packData);
+
+		double scale = DBL_MAX;
+		for (t = 0; t < numTiles; t++)
+		{
+			if (numJobs[t] > 0)
+				scale = Min(scale, scales[t]);
+		}
+
+		// Tiles that fitted at a larger scale are packed again at the common one, which
+		// nearly always fits too.  When one doesn't they all try again a little smaller.
+		bool isFitting = false;
+		for (int retry = 0; retry < UdimFitRetries && scale > 0.0 && !isFitting && !IsProgressCancelled(); retry++)
+		{
+			packData.scale = scale;
+			ParallelFor(numTiles, 1, PackTilesRange, &packData);
+
+			isFitting = true;
+			for (t = 0; t < numTiles; t++)
+			{
+				if (numJobs[t] > 0 && scales[t] != scale)
+					isFitting = false;
+			}
+			if (!isFitting)
+				scale *= UdimFitShrink;
+		}
+
+		if (isFitting)
+		{
+			ScalePackedJobs(uvSetGroup, scale);
+		}
+		else if (!IsProgressCancelled())
+		{
+			if (!m_isSolvingInBackground)
+			{
+				MGlobal::displayWarning("UVAR: The shells of uvset '" + m_uvSetGroups[uvSetGroup] + "' can't be fitted to their tiles with the minimum distance, packing them unscaled");
+			}
+			packData.scale = -1.0;
+			ParallelFor(numTiles, 1, PackTilesRange, &packData);
+			ScalePackedJobs(uvSetGroup, 1.0);
+		}
+	}
+	else
+	{
+		ParallelFor(numTiles, 1, PackTilesRange, &packData);
+	}
+
+	if (!IsProgressCancelled())
+	{
+		std::vector<int> indices(numTiles, 0);
+		for (i = 0; i < jobs.size(); i++)
+		{
+			UVJob& job = *jobs[i];
+			double2 position;
+			packers[job.udimTile]->GetPosition(indices[job.udimTile], position);
+			job.offsetU = position[0] - job.centerU;
+			job.offsetV = position[1] - job.centerV;
+			indices[job.udimTile]++;
+		}
+
+		// Nothing can be written to the script editor from a background run
+		if (!m_isSolvingInBackground)
+		{
+			int numUsedTiles = 0;
+			int numOverflowing = 0;
+			for (t = 0; t < numTiles; t++)
+			{
+				if (numJobs[t] == 0)
+					continue;
+
+				double packedWidth, packedHeight;
+				packers[t]->GetPackedSize(packedWidth, packedHeight);
+				if (packedWidth > 1.0 || packedHeight > 1.0)
+					numOverflowing++;
+				numUsedTiles++;
+			}
+
+			if (numOverflowing > 0)
+			{
+				const char* overflowMessage = "UVAR: The shells overflow %i of the UDIM tiles of uvset '%s', -layoutFitTile scales them to fit";
+#ifdef WIN32
+				sprintf_s(m_text, sizeof(m_text), overflowMessage, numOverflowing, m_uvSetGroups[uvSetGroup].asChar());
+#else
+				sprintf(m_text,                   overflowMessage, numOverflowing, m_uvSetGroups[uvSetGroup].asChar());
+#endif
+				MGlobal::displayWarning(m_text);
+			}
+
+			if (m_params.m_isVerbose)
+			{
+				const char* packMessage = "UVAR: Packed %i shells of uvset '%s' into %i UDIM tiles from 1001 to %i";
+#ifdef WIN32
+				sprintf_s(m_text, sizeof(m_text), packMessage, (int)jobs.size(), m_uvSetGroups[uvSetGroup].asChar(), numUsedTiles, 1000 + numTiles);
+#else
+				sprintf(m_text,                   packMessage, (int)jobs.size(), m_uvSetGroups[uvSetGroup].asChar(), numUsedTiles, 1000 + numTiles);
+#endif
+				OutputText(m_text);
+			}
+		}
+	}
+
+	for (t = 0; t < numTiles; t++)
+	{
+		delete packers[t];
+	}
+}
+
+void
+UVAutoRatioPro::AddLayoutBoxes(UVSpringLayout& layout, Mesh& mesh)
+{
+	for (uint j = 0; j < mesh.m_jobs.size(); j++)
+	{
+		UVJob& job = (UVJob&)(*mesh.m_jobs[j]);
+		if (!job.error)
+		{
+			double2 center;
+			center[0] = job.centerU;
+			center[1] = job.centerV;
+			if (job.layoutShape)
+			{
+				job.layoutShape->Scale(job.finalScaleX, job.finalScaleY);
+			}
+			double width = job.uvWidth * job.finalScaleX + m_params.m_layoutMinDistance;
+			double height = job.uvHeight * job.finalScaleY + m_params.m_layoutMinDistance;
 
-				// Retrieve results
-				int index = 0;
-				for (j = 0; j < mesh.m_jobs.size(); j++)
+			// Boxes that haven't changed size since the last run start where they ended and
+			// stay there, only the changed ones are solved. The map isn't written to while laying out.
+			bool isResumed = false;
+			if (m_params.m_isLayoutWarmStart)
+			{
+				LayoutStateMap::const_iterator it = m_layoutStates.find(GetLayoutKey(mesh, j));
+				if (it != m_layoutStates.end() &&
+					fabs(it->second.width - width) <= LayoutResumeTolerance * Max(width, it->second.width) &&
+					fabs(it->second.height - height) <= LayoutResumeTolerance * Max(height, it->second.height))
 				{
-					UVJob& job = (UVJob&)(*mesh.m_jobs[j]);
-					if (!job.error)
-					{
-						double2 position;
-						layout->GetPosition(index, position);
-						job.offsetU = position[0] - job.centerU;
-						job.offsetV = position[1] - job.centerV;
-						index++;
-					}
+					center[0] = it->second.u;
+					center[1] = it->second.v;
+					isResumed = true;
+					AtomicIncrement(&m_numResumedBoxes);
 				}
-
-				layout->Clear();
 			}
+			layout.AddBox(width, height, center, job.layoutShape, isResumed);
 		}
 	}
+}
 
+// Layouts stepped on the thread pool can't poll the progress window, they only see a cancel once the main thread has
+void
+UVAutoRatioPro::StepLayout(UVSpringLayout& layout, bool isPolling)
+{
+	layout.SetShapeMargin(m_params.m_layoutMinDistance);
+	layout.SetStepSize(m_params.m_layoutStep);
+	layout.SetSeed(m_params.m_layoutSeed);
 
-	delete layout;
-	layout = NULL;
+	int itCount = 0;
+	for (uint i = 0; i < m_params.m_layoutIterations; i++)
+	{
+		if (!layout.Step())
+			break;
 
-	m_layoutTime = m_timer.getTime();
+		itCount++;
+		if (itCount >= 100)
+		{
+			itCount = 0;
+			m_progress.Step();
+			if (isPolling ? IsProgressCancelled() : m_progress.IsCancelled())
+				break;
+		}
+	}
+}
+
+// Index is the layout box of the mesh's first job, and is moved past the mesh's jobs
+void
+UVAutoRatioPro::GetLayoutOffsets(UVSpringLayout& layout, Mesh& mesh, int& index)
+{
+	for (uint j = 0; j < mesh.m_jobs.size(); j++)
+	{
+		UVJob& job = (UVJob&)(*mesh.m_jobs[j]);
+		if (!job.error)
+		{
+			double2 position;
+			layout.GetPosition(index, position);
+			job.offsetU = position[0] - job.centerU;
+			job.offsetV = position[1] - job.centerV;
+			index++;
+		}
+	}
 }
 
 
@@ -713,7 +1491,19 @@ void
 UVAutoRatioPro::Normalise()
 {
 	m_timer.reset();
+	for (uint i = 0; i < m_uvSetGroups.length(); i++)
+	{
+		if (IsProgressCancelled())
+			break;
+
+		NormaliseUVSetGroup((int)i);
+	}
+	float m_normaliseTime = m_timer.getTime();
+}
 
+void
+UVAutoRatioPro::NormaliseUVSetGroup(int uvSetGroup)
+{
 	double lowX, lowY;
 	double highX, highY;
 	lowX = lowY = DBL_MAX;
@@ -727,7 +1517,7 @@ UVAutoRatioPro::Normalise()
 			break;
 
 		Mesh& mesh = *m_meshes[i];
-		if (!mesh.error)
+		if (!mesh.error && mesh.uvSetGroup == uvSetGroup)
 		{
 			for (uint j = 0; j < mesh.m_jobs.size(); j++)
 			{
@@ -755,7 +1545,7 @@ UVAutoRatioPro::Normalise()
 			break;
 
 		Mesh& mesh = *m_meshes[i];
-		if (!mesh.error)
+		if (!mesh.error && mesh.uvSetGroup == uvSetGroup)
 		{
 			for (uint j = 0; j < mesh.m_jobs.size(); j++)
 			{
@@ -783,7 +1573,8 @@ UVAutoRatioPro::Normalise()
 	}
 
 
-	if (m_params.m_isVerbose)
+	// Nothing can be written to the script editor from a background run
+	if (m_params.m_isVerbose && !m_isSolvingInBackground)
 	{
 		const char* extentsMessage = "Extents: %f, %f -> %f, %f  Center:(%f, %f)";
 #ifdef WIN32
@@ -793,15 +1584,17 @@ UVAutoRatioPro::Normalise()
 #endif
 		OutputText(m_text);
 	}
-
-	float m_normaliseTime = m_timer.getTime();
 }
 
 void
-UVAutoRatioPro::ApplyScales()
+UVAutoRatioPro::ApplyScales(uint first, uint last)
 {
 	m_timer.reset();
-	for (uint i = 0; i < m_meshes.size(); i++)
+
+	// The viewports redraw once when everything is applied, or when the apply is cancelled
+	bool isRefreshSuspended = m_params.m_isBatchApply && SuspendRefresh();
+
+	for (uint i = first; i < last; i++)
 	{
 		if (IsProgressCancelled())
 			break;
@@ -812,7 +1605,12 @@ UVAutoRatioPro::ApplyScales()
 			mesh.ApplyScale(*m_activeProcessor);
 		}
 	}
-	m_applyTime = m_timer.getTime();
+
+	if (isRefreshSuspended)
+	{
+		ResumeRefresh();
+	}
+	m_applyTime += m_timer.getTime();
 }
 
 const char*
@@ -940,6 +1738,269 @@ UVAutoRatioPro::DisplayTimingStats()
 	sprintf(m_text,                   message, (int)m_meshes.size(), m_totalJobs, m_loadTime,m_gatherTime, m_processTime, m_layoutTime, m_applyTime, m_totalTime);
 #endif
 	OutputText(m_text);
+
+	if (m_params.m_operationMode == UVShellLevel && m_params.m_isShellCache)
+	{
+		int cacheHits = 0;
+		for (uint i = 0; i < m_meshes.size(); i++)
+		{
+			Mesh& mesh = *m_meshes[i];
+			for (uint j = 0; j < mesh.m_jobs.size(); j++)
+			{
+				ShellJob& job = (ShellJob&)(*mesh.m_jobs[j]);
+				if (job.isCacheHit)
+					cacheHits++;
+			}
+		}
+
+		const char* cacheMessage = "UVAR: %i of %i shells reused results from an identical shell";
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), cacheMessage, cacheHits, m_totalJobs);
+#else
+		sprintf(m_text,                   cacheMessage, cacheHits, m_totalJobs);
+#endif
+		OutputText(m_text);
+	}
+}
+
+// The UV sets to process for a mesh, returns whether they were named by the user
+bool
+UVAutoRatioPro::GetRequestedUVSets(const MFnMesh& mesh, MStringArray& uvSetNames) const
+{
+	uvSetNames.clear();
+	if (m_params.m_isAllUVSets)
+	{
+		mesh.getUVSetNames(uvSetNames);
+		return true;
+	}
+
+	if (m_params.m_UVSetNames.length() > 1)
+	{
+		uvSetNames = m_params.m_UVSetNames;
+		return true;
+	}
+
+	uvSetNames.append(m_params.m_UVSetName);
+	return m_params.m_isUVSetOverride;
+}
+
+// Falling back to the current UV set would process it more than once when several sets are named
+bool
+UVAutoRatioPro::IsFallbackAllowed() const
+{
+	return m_params.m_isFallback && !m_params.m_isAllUVSets && m_params.m_UVSetNames.length() < 2;
+}
+
+// Meshes are laid out and normalised together with the other meshes in the same UV set
+int
+UVAutoRatioPro::GetUVSetGroup(const MString& uvSetName)
+{
+	for (uint i = 0; i < m_uvSetGroups.length(); i++)
+	{
+		if (m_uvSetGroups[i] == uvSetName)
+			return (int)i;
+	}
+	m_uvSetGroups.append(uvSetName);
+	return (int)m_uvSetGroups.length() - 1;
+}
+
+// The meshes for the other UV sets of a mesh reuse the surface areas measured by the first
+void
+UVAutoRatioPro::ShareSurface(Mesh*& firstMesh, Mesh* mesh)
+{
+	if (mesh == NULL)
+		return;
+
+	if (firstMesh == NULL)
+	{
+		firstMesh = mesh;
+		return;
+	}
+
+	firstMesh->surfaceMesh = firstMesh;
+	mesh->surfaceMesh = firstMesh;
+}
+
+// Adds a job for every valid shell of the mesh in one UV set,
+// returns the new mesh or NULL if it has no shells to process
+Mesh*
+UVAutoRatioPro::AddShellJobs(ValidMesh& validMesh, bool isUVSetOverride, bool isFallback, const MString& uvSetName)
+{
+	MStatus status;
+	Mesh* result = NULL;
+
+	MDagPath dagPath = validMesh.dagPath;
+	dagPath.extendToShape();
+	MFnMesh mesh(dagPath);
+
+	validMesh.validShells.clear();
+
+	// Find the uvset we can use for this mesh
+	UVSetResult uvSetResult = FindUVSet(mesh, isUVSetOverride, isFallback, uvSetName);
+	if (uvSetResult == NONE)
+	{
+		// this mesh has no desired uv set, and it can be skipped
+		return NULL;
+	}
+
+	MString currentUVSetName = GetCurrentUVSetName(mesh);
+
+	if (uvSetResult == OVERRIDE)
+	{
+		mesh.setCurrentUVSetName(uvSetName);
+	}
+
+	// Get the UV shell information
+	MIntArray uvShellIDs;
+	unsigned int numShells;
+
+	// it would appear that maya has a bug with this function,
+	// in that it ignores the uvset you pass in, and instead
+	// uses the current uvset of the mesh.
+	// So for now we'll just manually set and unset the uvset
+	// to current before calling this function
+	status = mesh.getUvShellsIds(uvShellIDs, numShells);
+
+	// Go through components in the selection finding which UV shell they are in
+	for (unsigned int j = 0; j < validMesh.components.size(); j++)
+	{
+		if (MGlobal::mayaState() == MGlobal::kInteractive)
+		{
+			if (IsProgressCancelled())
+				break;
+		}
+
+		MObject component = validMesh.components[j];
+
+		// Special case for null component, this happens when the entire mesh is selected
+		if (MObject::kNullObj == component)
+		{
+			// Add all the shells, clear any previously added ones
+			validMesh.validShells.clear();
+			for (unsigned int k = 0; k < numShells; k++)
+			{
+				validMesh.validShells.push_back(k);
+			}
+			// Since we have added all the uv shells, stop processing this mesh
+			break;
+		}
+		else
+		{
+			MObject uvComponent = MObject::kNullObj;
+			// Special case for if the selection is already made of UV's
+			// because we don't have to convert the selection
+			if (MFn::kMeshMapComponent == component.apiType())
+			{
+				uvComponent = component;
+			}
+			else
+			{
+				// select the components
+				status = MGlobal::clearSelectionList();
+				status = MGlobal::select(dagPath, component);
+
+				MStringArray selections;
+				MGlobal::executeCommand("polyListComponentConversion -fromVertexFace -fromEdge -fromFace -fromVertex -toUV -internal;", selections);
+
+				// Now try to get the component from the current selection
+				MSelectionList activeList;
+				for (unsigned int i = 0; i < selections.length(); i++)
+				{
+					activeList.add(selections[i]);
+				}
+
+				// I think this assert is wrong
+				// because a single face component can become multiple uv components
+
+				// We should only have 1 valid in the list, or 0 if it failed
+				assert(activeList.length() < 2);
+				if (activeList.length() == 1)
+				{
+					MDagPath tempDagPath;
+					activeList.getDagPath(0, tempDagPath, uvComponent);
+				}
+				else
+				{
+					displayError(error_componentConversionError);
+				}
+			}
+
+			// If the conversion to UV components went ok, process them
+			if (uvComponent != MObject::kNullObj)
+			{
+				MFnSingleIndexedComponent uvComponents(uvComponent);
+				int numUVs = uvComponents.elementCount();
+				for (int k = 0; k < numUVs; k++)
+				{
+					int uvIndex = uvComponents.element(k);
+					assert((unsigned int)uvIndex < uvShellIDs.length());
+					int shellIndex = uvShellIDs[uvIndex];
+					if (!validMesh.HasShell(shellIndex) && shellIndex >= 0)
+					{
+						validMesh.validShells.push_back(shellIndex);
+					}
+				}
+
+			}
+		}
+	}
+
+	if (validMesh.validShells.size() > 0)
+	{
+		Mesh* mesh = m_meshPool.Allocate();
+		mesh->dagPath = dagPath;
+		mesh->requestedUVSetName = uvSetName;
+		mesh->isUVSetOverride = isUVSetOverride;
+		mesh->uvSetGroup = GetUVSetGroup(uvSetName);
+		m_meshes.push_back(mesh);
+		result = mesh;
+
+		// Number of UVs in each shell, shells without any aren't processed
+		std::vector<int> shellSizes(numShells, 0);
+		unsigned int numUVs = uvShellIDs.length();
+		for (unsigned int k = 0; k < numUVs; k++)
+		{
+			int shellIndex = uvShellIDs[k];
+			if (shellIndex >= 0 && shellIndex < (int)numShells)
+			{
+				shellSizes[shellIndex]++;
+			}
+		}
+
+		// Add all the valid shells
+		for (unsigned int j = 0; j < validMesh.validShells.size(); j++)
+		{
+			if (MGlobal::mayaState() == MGlobal::kInteractive)
+			{
+				if (IsProgressCancelled())
+					break;
+			}
+
+			int shellIndex = validMesh.validShells[j];
+			if (shellSizes[shellIndex] > 0)
+			{
+				ShellJob* job = m_shellJobPool.Allocate();
+				job->mesh = mesh;
+				job->meshShellNumber = shellIndex;
+				mesh->m_jobs.push_back(job);
+			}
+		}
+
+		// A streamed run groups the UV indices when the mesh's chunk is gathered,
+		// so the indices of the whole selection are never held at once
+		if (m_params.m_streamChunkSize == 0)
+		{
+			mesh->BuildUVIndices(uvShellIDs, numShells);
+		}
+	}
+
+	// Restore the uvset
+	if (uvSetResult == OVERRIDE)
+	{
+		mesh.setCurrentUVSetName(currentUVSetName);
+	}
+
+	return result;
 }
 
 // Build UVShell objects from the selection
@@ -1026,7 +2087,7 @@ UVAutoRatioPro::ProcessAsUVShellLevel()
 		desiredUVSetName = &(m_params.m_UVSetName);
 	}*/
 
-	// For each mesh, collect UV shells that are valid
+	// For each mesh and UV set, collect UV shells that are valid
 	for (unsigned int i = 0; i < potentialMeshes.size(); i++)
 	{
 		if (MGlobal::mayaState() == MGlobal::kInteractive)
@@ -1039,163 +2100,14 @@ UVAutoRatioPro::ProcessAsUVShellLevel()
 		dagPath.extendToShape();
 		MFnMesh mesh(dagPath);
 
-		// Find the uvset we can use for this mesh
-		UVSetResult uvSetResult = FindUVSet(mesh, m_params.m_isUVSetOverride, m_params.m_isFallback, m_params.m_UVSetName);
-		if (uvSetResult == NONE)
-		{
-			// this mesh has no desired uv set, and it can be skipped
-			continue;
-		}
-
-		MString currentUVSetName = GetCurrentUVSetName(mesh);
-
-		if (uvSetResult == OVERRIDE)
-		{
-			mesh.setCurrentUVSetName(m_params.m_UVSetName);
-		}
-
-		// Get the UV shell information
-		MIntArray uvShellIDs;
-		unsigned int numShells;
-
-		// it would appear that maya has a bug with this function,
-		// in that it ignores the uvset you pass in, and instead
-		// uses the current uvset of the mesh.
-		// So for now we'll just manually set and unset the uvset
-		// to current before calling this function
-		status = mesh.getUvShellsIds(uvShellIDs, numShells);
-
-		// Go through components in the selection finding which UV shell they are in
-		for (unsigned int j = 0; j < potentialMeshes[i]->components.size(); j++)
-		{
-			if (MGlobal::mayaState() == MGlobal::kInteractive)
-			{
-				if (IsProgressCancelled())
-					break;
-			}
-
-			MObject component = potentialMeshes[i]->components[j];
-
-			// Special case for null component, this happens when the entire mesh is selected
-			if (MObject::kNullObj == component)
-			{
-				// Add all the shells, clear any previously added ones
-				potentialMeshes[i]->validShells.clear();
-				for (unsigned int k = 0; k < numShells; k++)
-				{
-					potentialMeshes[i]->validShells.push_back(k);
-				}
-				// Since we have added all the uv shells, stop processing this mesh
-				break;
-			}
-			else
-			{
-				MObject uvComponent = MObject::kNullObj;
-				// Special case for if the selection is already made of UV's
-				// because we don't have to convert the selection
-				if (MFn::kMeshMapComponent == component.apiType())
-				{
-					uvComponent = component;
-				}
-				else
-				{
-					// select the components
-					status = MGlobal::clearSelectionList();
-					status = MGlobal::select(dagPath, component);
-
-					MStringArray selections;
-					MGlobal::executeCommand("polyListComponentConversion -fromVertexFace -fromEdge -fromFace -fromVertex -toUV -internal;", selections);
-
-					// Now try to get the component from the current selection
-					MSelectionList activeList;
-					for (unsigned int i = 0; i < selections.length(); i++)
-					{
-						activeList.add(selections[i]);
-					}
-
-					// I think this assert is wrong
-					// because a single face component can become multiple uv components
-
-					// We should only have 1 valid in the list, or 0 if it failed
-					assert(activeList.length() < 2);
-					if (activeList.length() == 1)
-					{
-						MDagPath tempDagPath;
-						activeList.getDagPath(0, tempDagPath, uvComponent);
-					}
-					else
-					{
-						displayError(error_componentConversionError);
-					}
-				}
-
-				// If the conversion to UV components went ok, process them
-				if (uvComponent != MObject::kNullObj)
-				{
-					MFnSingleIndexedComponent uvComponents(uvComponent);
-					int numUVs = uvComponents.elementCount();
-					for (int k = 0; k < numUVs; k++)
-					{
-						int uvIndex = uvComponents.element(k);
-						assert((unsigned int)uvIndex < uvShellIDs.length());
-						int shellIndex = uvShellIDs[uvIndex];
-						if (!potentialMeshes[i]->HasShell(shellIndex) && shellIndex >= 0)
-						{
-							potentialMeshes[i]->validShells.push_back(shellIndex);
-						}
-					}
-
-				}
-			}
-		}
-
-		if (potentialMeshes[i]->validShells.size() > 0)
-		{
-			Mesh* mesh = new Mesh();
-			mesh->dagPath = dagPath;
-			m_meshes.push_back(mesh);
-
-			// Add all the valid shells
-			for (unsigned int j = 0; j < potentialMeshes[i]->validShells.size(); j++)
-			{
-				if (MGlobal::mayaState() == MGlobal::kInteractive)
-				{
-					if (IsProgressCancelled())
-						break;
-				}
-
-				MDagPath meshDagPath = potentialMeshes[i]->dagPath;
-				int shellIndex = potentialMeshes[i]->validShells[j];
-
-				MFnSingleIndexedComponent uvComponents;
-				MObject uvComponentObject;
-				uvComponentObject = uvComponents.create(MFn::kMeshMapComponent, &status);
-
-				// collect UV indices
-				for (unsigned int j = 0; j < uvShellIDs.length(); j++)
-				{
-					// if the shell ID matches the current index, add the corresponding indices
-					if (shellIndex == uvShellIDs[j])
-					{
-						uvComponents.addElement( j );
-					}
-				}
-
-				if (uvComponents.elementCount() > 0)
-				{
-					ShellJob* job = new ShellJob();
-					job->mesh = mesh;
-					job->meshShellNumber = shellIndex;
-					job->uvComponentObject = uvComponentObject;
-					mesh->m_jobs.push_back(job);
-				}
-			}
-		}
+		MStringArray uvSetNames;
+		bool isUVSetOverride = GetRequestedUVSets(mesh, uvSetNames);
 
-		// Restore the uvset
-		if (uvSetResult == OVERRIDE)
+		Mesh* firstMesh = NULL;
+		for (unsigned int j = 0; j < uvSetNames.length(); j++)
 		{
-			mesh.setCurrentUVSetName(currentUVSetName);
+			Mesh* setMesh = AddShellJobs(*potentialMeshes[i], isUVSetOverride, IsFallbackAllowed(), uvSetNames[j]);
+			ShareSurface(firstMesh, setMesh);
 		}
 	}
 
@@ -1246,16 +2158,29 @@ UVAutoRatioPro::ProcessAsObjectLevel()
 				}
 			}
 
-			// add to list
+			// add to list, once for each UV set
 			if (unique)
 			{
-				Mesh* mesh = new Mesh;
-				mesh->dagPath = dagPath;
-				m_meshes.push_back(mesh);
+				MFnMesh meshFn(dagPath);
+				MStringArray uvSetNames;
+				bool isUVSetOverride = GetRequestedUVSets(meshFn, uvSetNames);
 
-				MeshJob* job = new MeshJob;
-				job->mesh = mesh;
-				mesh->m_jobs.push_back(job);
+				Mesh* firstMesh = NULL;
+				for (uint i = 0; i < uvSetNames.length(); i++)
+				{
+					Mesh* mesh = m_meshPool.Allocate();
+					mesh->dagPath = dagPath;
+					mesh->requestedUVSetName = uvSetNames[i];
+					mesh->isUVSetOverride = isUVSetOverride;
+					mesh->uvSetGroup = GetUVSetGroup(uvSetNames[i]);
+					m_meshes.push_back(mesh);
+
+					MeshJob* job = m_meshJobPool.Allocate();
+					job->mesh = mesh;
+					mesh->m_jobs.push_back(job);
+
+					ShareSurface(firstMesh, mesh);
+				}
 			}
 		}
 	}
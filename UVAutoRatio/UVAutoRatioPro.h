@@ -16,12 +16,21 @@
 
 #include <iostream>
 #include <vector>
+#include <map>
 #include "Timer.h"
+#include "ObjectPool.h"
+#include "UVUndoJournal.h"
+#include "ThreadUtility.h"
+#include "ProgressService.h"
+#include "FaceHeatmap.h"
+#include "UVTriangleBVH.h"
 #include "ShellProcessor.h"
+#include "GatherSnapshot.h"
 
 class MeshJob;
 class ShellJob;
 class Mesh;
+class UVSpringLayout;
 
 struct ValidMesh
 {
@@ -49,6 +58,13 @@ struct ValidMesh
 
 class UVMesh;
 
+// Where a job's box ended up in the last -layoutWarmStart run
+struct LayoutState
+{
+	double	u, v;
+	double	width, height;
+};
+
 class UVAutoRatioPro :
 	public MPxCommand
 {
@@ -65,13 +81,14 @@ public:
 	static      void* creator();
 	static MSyntax newSyntax();
 
-	static bool		IsProgressCancelled();
+	// Cancels and releases a background run, called when the plugin is unloaded
+	static void		ShutdownAsync();
 
-	static void		SetNumSubTasks(int tasks, const MString& name);
-	static void		StepJobProgress();
+	// Forgets the shell positions kept for -layoutWarmStart, called by -layoutClearWarmStart and on unload
+	static void		ClearLayoutStates();
 
 	void			TestColourFaces();
-	void			ColourFaces(const MDagPath& dagPath, MObject& component, const MString* uvSetName);
+	void			ColourFaces(Mesh& mesh, FaceHeatmap& heatmap);
 
 private:
 	// Startup
@@ -80,13 +97,67 @@ private:
 
 	MStatus		ProcessMeshes();
 	MStatus		BuildDataLists();
-	void		GatherData();
-	void		FindScales();
+	void		GatherData(uint first, uint last);
+	void		FindScales(uint first, uint last);
+	void		GatherStreamed(bool applyChunks);
+	void		BuildLayoutShapes();
 	void		LayoutShells();
+	void		LayoutUVSetGroup(int uvSetGroup);
+	void		LayoutUVSetGroupPerMesh(int uvSetGroup);
+	void		PackUVSetGroup(int uvSetGroup);
+	void		ScalePackedJobs(int uvSetGroup, double scale);
+	void		GatherUdimMaterials();
+	int			AssignUdimTiles(int uvSetGroup, std::vector<UVJob*>& jobs);
+	void		PackUVSetGroupTiles(int uvSetGroup);
+	static void	PackTilesRange(void* data, int begin, int end);
+	void		LayoutMeshClusters(int uvSetGroup, const std::vector<Mesh*>& meshes);
+	void		AddLayoutBoxes(UVSpringLayout& layout, Mesh& mesh);
+	void		StepLayout(UVSpringLayout& layout, bool isPolling);
+	void		GetLayoutOffsets(UVSpringLayout& layout, Mesh& mesh, int& index);
+	static void	LayoutMeshesRange(void* data, int begin, int end);
+	UVHash		GetLayoutKey(const Mesh& mesh, uint jobIndex) const;
+	void		StoreLayoutStates();
 	void		Normalise();
-	void		ApplyScales();
+	void		NormaliseUVSetGroup(int uvSetGroup);
+	void		ApplyScales(uint first, uint last);
 	void		ProcessAsObjectLevel();
 	void		ProcessAsUVShellLevel();
+	Mesh*		AddShellJobs(ValidMesh& validMesh, bool isUVSetOverride, bool isFallback, const MString& uvSetName);
+	bool		GetRequestedUVSets(const MFnMesh& mesh, MStringArray& uvSetNames) const;
+	bool		IsFallbackAllowed() const;
+	int			GetUVSetGroup(const MString& uvSetName);
+	void		ShareSurface(Mesh*& firstMesh, Mesh* mesh);
+	void		CountJobs();
+	void		RestoreUVSets();
+
+	// Asynchronous mode
+	MStatus		CheckNoAsyncRun();
+	MStatus		StartAsync();
+	MStatus		CommitAsync();
+	MStatus		CancelAsync();
+	void		QueryAsync();
+	MStatus		SnapshotAsync();
+	void		SolveAsync();
+	MStatus		ApplyAsync();
+	static void	WaitForAsync();
+	static void	DiscardAsync();
+#if UVAR_THREADED
+	static MThreadRetVal	AsyncSolveTask(void* data);
+	static void				AsyncSolveDone(void* data);
+#endif
+
+	// Gather snapshots
+	MStatus		SaveSnapshot();
+	MStatus		LoadSnapshot();
+	MStatus		ReplaySnapshot();
+
+	// Structured results
+	void		OutputResults();
+	void		SetResultArray();
+	bool		WriteResultsJson();
+	int			GetShellNumber(const UVJob& job) const;
+	JobError	GetResultError(const Mesh& mesh, const UVJob& job) const;
+	void		RunKernelBenchmark();
 
 	// Helper
 	void		DisplayHelp() const;
@@ -99,19 +170,43 @@ private:
 	const char* ErrorToString(JobError error) const;
 
 	// Progress
-	static void		UpdateProgress();
-	static void		SetProgress(int value);
-	
+	bool		IsProgressCancelled();
+
 
 	std::vector<Mesh*>		m_meshes;
 	Processor*				m_activeProcessor;
 
-	static int				m_totalJobs;
-	static int				m_subTasks, m_subTasksLeft;
-	static double			m_subTaskJump;
-	static MString			m_subTaskName;
-	static double			m_progress, m_progressStep;
-	static MString			m_progressMessage;
+	// Storage for the meshes and jobs, released in bulk when the command is destroyed
+	ObjectPool<Mesh>		m_meshPool;
+	ObjectPool<MeshJob>		m_meshJobPool;
+	ObjectPool<ShellJob>	m_shellJobPool;
+
+	// Triangles of each job for -layoutShapes
+	std::vector<UVTriangleBVH*>	m_layoutShapes;
+
+	// Names of the UV sets being processed, each is laid out and normalised on its own
+	MStringArray			m_uvSetGroups;
+
+	// 2D : 3D ratio each UV set was fitted to the tile at by -layoutFitTile
+	MDoubleArray			m_fitTileRatios;
+
+	// Mapped by -loadSnapshot, the shell jobs point into it
+	GatherSnapshot			m_snapshot;
+
+	int						m_totalJobs;
+	ProgressService			m_progress;
+
+	// The run solving in the background, its progress and cancellation go through its service
+	static UVAutoRatioPro*	m_asyncRun;
+	bool					m_isSolvingInBackground;
+
+	// The background run this command committed, it owns the undo information
+	UVAutoRatioPro*			m_committedRun;
+
+	// Kept between runs for -layoutWarmStart, keyed by mesh, UV set and job
+	typedef std::map<UVHash, LayoutState> LayoutStateMap;
+	static LayoutStateMap	m_layoutStates;
+	volatile int			m_numResumedBoxes;
 
 	// Input parameters
 	UVAutoRatioProParams			m_params;
@@ -131,6 +226,7 @@ private:
 
 	// Undo & redo stack
 	std::vector<MDGModifier*> m_undos;	// The stack of undo to perform.
+	UVUndoJournal		m_undoJournal;		// Original and final UVs of meshes written directly
 
 	// Help static string data
 	static const char* UVAutoRatio_Help[];
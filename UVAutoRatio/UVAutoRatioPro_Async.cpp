@@ -0,0 +1,376 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "MayaUtility.h"
+#include "Utility.h"
+#include "UVAutoRatioPro.h"
+
+//
+// Asynchronous mode
+//
+// The selection is broken down and gathered on the main thread, as that needs the DG.
+// A copy of the command then solves, lays out and normalises the jobs on a worker thread
+// while Maya carries on. When it's done it queues "UVAutoRatioPro -commitAsync" for when
+// Maya is idle, and that command applies the results and holds the undo information.
+//
+
+static const char* error_asyncRunning = "An asynchronous run is still in progress, commit or cancel it first";
+static const char* error_asyncStart = "Failed to start the asynchronous run";
+static const char* warning_noAsyncRun = "There is no asynchronous run";
+static const char* warning_asyncBusy = "The asynchronous run is still solving, its results will be applied when it finishes";
+static const char* warning_noThreads = "Asynchronous mode needs Maya 2008 or later, running synchronously";
+
+// Only one run at a time can use the progress state
+MStatus
+UVAutoRatioPro::CheckNoAsyncRun()
+{
+	if (m_asyncRun != NULL)
+	{
+		displayError(error_asyncRunning);
+		return MS::kFailure;
+	}
+	return MS::kSuccess;
+}
+
+MStatus
+UVAutoRatioPro::StartAsync()
+{
+#if UVAR_THREADED
+	if (CheckNoAsyncRun() != MS::kSuccess)
+		return MS::kFailure;
+
+	// The run outlives this command, which has nothing to undo.
+	// Streaming is turned off as the worker needs the gathered data.
+	UVAutoRatioPro* run = new UVAutoRatioPro;
+	run->m_params = m_params;
+	run->m_params.m_streamChunkSize = 0;
+	run->m_savedSelection = m_savedSelection;
+
+	MStatus status = run->SnapshotAsync();
+	run->m_progress.EndWindow();
+	if (status != MS::kSuccess || run->m_progress.IsCancelled())
+	{
+		run->RestoreUVSets();
+		delete run;
+		return status;
+	}
+
+	m_asyncRun = run;
+	run->m_isSolvingInBackground = true;
+
+	MThreadAsync::init();
+	status = MThreadAsync::createTask(AsyncSolveTask, run, AsyncSolveDone, run);
+	if (status != MS::kSuccess)
+	{
+		run->m_progress.SetFinished();
+		DiscardAsync();
+		displayError(error_asyncStart);
+		return status;
+	}
+
+	if (m_params.m_isVerbose)
+	{
+		OutputText("UVAutoRatio 2.0 Pro: Solving in the background...");
+	}
+	return MS::kSuccess;
+#else
+	displayWarning(warning_noThreads);
+	m_params.m_asyncAction = AsyncNone;
+	return ProcessMeshes();
+#endif
+}
+
+// Builds the jobs and gathers their data, everything here reads from the DG.
+// The solve is done here too when it has to read the UV area back from the mesh.
+MStatus
+UVAutoRatioPro::SnapshotAsync()
+{
+	MStatus status;
+
+	if (m_params.m_isVerbose)
+	{
+		OutputText("");
+		OutputText("UVAutoRatio 2.0 Pro: Building Task List...");
+	}
+
+	m_masterTimer.reset();
+
+	m_progress.StartWindow();
+
+	m_progress.SetPhase(0, "Inspecting Selection...");
+	status = BuildDataLists();
+	if (status != MS::kSuccess)
+		return status;
+
+	CountJobs();
+
+	if (!IsProgressCancelled())
+	{
+		if (m_params.m_isVerbose)
+		{
+			OutputText("UVAutoRatio 2.0 Pro: Gathering Data...");
+		}
+		m_progress.SetPhase(1, "Gathering Data...");
+
+		GatherData(0, (uint)m_meshes.size());
+	}
+
+	if (!IsProgressCancelled() && !m_params.m_skipScaling && !m_activeProcessor->IsSolveThreadSafe())
+	{
+		if (m_params.m_isVerbose)
+		{
+			OutputText("UVAutoRatio 2.0 Pro: Calculating Scale...");
+		}
+		m_progress.SetPhase(2, "Calculating Scale...");
+
+		FindScales(0, (uint)m_meshes.size());
+	}
+
+	// The shapes and materials read the scene, so they can't be gathered on the worker
+	if (!IsProgressCancelled() && m_params.m_layoutShells && m_params.m_layoutShapes)
+	{
+		BuildLayoutShapes();
+	}
+	if (!IsProgressCancelled() && m_params.m_layoutShells && m_params.m_layoutUdim == UdimByMaterial)
+	{
+		GatherUdimMaterials();
+	}
+
+	m_totalTime = m_masterTimer.getTime();
+
+	return MS::kSuccess;
+}
+
+// Runs on the worker thread, only touches the gathered data
+void
+UVAutoRatioPro::SolveAsync()
+{
+	m_masterTimer.reset();
+
+	if (!IsProgressCancelled() && !m_params.m_skipScaling && m_activeProcessor->IsSolveThreadSafe())
+	{
+		m_progress.SetPhase(2, "Calculating Scale...");
+		FindScales(0, (uint)m_meshes.size());
+	}
+
+	if (!IsProgressCancelled() && m_params.m_layoutShells)
+	{
+		m_progress.SetPhase(3, "Solving Overlaps...");
+		LayoutShells();
+	}
+
+	if (!IsProgressCancelled() && m_params.m_normalise)
+	{
+		m_progress.SetPhase(4, "Normalising...");
+		Normalise();
+	}
+
+	m_progress.SetPhase(5, "Applying...");
+
+	m_totalTime += m_masterTimer.getTime();
+}
+
+#if UVAR_THREADED
+MThreadRetVal
+UVAutoRatioPro::AsyncSolveTask(void* data)
+{
+	UVAutoRatioPro* run = (UVAutoRatioPro*)data;
+	run->SolveAsync();
+	return 0;
+}
+
+// Called on the worker thread once the task has finished
+void
+UVAutoRatioPro::AsyncSolveDone(void* data)
+{
+	UVAutoRatioPro* run = (UVAutoRatioPro*)data;
+	bool isCancelled = run->m_progress.IsCancelled();
+	run->m_progress.SetFinished();
+
+	// A cancelled run is discarded by the command that cancelled it
+	if (!isCancelled)
+	{
+		MGlobal::executeCommandOnIdle("UVAutoRatioPro -commitAsync", false);
+	}
+}
+#endif
+
+MStatus
+UVAutoRatioPro::CommitAsync()
+{
+	if (m_asyncRun == NULL)
+	{
+		displayWarning(warning_noAsyncRun);
+		return MS::kSuccess;
+	}
+
+	if (!m_asyncRun->m_progress.IsFinished())
+	{
+		displayWarning(warning_asyncBusy);
+		return MS::kSuccess;
+	}
+
+	if (m_asyncRun->m_progress.IsCancelled())
+	{
+		DiscardAsync();
+		return MS::kSuccess;
+	}
+
+	// Take ownership of the run, undo and redo are passed on to it
+	m_committedRun = m_asyncRun;
+	m_committedRun->m_isSolvingInBackground = false;
+	m_asyncRun = NULL;
+#if UVAR_THREADED
+	MThreadAsync::release();
+#endif
+
+	return m_committedRun->ApplyAsync();
+}
+
+// Applies the solved jobs, back on the main thread
+MStatus
+UVAutoRatioPro::ApplyAsync()
+{
+	m_masterTimer.reset();
+
+	m_progress.StartWindow();
+
+	// Meshes may have been deleted while the run was solving
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (!mesh.error && !mesh.dagPath.isValid())
+		{
+			mesh.error = INVALID_MESH;
+		}
+	}
+
+	if (m_params.m_isVerbose)
+	{
+		OutputText("UVAutoRatio 2.0 Pro: Applying...");
+	}
+	m_progress.SetPhase(5, "Applying...");
+
+	ApplyScales(0, (uint)m_meshes.size());
+
+	if (m_params.m_isColour && !IsProgressCancelled())
+	{
+		TestColourFaces();
+	}
+
+	m_progress.SetPhase(6, "Finito!");
+
+	m_totalTime += m_masterTimer.getTime();
+
+	if ((m_params.m_isVerbose || m_params.m_resultFormat != ResultText) && IsProgressCancelled())
+	{
+		for (uint i = 0; i < m_meshes.size(); i++)
+		{
+			Mesh& mesh = *m_meshes[i];
+			for (uint j = 0; j < mesh.m_jobs.size(); j++)
+			{
+				UVJob& job = *mesh.m_jobs[j];
+				if (!job.completed)
+					job.error = SKIPPED;
+			}
+		}
+	}
+	OutputResults();
+
+	m_progress.EndWindow();
+
+	return MS::kSuccess;
+}
+
+MStatus
+UVAutoRatioPro::CancelAsync()
+{
+	if (m_asyncRun == NULL)
+	{
+		displayWarning(warning_noAsyncRun);
+		return MS::kSuccess;
+	}
+
+	m_asyncRun->m_progress.Cancel();
+	WaitForAsync();
+	DiscardAsync();
+
+	return MS::kSuccess;
+}
+
+void
+UVAutoRatioPro::QueryAsync()
+{
+	int percent = -1;
+	if (m_asyncRun != NULL)
+	{
+		const ProgressService& progress = m_asyncRun->m_progress;
+		percent = (progress.GetProgress() * 100) / (ProgressService::NumPhases * ProgressService::PhaseSize);
+		if (progress.IsFinished())
+			percent = 100;
+	}
+	setResult(percent);
+}
+
+void
+UVAutoRatioPro::ShutdownAsync()
+{
+	if (m_asyncRun != NULL)
+	{
+		m_asyncRun->m_progress.Cancel();
+		WaitForAsync();
+		DiscardAsync();
+	}
+}
+
+// The worker checks for cancellation between jobs and layout steps, so this doesn't wait long
+void
+UVAutoRatioPro::WaitForAsync()
+{
+	while (!m_asyncRun->m_progress.IsFinished())
+	{
+		ThreadSleep(10);
+	}
+}
+
+void
+UVAutoRatioPro::DiscardAsync()
+{
+	UVAutoRatioPro* run = m_asyncRun;
+	m_asyncRun = NULL;
+#if UVAR_THREADED
+	MThreadAsync::release();
+#endif
+
+	if (run != NULL)
+	{
+		run->RestoreUVSets();
+		delete run;
+	}
+}
+
+// Gathering may have switched the current UV set of the meshes, put them back
+// when the results are thrown away
+void
+UVAutoRatioPro::RestoreUVSets()
+{
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		if (!mesh.error && mesh.dagPath.isValid())
+		{
+			mesh.RestoreUVSet();
+		}
+	}
+}
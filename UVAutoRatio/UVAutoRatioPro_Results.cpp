@@ -0,0 +1,252 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "MayaUtility.h"
+#include "Utility.h"
+#include "UVKernels.h"
+#include "UVAutoRatioPro.h"
+
+//
+// Structured results
+//
+// -resultFormat returns the jobs as typed arrays, or writes them to a JSON file, instead of
+// formatting a line of text for each one.  Tools read the numbers directly, and large runs
+// don't spend their time printing to the script editor.
+//
+
+static const char* error_resultFile = "Failed to write the results file";
+
+// Values returned for each job by -resultFormat array
+static const int ResultStride = 11;
+
+// Reports the jobs in the requested format, text is only formatted when it is asked for
+void
+UVAutoRatioPro::OutputResults()
+{
+	switch (m_params.m_resultFormat)
+	{
+	case ResultArray:
+		SetResultArray();
+		if (m_params.m_resultPath.length() > 0 && !WriteResultsJson())
+		{
+			displayError(error_resultFile);
+		}
+		break;
+	case ResultJson:
+		if (!WriteResultsJson())
+		{
+			displayError(error_resultFile);
+		}
+		break;
+	default:
+	case ResultText:
+		DisplayStats(!m_params.m_isVerbose);
+		break;
+	}
+
+	if (m_params.m_isShowTiming)
+		DisplayTimingStats();
+}
+
+// Mesh index, shell number, surface area, texture area, final texture area, scale U, scale V,
+// offset U, offset V, iterations and error code of each job.  The shell number is -1 for whole meshes,
+// the mesh index counts the meshes of the JSON file written by the same run.
+void
+UVAutoRatioPro::SetResultArray()
+{
+	uint numJobs = 0;
+	uint i = 0;
+	for (i = 0; i < m_meshes.size(); i++)
+	{
+		numJobs += (uint)m_meshes[i]->m_jobs.size();
+	}
+
+	MDoubleArray results;
+	results.setLength(numJobs * ResultStride);
+	uint index = 0;
+	for (i = 0; i < m_meshes.size(); i++)
+	{
+		const Mesh& mesh = *m_meshes[i];
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			const UVJob& job = *mesh.m_jobs[j];
+			results[index++] = (double)i;
+			results[index++] = (double)GetShellNumber(job);
+			results[index++] = job.surfaceArea;
+			results[index++] = job.textureArea;
+			results[index++] = job.finalTextureArea;
+			results[index++] = job.finalScaleX;
+			results[index++] = job.finalScaleY;
+			results[index++] = job.offsetU;
+			results[index++] = job.offsetV;
+			results[index++] = (double)job.iterationsPerformed;
+			results[index++] = (double)GetResultError(mesh, job);
+		}
+	}
+	setResult(results);
+}
+
+int
+UVAutoRatioPro::GetShellNumber(const UVJob& job) const
+{
+	if (m_params.m_operationMode == UVShellLevel)
+		return ((const ShellJob&)job).meshShellNumber;
+	return -1;
+}
+
+// A job of a mesh that failed reports the mesh's error
+JobError
+UVAutoRatioPro::GetResultError(const Mesh& mesh, const UVJob& job) const
+{
+	if (job.error == OK)
+		return mesh.error;
+	return job.error;
+}
+
+static void
+WriteJsonString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text; *c != 0; c++)
+	{
+		unsigned char character = (unsigned char)*c;
+		if (character == '"' || character == '\\')
+		{
+			fputc('\\', file);
+			fputc(character, file);
+		}
+		else if (character < 0x20)
+		{
+			fprintf(file, "\\u%04x", character);
+		}
+		else
+		{
+			fputc(character, file);
+		}
+	}
+	fputc('"', file);
+}
+
+// Infinite and undefined values aren't valid JSON, they are written as null
+static void
+WriteJsonNumber(FILE* file, const char* name, double value)
+{
+	if (value == value && value <= DBL_MAX && value >= -DBL_MAX)
+		fprintf(file, "\"%s\": %.17g", name, value);
+	else
+		fprintf(file, "\"%s\": null", name);
+}
+
+bool
+UVAutoRatioPro::WriteResultsJson()
+{
+	FILE* file = NULL;
+#ifdef WIN32
+	if (fopen_s(&file, m_params.m_resultPath.asChar(), "wb") != 0)
+		file = NULL;
+#else
+	file = fopen(m_params.m_resultPath.asChar(), "wb");
+#endif
+	if (file == NULL)
+		return false;
+
+	fprintf(file, "{\n\t\"meshes\": [");
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		const Mesh& mesh = *m_meshes[i];
+		fprintf(file, "%s\n\t\t{\n\t\t\t\"path\": ", (i > 0) ? "," : "");
+		WriteJsonString(file, mesh.pathName.asChar());
+		fprintf(file, ",\n\t\t\t\"uvSet\": ");
+		WriteJsonString(file, mesh.useUVSetName.asChar());
+		fprintf(file, ",\n\t\t\t\"error\": %i,\n\t\t\t\"status\": ", (int)mesh.error);
+		WriteJsonString(file, ErrorToString(mesh.error));
+		fprintf(file, ",\n\t\t\t\"jobs\": [");
+
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			const UVJob& job = *mesh.m_jobs[j];
+			JobError error = GetResultError(mesh, job);
+			fprintf(file, "%s\n\t\t\t\t{\"shell\": %i, ", (j > 0) ? "," : "", GetShellNumber(job));
+			WriteJsonNumber(file, "surfaceArea", job.surfaceArea);
+			fprintf(file, ", ");
+			WriteJsonNumber(file, "textureArea", job.textureArea);
+			fprintf(file, ", ");
+			WriteJsonNumber(file, "finalTextureArea", job.finalTextureArea);
+			fprintf(file, ", ");
+			WriteJsonNumber(file, "scaleU", job.finalScaleX);
+			fprintf(file, ", ");
+			WriteJsonNumber(file, "scaleV", job.finalScaleY);
+			fprintf(file, ", ");
+			WriteJsonNumber(file, "offsetU", job.offsetU);
+			fprintf(file, ", ");
+			WriteJsonNumber(file, "offsetV", job.offsetV);
+			fprintf(file, ", \"iterations\": %i, \"error\": %i, \"status\": ", job.iterationsPerformed, (int)error);
+			WriteJsonString(file, ErrorToString(error));
+			fprintf(file, "}");
+		}
+		fprintf(file, "%s]\n\t\t}", mesh.m_jobs.empty() ? "" : "\n\t\t\t");
+	}
+	fprintf(file, "%s],\n", m_meshes.empty() ? "" : "\n\t");
+
+	fprintf(file, "\t\"timings\": {\"load\": %.3f, \"gather\": %.3f, \"process\": %.3f, \"layout\": %.3f, \"apply\": %.3f, \"total\": %.3f}\n}\n",
+		m_loadTime, m_gatherTime, m_processTime, m_layoutTime, m_applyTime, m_totalTime);
+
+	bool result = (ferror(file) == 0);
+	if (fclose(file) != 0)
+		result = false;
+	return result;
+}
+
+//
+// Kernel benchmark
+//
+// -benchmarkKernels times the array kernels of each instruction set the CPU supports against
+// the scalar ones on synthetic data, so the gain on a particular machine can be checked.
+//
+
+static const int KernelBenchmarkValues = 100000;
+static const int KernelBenchmarkRepeats = 100;
+
+// Prints a line for each kernel and level, flagging any whose results differ from scalar,
+// and returns their speedups over scalar in the same order
+void
+UVAutoRatioPro::RunKernelBenchmark()
+{
+	const char* levelMessage = "UVAR: Kernels in use: %s, supported: %s";
+#ifdef WIN32
+	sprintf_s(m_text, sizeof(m_text), levelMessage, GetKernelLevelName(GetKernelLevel()), GetKernelLevelName(GetSupportedKernelLevel()));
+#else
+	sprintf(m_text,                   levelMessage, GetKernelLevelName(GetKernelLevel()), GetKernelLevelName(GetSupportedKernelLevel()));
+#endif
+	OutputText(m_text);
+
+	std::vector<KernelTiming> timings;
+	BenchmarkKernels(KernelBenchmarkValues, KernelBenchmarkRepeats, timings);
+
+	MDoubleArray speedups;
+	const char* timingMessage = "UVAR: %-16s %-7s %8.1fms %6.2fx %s";
+	for (uint i = 0; i < timings.size(); i++)
+	{
+		const KernelTiming& timing = timings[i];
+		const char* check = timing.matches ? "" : "RESULTS DIFFER FROM SCALAR";
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), timingMessage, timing.kernel, GetKernelLevelName(timing.level), timing.milliseconds, timing.speedup, check);
+#else
+		sprintf(m_text,                   timingMessage, timing.kernel, GetKernelLevelName(timing.level), timing.milliseconds, timing.speedup, check);
+#endif
+		OutputText(m_text);
+		speedups.append(timing.speedup);
+	}
+	setResult(speedups);
+}
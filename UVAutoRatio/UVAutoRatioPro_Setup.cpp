@@ -12,6 +12,7 @@
 //
 
 #include "MayaPCH.h"
+#include <maya/MAnimControl.h>
 #include "MayaUtility.h"
 #include "Utility.h"
 //#include "UVShell.h"
@@ -24,16 +25,49 @@ const char* UVAutoRatioPro::UVAutoRatio_Help[] = {
 	"\n",
 	"\t-help       (-hlp) This gets printed\n",
 	"\t-ratio      (-r)   [double] Desired 2D : 3D ratio\n",
-	"\t-uvSetName  (-us)  [string] The name of the UV set to use (optional)\n",
+	"\t-uvSetName  (-us)  [string] The name of the UV set to use (optional), can be used more than once to process several UV sets\n",
+	"\t-allUVSets  (-aus) Process every UV set of each mesh, measuring the surface area only once (optional), default false\n",
 	"\t-fallback   (-fb)  If the named UV set is not found in a mesh, use the default UV set instead of skipping it (optional)\n",
 	"\t-iterations (-it)  [integer] Maximum number of iterations (optional), default 200\n",
 	"\t-threshold  (-th)  [double] Accuracy threshold for ratio finder (optional), default 0.001\n",
 	"\t-operation  (-op)  [integer] 0 = whole mesh, 1 = uv shell\n",
 	"\t-verbose    (-vb)  Display output (optional), default false\n",
 	"\t-layout     (-lay) Layout UV shells to prevent overlapping (optional), default true\n",
+	"\t-layoutIterations (-lai) [integer] Maximum number of layout steps, layout stops earlier once the shells separate or settle (optional), default 10000\n",
+	"\t-layoutStep  (-las) [double] First layout step size, the step adapts as the shells move (optional), default 0.001\n",
+	"\t-layoutSeed  (-lse) [integer] Seed for the directions shells on the same spot are pushed apart in, the same seed always gives the same layout (optional), default 0\n",
+	"\t-layoutScope (-lsc) [string] global = lay out all the shells of a UV set together, mesh = lay out each mesh on its own, several at once, cluster = lay out each mesh then keep its shells together while laying out the meshes (optional), default global\n",
+	"\t-layoutWarmStart (-lws) Shells that are the same size as in the last warm started layout start where it left them and don't move, only the rest are laid out (optional), default false\n",
+	"\t-layoutClearWarmStart (-lcw) Forget the shell positions kept for -layoutWarmStart and return without processing, doesn't need a selection\n",
+	"\t-layoutMethod (-lam) [string] spring = push overlapping shells apart, pack = pack the shells' rasterised triangles into a new atlas, -layoutScope and -layoutWarmStart only apply to spring (optional), default spring\n",
+	"\t-layoutPackResolution (-lpr) [integer] Width of the pack atlas in cells, more cells pack closer but take longer (optional), default 512\n",
+	"\t-layoutFitTile (-lft) Scale every shell by the largest amount that still packs them all into the 0 to 1 tile, returns the 2D : 3D ratio reached for each UV set (optional), implies -layout and -layoutMethod pack, can't be used with -normalise\n",
+	"\t-layoutUdim (-lud) [string] none = pack into one space, material = a UDIM tile for each shading group, mesh = a tile for each mesh, area = deal the shells out to tiles holding about the same area, each tile is packed on its own starting at 1001 (optional), implies -layout and -layoutMethod pack, can't be used with -normalise, default none\n",
+	"\t-layoutUdimTiles (-lut) [integer] Number of tiles the shells are dealt out to by area, material and mesh tiles past it wrap round (optional), default 0 (as many as needed)\n",
+	"\t-layoutUdimBudget (-lub) [double] Shell area each tile holds when dealing by area without -layoutUdimTiles (optional), default 0.5\n",
+	"\t-layoutShapes (-lsh) Only separate shells whose UV triangles overlap, not just their bounding boxes (optional), default false\n",
 	"\t-skipscale  (-ss)  Skip the scaling operation (useful if you only want to fix layout)\n",
 	"\t-onlyScaleH (-osh) Restrict scaling of UVs to horizontal axis (optional), default false\n",
 	"\t-onlyScaleV (-osv) Restrict scaling of UVs to vertical axis (optional), default false\n",
+	"\t-colour      (-col) Colour the faces by their ratio, relative to the average of their shell or mesh (optional), default false\n",
+	"\t-colourRatio (-cor) [double] Colour the faces relative to this ratio instead of the shell or mesh average (optional)\n",
+	"\t-startFrame  (-sf)  [double] Use the surface area over a frame range starting at this frame, defaults to the playback start (optional)\n",
+	"\t-endFrame    (-ef)  [double] Use the surface area over a frame range ending at this frame, defaults to the playback end (optional)\n",
+	"\t-frameStep   (-fst) [double] Frames between samples of the frame range (optional), default 1\n",
+	"\t-frameStatistic (-fs) [integer] Surface area used from the frame range, 0 = minimum, 1 = mean, 2 = maximum (optional), default 1\n",
+	"\t-noShellCache (-nsc) Don't reuse results between identical UV shells (optional), default false\n",
+	"\t-streamChunk (-stc) [integer] Process meshes in chunks of this size, releasing their UV data as it goes (optional), default 0 (off)\n",
+	"\t-moveUVHistory (-muh) Always apply the changes with polyMoveUV nodes, even for meshes without construction history (optional), default false\n",
+	"\t-batchApply  (-bap) Apply each mesh's changes in one go without selecting them, the viewports only redraw once they are all applied (optional), default false\n",
+	"\t-saveSnapshot (-svs) [string] Write the gathered data to this file (optional), can't be used with -streamChunk\n",
+	"\t-loadSnapshot (-lds) [string] Solve, layout and normalise the gathered data in this file instead of the selection, returns the scale U, scale V, offset U and offset V of each job without changing the scene (optional)\n",
+	"\t-resultFormat (-rf) [string] text = print a line for each job, array = return the mesh index, shell number (-1 for whole meshes), surface area, texture area, final texture area, scale U, scale V, offset U, offset V, iterations and error code of each job, json = write every job to -resultFile (optional), default text\n",
+	"\t-resultFile   (-rfl) [string] The JSON file -resultFormat json writes, -resultFormat array also writes it when given, so the path and UV set of each mesh index come from the same run\n",
+	"\t-async       (-asy) Gather on the main thread, then solve in the background and apply the results when Maya is idle (optional), default false\n",
+	"\t-commitAsync (-cma) Apply the results of a finished background run now\n",
+	"\t-cancelAsync (-cna) Cancel the background run and discard its results\n",
+	"\t-queryAsync  (-qya) Returns the percentage complete of the background run, or -1 if there isn't one\n",
+	"\t-benchmarkKernels (-bmk) Time the area, bounds, scale and transform kernels of each instruction set this CPU supports against the scalar ones, checks their results match scalar and returns the speedup of each, doesn't need a selection\n",
 	"\n"
 };
 
@@ -55,16 +89,47 @@ UVAutoRatioPro::newSyntax()
 	syntax.addFlag("-it", "-iterations", MSyntax::kLong);
 	syntax.addFlag("-op", "-operation", MSyntax::kLong);
 	syntax.addFlag("-us", "-uvSetName",MSyntax::kString);
+	syntax.makeFlagMultiUse("-us");
+	syntax.addFlag("-aus", "-allUVSets");
 	syntax.addFlag("-lay", "-layout");
 	syntax.addFlag("-nor", "-normalise");
 	syntax.addFlag("-kar", "-keepAspectRatio");
 	syntax.addFlag("-lai", "-layoutIterations", MSyntax::kLong);
 	syntax.addFlag("-las", "-layoutStep", MSyntax::kDouble);
+	syntax.addFlag("-lse", "-layoutSeed", MSyntax::kLong);
+	syntax.addFlag("-lsc", "-layoutScope", MSyntax::kString);
+	syntax.addFlag("-lws", "-layoutWarmStart");
+	syntax.addFlag("-lcw", "-layoutClearWarmStart");
+	syntax.addFlag("-lam", "-layoutMethod", MSyntax::kString);
+	syntax.addFlag("-lpr", "-layoutPackResolution", MSyntax::kLong);
+	syntax.addFlag("-lft", "-layoutFitTile");
+	syntax.addFlag("-lud", "-layoutUdim", MSyntax::kString);
+	syntax.addFlag("-lut", "-layoutUdimTiles", MSyntax::kLong);
+	syntax.addFlag("-lub", "-layoutUdimBudget", MSyntax::kDouble);
 	syntax.addFlag("-lad", "-layoutMinDistance", MSyntax::kDouble);
+	syntax.addFlag("-lsh", "-layoutShapes");
 	syntax.addFlag("-ss", "-skipscale");
 	syntax.addFlag("-osh", "-onlyScaleH");
 	syntax.addFlag("-osv", "-onlyScaleV");
 	syntax.addFlag("-col", "-colour");
+	syntax.addFlag("-cor", "-colourRatio", MSyntax::kDouble);
+	syntax.addFlag("-sf", "-startFrame", MSyntax::kDouble);
+	syntax.addFlag("-ef", "-endFrame", MSyntax::kDouble);
+	syntax.addFlag("-fst", "-frameStep", MSyntax::kDouble);
+	syntax.addFlag("-fs", "-frameStatistic", MSyntax::kLong);
+	syntax.addFlag("-nsc", "-noShellCache");
+	syntax.addFlag("-stc", "-streamChunk", MSyntax::kLong);
+	syntax.addFlag("-muh", "-moveUVHistory");
+	syntax.addFlag("-bap", "-batchApply");
+	syntax.addFlag("-svs", "-saveSnapshot", MSyntax::kString);
+	syntax.addFlag("-lds", "-loadSnapshot", MSyntax::kString);
+	syntax.addFlag("-rf", "-resultFormat", MSyntax::kString);
+	syntax.addFlag("-rfl", "-resultFile", MSyntax::kString);
+	syntax.addFlag("-asy", "-async");
+	syntax.addFlag("-cma", "-commitAsync");
+	syntax.addFlag("-cna", "-cancelAsync");
+	syntax.addFlag("-qya", "-queryAsync");
+	syntax.addFlag("-bmk", "-benchmarkKernels");
 	
 	syntax.useSelectionAsDefault(false);
 	syntax.enableQuery(false);
@@ -78,6 +143,16 @@ UVAutoRatioPro::ParseArguments(const MArgList& args)
 	//static const char* error_noArgs = "No parameters specified. -help for available flags.";
 	static const char* error_noRatio = "No ratio parameter specified.";
 	static const char* error_bothScalings = "Cannot have both scaling directions limited";
+	static const char* error_frameRange = "The end frame must not be before the start frame";
+	static const char* error_snapshotStreamed = "A snapshot needs all the gathered data at once, it can't be saved with -streamChunk";
+	static const char* error_snapshotAsync = "Snapshots can't be saved or replayed by an asynchronous run";
+	static const char* error_layoutScope = "Unknown layout scope, use global, mesh or cluster";
+	static const char* error_layoutMethod = "Unknown layout method, use spring or pack";
+	static const char* error_fitTileNormalise = "-layoutFitTile already fits the shells to the tile, it can't be used with -normalise";
+	static const char* error_layoutUdim = "Unknown UDIM mode, use none, material, mesh or area";
+	static const char* error_resultFormat = "Unknown result format, use text, array or json";
+	static const char* error_resultFile = "-resultFormat json needs the -resultFile to write";
+	static const char* error_udimNormalise = "-layoutUdim packs the shells into their tiles, it can't be used with -normalise";
 
 	MArgDatabase argData(syntax(), args);
 
@@ -87,16 +162,119 @@ UVAutoRatioPro::ParseArguments(const MArgList& args)
 	m_params.m_isShowTiming = argData.isFlagSet("-showTimings");
 	m_params.m_isFallback = argData.isFlagSet("-fallback");
 	m_params.m_layoutShells = argData.isFlagSet("-layout");
+	m_params.m_isLayoutFitTile = argData.isFlagSet("-layoutFitTile");
+	if (m_params.m_isLayoutFitTile)
+	{
+		m_params.m_layoutShells = true;
+	}
+
+	MString layoutUdim;
+	if (getArgValue(argData, "-lud", "-layoutUdim", layoutUdim))
+	{
+		if (layoutUdim == "none")
+			m_params.m_layoutUdim = UdimNone;
+		else if (layoutUdim == "material")
+			m_params.m_layoutUdim = UdimByMaterial;
+		else if (layoutUdim == "mesh")
+			m_params.m_layoutUdim = UdimByMesh;
+		else if (layoutUdim == "area")
+			m_params.m_layoutUdim = UdimByArea;
+		else
+			return error_layoutUdim;
+
+		if (m_params.m_layoutUdim != UdimNone)
+			m_params.m_layoutShells = true;
+	}
 	m_params.m_normalise = argData.isFlagSet("-normalise");
 	m_params.m_normaliseKeepAspectRatio = argData.isFlagSet("-keepAspectRatio");
 	m_params.m_skipScaling = argData.isFlagSet("-skipscale");
 	m_params.m_isColour = argData.isFlagSet("-colour");
+	m_params.m_isShellCache = !argData.isFlagSet("-noShellCache");
+	m_params.m_isMoveUVHistory = argData.isFlagSet("-moveUVHistory");
+	m_params.m_isBatchApply = argData.isFlagSet("-batchApply");
+
+	// Clearing the warm start states doesn't touch the scene either
+	m_params.m_isLayoutClearWarmStart = argData.isFlagSet("-layoutClearWarmStart");
+	if (m_params.m_isLayoutClearWarmStart)
+		return NULL;
+
+	// The benchmark doesn't touch the scene, so it ignores the other flags
+	m_params.m_isBenchmarkKernels = argData.isFlagSet("-benchmarkKernels");
+	if (m_params.m_isBenchmarkKernels)
+		return NULL;
+
+	// Committing, cancelling and querying only act on the background run
+	if (argData.isFlagSet("-commitAsync"))
+		m_params.m_asyncAction = AsyncCommit;
+	if (argData.isFlagSet("-cancelAsync"))
+		m_params.m_asyncAction = AsyncCancel;
+	if (argData.isFlagSet("-queryAsync"))
+		m_params.m_asyncAction = AsyncQuery;
+	if (m_params.m_asyncAction != AsyncNone)
+		return NULL;
+
+	if (argData.isFlagSet("-async"))
+		m_params.m_asyncAction = AsyncStart;
 
 	if (m_params.m_layoutShells)
 	{
 		getArgValue(argData, "-lai", "-layoutIterations", m_params.m_layoutIterations);
 		getArgValue(argData, "-las", "-layoutStep", m_params.m_layoutStep);
+		getArgValue(argData, "-lse", "-layoutSeed", m_params.m_layoutSeed);
+
+		MString layoutScope;
+		if (getArgValue(argData, "-lsc", "-layoutScope", layoutScope))
+		{
+			if (layoutScope == "mesh")
+				m_params.m_layoutScope = LayoutPerMesh;
+			else if (layoutScope == "global")
+				m_params.m_layoutScope = LayoutGlobal;
+			else if (layoutScope == "cluster")
+				m_params.m_layoutScope = LayoutClustered;
+			else
+				return error_layoutScope;
+		}
+
 		getArgValue(argData, "-lad", "-layoutMinDistance", m_params.m_layoutMinDistance);
+		m_params.m_layoutShapes = argData.isFlagSet("-layoutShapes");
+		m_params.m_isLayoutWarmStart = argData.isFlagSet("-layoutWarmStart");
+
+		MString layoutMethod;
+		if (getArgValue(argData, "-lam", "-layoutMethod", layoutMethod))
+		{
+			if (layoutMethod == "spring")
+				m_params.m_layoutMethod = LayoutSprings;
+			else if (layoutMethod == "pack")
+				m_params.m_layoutMethod = LayoutBitmapPack;
+			else
+				return error_layoutMethod;
+		}
+
+		if (m_params.m_isLayoutFitTile)
+		{
+			if (m_params.m_normalise)
+				return error_fitTileNormalise;
+			m_params.m_layoutMethod = LayoutBitmapPack;
+		}
+
+		if (m_params.m_layoutUdim != UdimNone)
+		{
+			if (m_params.m_normalise)
+				return error_udimNormalise;
+			m_params.m_layoutMethod = LayoutBitmapPack;
+
+			getArgValue(argData, "-lut", "-layoutUdimTiles", m_params.m_layoutUdimTiles);
+			getArgValue(argData, "-lub", "-layoutUdimBudget", m_params.m_layoutUdimBudget);
+			m_params.m_layoutUdimTiles = ClampInt(0, 1000, m_params.m_layoutUdimTiles);
+			m_params.m_layoutUdimBudget = ClampDouble(0.001, 1000.0, m_params.m_layoutUdimBudget);
+		}
+
+		// Packing always rasterises the shells' triangles
+		if (m_params.m_layoutMethod == LayoutBitmapPack)
+			m_params.m_layoutShapes = true;
+
+		getArgValue(argData, "-lpr", "-layoutPackResolution", m_params.m_layoutPackResolution);
+		m_params.m_layoutPackResolution = ClampInt(64, 8192, m_params.m_layoutPackResolution);
 		m_params.m_layoutIterations = ClampUInt(1, 10000, m_params.m_layoutIterations);
 		m_params.m_layoutStep = ClampDouble(0.00001, 0.1, m_params.m_layoutStep);
 		m_params.m_layoutMinDistance = ClampDouble(0.0, 1000.0, m_params.m_layoutMinDistance);
@@ -128,14 +306,88 @@ UVAutoRatioPro::ParseArguments(const MArgList& args)
 		m_params.m_threshold = ClampDouble(0.0001, 1.0, m_params.m_threshold);
 	}
 
+	getArgValue(argData, "-stc", "-streamChunk", m_params.m_streamChunkSize);
+
+	MString resultFormat;
+	if (getArgValue(argData, "-rf", "-resultFormat", resultFormat))
+	{
+		if (resultFormat == "text")
+			m_params.m_resultFormat = ResultText;
+		else if (resultFormat == "array")
+			m_params.m_resultFormat = ResultArray;
+		else if (resultFormat == "json")
+			m_params.m_resultFormat = ResultJson;
+		else
+			return error_resultFormat;
+	}
+	getArgValue(argData, "-rfl", "-resultFile", m_params.m_resultPath);
+	if (m_params.m_resultFormat == ResultJson && m_params.m_resultPath.length() == 0)
+	{
+		return error_resultFile;
+	}
+
+	getArgValue(argData, "-svs", "-saveSnapshot", m_params.m_saveSnapshotPath);
+	getArgValue(argData, "-lds", "-loadSnapshot", m_params.m_loadSnapshotPath);
+	if (m_params.m_saveSnapshotPath.length() > 0 || m_params.m_loadSnapshotPath.length() > 0)
+	{
+		if (m_params.m_asyncAction == AsyncStart)
+		{
+			return error_snapshotAsync;
+		}
+		if (m_params.m_saveSnapshotPath.length() > 0 && m_params.m_streamChunkSize > 0)
+		{
+			return error_snapshotStreamed;
+		}
+	}
+
+	// A frame range is used if either end of it is given, the other end comes from the playback range
+	m_params.m_startFrame = MAnimControl::minTime().as(MTime::uiUnit());
+	m_params.m_endFrame = MAnimControl::maxTime().as(MTime::uiUnit());
+	bool hasStartFrame = getArgValue(argData, "-sf", "-startFrame", m_params.m_startFrame);
+	bool hasEndFrame = getArgValue(argData, "-ef", "-endFrame", m_params.m_endFrame);
+	m_params.m_isFrameRange = (hasStartFrame || hasEndFrame);
+	if (m_params.m_isFrameRange)
+	{
+		if (m_params.m_endFrame < m_params.m_startFrame)
+		{
+			return error_frameRange;
+		}
+
+		int frameStatistic = (int)FrameMean;
+		getArgValue(argData, "-fst", "-frameStep", m_params.m_frameStep);
+		getArgValue(argData, "-fs", "-frameStatistic", frameStatistic);
+		m_params.m_frameStep = ClampDouble(0.001, DBL_MAX, m_params.m_frameStep);
+		m_params.m_frameStatistic = (FrameStatistic)ClampInt(FrameMinimum, FrameMaximum, frameStatistic);
+
+		// Identical shells at the current frame can still deform differently
+		m_params.m_isShellCache = false;
+	}
+
+	if (getArgValue(argData, "-cor", "-colourRatio", m_params.m_colourRatio))
+	{
+		m_params.m_isColour = true;
+		m_params.m_colourRatio = ClampDouble(0.0, DBL_MAX, m_params.m_colourRatio);
+	}
+
 	int opMode = 0;
 	getArgValue(argData, "-op", "-operation", opMode);
 	m_params.m_operationMode = (OperationMode)opMode;
 	
-	if (getArgValue(argData, "-us", "-uvSetName", m_params.m_UVSetName))
+	unsigned int numUVSetNames = argData.numberOfFlagUses("-us");
+	for (unsigned int i = 0; i < numUVSetNames; i++)
+	{
+		MArgList argList;
+		if (argData.getFlagArgumentList("-us", i, argList) == MS::kSuccess)
+		{
+			m_params.m_UVSetNames.append(argList.asString(0));
+		}
+	}
+	if (m_params.m_UVSetNames.length() > 0)
 	{
+		m_params.m_UVSetName = m_params.m_UVSetNames[0];
 		m_params.m_isUVSetOverride = true;
 	}
+	m_params.m_isAllUVSets = argData.isFlagSet("-allUVSets");
 
 	return NULL;
 }
@@ -163,17 +415,46 @@ UVAutoRatioPro::UVAutoRatioPro()
 	m_params.m_isFallback = false;
 	m_params.m_skipScaling = false;
 	m_params.m_isUVSetOverride = false;
+	m_params.m_isAllUVSets = false;
 	m_params.m_operationMode = ObjectLevel;
 	m_params.m_layoutShells = false;
 	m_params.m_layoutIterations = 10000;
 	m_params.m_scalingAxis = Both;
 	m_params.m_isColour = false;
+	m_params.m_colourRatio = 0.0;
 	m_params.m_layoutStep = 0.001;
+	m_params.m_layoutSeed = 0;
+	m_params.m_layoutScope = LayoutGlobal;
+	m_params.m_isLayoutWarmStart = false;
+	m_params.m_isLayoutClearWarmStart = false;
+	m_params.m_layoutMethod = LayoutSprings;
+	m_params.m_layoutPackResolution = 512;
+	m_params.m_isLayoutFitTile = false;
+	m_params.m_layoutUdim = UdimNone;
+	m_params.m_layoutUdimTiles = 0;
+	m_params.m_layoutUdimBudget = 0.5;
 	m_params.m_layoutMinDistance = 0.0;
+	m_params.m_layoutShapes = false;
 	m_params.m_normalise = false;
 	m_params.m_normaliseKeepAspectRatio = true;
+	m_params.m_isShellCache = true;
+	m_params.m_isFrameRange = false;
+	m_params.m_startFrame = 0.0;
+	m_params.m_endFrame = 0.0;
+	m_params.m_frameStep = 1.0;
+	m_params.m_frameStatistic = FrameMean;
+	m_params.m_streamChunkSize = 0;
+	m_params.m_isMoveUVHistory = false;
+	m_params.m_isBatchApply = false;
+	m_params.m_resultFormat = ResultText;
+	m_params.m_asyncAction = AsyncNone;
+	m_params.m_isBenchmarkKernels = false;
 
 	m_activeProcessor = NULL;
+	m_committedRun = NULL;
+	m_isSolvingInBackground = false;
+	m_totalJobs = 0;
+	m_numResumedBoxes = 0;
 
 	m_loadTime = 0;
 	m_gatherTime = 0;
@@ -214,16 +495,29 @@ UVAutoRatioPro::~UVAutoRatioPro()
 		}
 		m_undos.clear();
 	}
+	m_undoJournal.Clear();
 
-	// Delete all meshes
+	// Delete the layout shapes
 	{
-		std::vector<Mesh*>::reverse_iterator riter;
-		for ( riter = m_meshes.rbegin(); riter != m_meshes.rend(); ++riter )
+		std::vector<UVTriangleBVH*>::reverse_iterator riter;
+		for ( riter = m_layoutShapes.rbegin(); riter != m_layoutShapes.rend(); ++riter )
 		{
 			delete (*riter);
 		}
-		m_meshes.clear();
+		m_layoutShapes.clear();
 	}
+
+	if (m_committedRun)
+	{
+		delete m_committedRun;
+		m_committedRun = NULL;
+	}
+
+	// Release all jobs and meshes
+	m_meshes.clear();
+	m_shellJobPool.Clear();
+	m_meshJobPool.Clear();
+	m_meshPool.Clear();
 }
 
 void*
@@ -235,7 +529,21 @@ UVAutoRatioPro::creator()
 bool
 UVAutoRatioPro::isUndoable() const
 {
-	return true;
+	// The kernel benchmark, and starting, cancelling and querying a background run
+	// don't change the scene, committing it is undone through the run that was committed
+	if (m_params.m_isBenchmarkKernels || m_params.m_isLayoutClearWarmStart)
+		return false;
+
+	switch (m_params.m_asyncAction)
+	{
+	case AsyncNone:
+		return true;
+	case AsyncCommit:
+		return (m_committedRun != NULL);
+	default:
+		break;
+	}
+	return false;
 }
 
 bool
@@ -292,12 +600,19 @@ UVAutoRatioPro::redoIt()
 {
 	MStatus status = MS::kSuccess;
 
+	if (m_committedRun)
+	{
+		return m_committedRun->redoIt();
+	}
+
 	std::vector<MDGModifier*>::reverse_iterator riter;
 	for ( riter = m_undos.rbegin(); riter != m_undos.rend(); ++riter )
 	{
 		status=(*riter)->doIt();
 	}
 
+	m_undoJournal.Redo();
+
 	return status;
 }
 
@@ -306,12 +621,19 @@ UVAutoRatioPro::undoIt()
 {
 	MStatus status = MS::kSuccess;
 
+	if (m_committedRun)
+	{
+		return m_committedRun->undoIt();
+	}
+
 	std::vector<MDGModifier*>::reverse_iterator riter;
 	for ( riter = m_undos.rbegin(); riter != m_undos.rend(); ++riter )
 	{
 		status=(*riter)->undoIt();
 	}
 
+	m_undoJournal.Undo();
+
 	return MS::kSuccess;
 }
 
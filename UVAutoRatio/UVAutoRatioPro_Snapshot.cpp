@@ -0,0 +1,185 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "MayaUtility.h"
+#include "Utility.h"
+#include "UVAutoRatioPro.h"
+
+//
+// Gather snapshots
+//
+// -saveSnapshot writes what gather measured to a file, and -loadSnapshot solves,
+// lays out and normalises that data again without reading the scene.  The results
+// aren't applied, instead the scale and offset of every job is returned so
+// parameters can be compared and scenes reproduced without the Maya file.
+//
+
+static const char* error_snapshotSave = "Failed to write the snapshot";
+static const char* error_snapshotOpen = "Failed to open the snapshot, it is missing, damaged or from another version";
+static const char* error_snapshotAxis = "Snapshots can only be replayed when scaling both axes";
+
+MStatus
+UVAutoRatioPro::SaveSnapshot()
+{
+	if (!GatherSnapshot::Save(m_params.m_saveSnapshotPath, m_meshes, m_params.m_operationMode))
+	{
+		displayError(error_snapshotSave);
+		return MS::kFailure;
+	}
+
+	if (m_params.m_isVerbose)
+	{
+		const char* savedMessage = "UVAR: Saved %i meshes and %i jobs to %s";
+#ifdef WIN32
+		sprintf_s(m_text, sizeof(m_text), savedMessage, (int)m_meshes.size(), m_totalJobs, m_params.m_saveSnapshotPath.asChar());
+#else
+		sprintf(m_text,                   savedMessage, (int)m_meshes.size(), m_totalJobs, m_params.m_saveSnapshotPath.asChar());
+#endif
+		OutputText(m_text);
+	}
+	return MS::kSuccess;
+}
+
+// Builds the meshes and jobs from the snapshot, the shell jobs index the mapped file directly
+MStatus
+UVAutoRatioPro::LoadSnapshot()
+{
+	if (!m_snapshot.Open(m_params.m_loadSnapshotPath))
+	{
+		displayError(error_snapshotOpen);
+		return MS::kFailure;
+	}
+
+	m_params.m_operationMode = m_snapshot.GetOperationMode();
+	if (m_params.m_operationMode == UVShellLevel)
+		m_activeProcessor = new ShellProcessor();
+	else
+		m_activeProcessor = new MeshProcessor();
+
+	for (unsigned int i = 0; i < m_snapshot.GetNumMeshes(); i++)
+	{
+		const GatherSnapshot::MeshRecord& meshRecord = m_snapshot.GetMesh(i);
+
+		Mesh* mesh = m_meshPool.Allocate();
+		mesh->name = m_snapshot.GetString(meshRecord.nameOffset, meshRecord.nameLength);
+		mesh->pathName = mesh->name;
+		mesh->requestedUVSetName = m_snapshot.GetString(meshRecord.uvSetNameOffset, meshRecord.uvSetNameLength);
+		mesh->currentUVSetName = mesh->requestedUVSetName;
+		mesh->useUVSetName = mesh->requestedUVSetName;
+		mesh->uvSetGroup = GetUVSetGroup(mesh->requestedUVSetName);
+		mesh->error = (JobError)meshRecord.error;
+		mesh->uArray = MFloatArray(m_snapshot.GetFloats(meshRecord.uOffset), meshRecord.numUVs);
+		mesh->vArray = MFloatArray(m_snapshot.GetFloats(meshRecord.vOffset), meshRecord.numUVs);
+
+		for (unsigned int j = 0; j < meshRecord.numJobs; j++)
+		{
+			const GatherSnapshot::JobRecord& jobRecord = m_snapshot.GetJob(meshRecord.firstJob + j);
+
+			UVJob* job = NULL;
+			if (m_params.m_operationMode == UVShellLevel)
+			{
+				ShellJob* shellJob = m_shellJobPool.Allocate();
+				shellJob->meshShellNumber = jobRecord.meshShellNumber;
+				shellJob->uvIndices = (int*)m_snapshot.GetInts(meshRecord.uvIndexOffset) + jobRecord.firstUVIndex;
+				shellJob->numIndices = (int)jobRecord.numUVIndices;
+				job = shellJob;
+			}
+			else
+			{
+				job = m_meshJobPool.Allocate();
+			}
+
+			job->mesh = mesh;
+			job->error = (JobError)jobRecord.error;
+			job->surfaceArea = jobRecord.surfaceArea;
+			job->textureArea = jobRecord.textureArea;
+			job->centerU = jobRecord.centerU;
+			job->centerV = jobRecord.centerV;
+			job->uvWidth = jobRecord.uvWidth;
+			job->uvHeight = jobRecord.uvHeight;
+			mesh->m_jobs.push_back(job);
+		}
+
+		m_meshes.push_back(mesh);
+	}
+
+	m_activeProcessor->m_progress = &m_progress;
+	m_activeProcessor->m_undoHistory = &m_undos;
+	m_activeProcessor->m_undoJournal = NULL;
+	m_activeProcessor->m_params = m_params;
+	return MS::kSuccess;
+}
+
+// Solves the snapshot with this command's parameters and returns
+// scaleU, scaleV, offsetU and offsetV for every job in the snapshot's order
+MStatus
+UVAutoRatioPro::ReplaySnapshot()
+{
+	MStatus status;
+
+	// The iterative solvers and the layout shapes read the mesh from the scene
+	if (m_params.m_scalingAxis != Both)
+	{
+		displayError(error_snapshotAxis);
+		return MS::kFailure;
+	}
+	m_params.m_layoutShapes = false;
+
+	m_masterTimer.reset();
+	m_timer.reset();
+	status = LoadSnapshot();
+	m_loadTime = m_timer.getTime();
+	if (status != MS::kSuccess)
+		return status;
+
+	CountJobs();
+
+	if (!m_params.m_skipScaling)
+	{
+		FindScales(0, (uint)m_meshes.size());
+	}
+	if (m_params.m_layoutShells)
+	{
+		// The snapshot has no shading groups, each mesh gets its own tile instead
+		if (m_params.m_layoutUdim == UdimByMaterial)
+		{
+			GatherUdimMaterials();
+		}
+		LayoutShells();
+	}
+	if (m_params.m_normalise)
+	{
+		Normalise();
+	}
+	m_totalTime = m_masterTimer.getTime();
+
+	MDoubleArray results;
+	for (uint i = 0; i < m_meshes.size(); i++)
+	{
+		Mesh& mesh = *m_meshes[i];
+		for (uint j = 0; j < mesh.m_jobs.size(); j++)
+		{
+			UVJob& job = *mesh.m_jobs[j];
+			results.append(job.finalScaleX);
+			results.append(job.finalScaleY);
+			results.append(job.offsetU);
+			results.append(job.offsetV);
+		}
+	}
+
+	// -resultFormat array replaces the scales and offsets
+	setResult(results);
+	OutputResults();
+	return MS::kSuccess;
+}
@@ -0,0 +1,874 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+
+#include "MayaPCH.h"
+#include <algorithm>
+#include "MayaUtility.h"
+#include "ThreadUtility.h"
+#include "UVTriangleBVH.h"
+#include "UVBitmapPacker.h"
+
+// Shapes rasterised per thread pool task
+static const int ShapeGrainSize = 16;
+
+// Scales tried when fitting to a tile, each halves the range the best scale is in
+static const int FitSearchSteps = 12;
+static const int FitShrinkSteps = 16;
+
+// The search stops once the scales left to try move the largest shape's edge by less than this many cells
+static const double FitCellPrecision = 0.5;
+
+// Base cells across each atlas cell, a finer base mask loses less when it is shrunk.
+// The largest shape is kept to the atlas's width in base cells, large shapes lose little anyway.
+static const int BaseCellsPerCell = 8;
+
+static const PackWord AllBits = ~(PackWord)0;
+
+static void
+SetBit(PackWord* row, int x)
+{
+	row[x >> 6] |= (PackWord)1 << (x & 63);
+}
+
+static bool
+GetBit(const PackWord* row, int x)
+{
+	return (row[x >> 6] & ((PackWord)1 << (x & 63))) != 0;
+}
+
+static int
+CountBits(PackWord bits)
+{
+	int count = 0;
+	while (bits != 0)
+	{
+		bits &= bits - 1;
+		count++;
+	}
+	return count;
+}
+
+static int
+HighestBit(PackWord bits)
+{
+	int index = 63;
+	while ((bits >> 56) == 0)
+	{
+		bits <<= 8;
+		index -= 8;
+	}
+	while ((bits >> 63) == 0)
+	{
+		bits <<= 1;
+		index--;
+	}
+	return index;
+}
+
+// Whether any cell of the row from first to last inclusive is set
+static bool
+AnyBitInRange(const PackWord* row, int first, int last)
+{
+	int firstWord = first >> 6;
+	int lastWord = last >> 6;
+	for (int w = firstWord; w <= lastWord; w++)
+	{
+		PackWord bits = row[w];
+		if (w == lastWord && (last & 63) != 63)
+			bits &= ((PackWord)1 << ((last & 63) + 1)) - 1;
+		if (w == firstWord)
+			bits &= AllBits << (first & 63);
+		if (bits != 0)
+			return true;
+	}
+	return false;
+}
+
+// Whether the mask row, moved right by offset cells, shares a bit with the atlas row.
+// Each mask word straddles at most two atlas words.
+static bool
+RowOverlaps(const PackWord* atlasRow, int atlasWords, const PackWord* maskRow, int maskWords, int offset)
+{
+	int first = offset >> 6;
+	int shift = offset & 63;
+	for (int k = 0; k < maskWords; k++)
+	{
+		PackWord bits = maskRow[k];
+		if (bits == 0)
+			continue;
+
+		if (atlasRow[first + k] & (bits << shift))
+			return true;
+		if (shift != 0 && first + k + 1 < atlasWords && (atlasRow[first + k + 1] & (bits >> (64 - shift))))
+			return true;
+	}
+	return false;
+}
+
+static void
+OrRow(PackWord* atlasRow, int atlasWords, const PackWord* maskRow, int maskWords, int offset)
+{
+	int first = offset >> 6;
+	int shift = offset & 63;
+	for (int k = 0; k < maskWords; k++)
+	{
+		PackWord bits = maskRow[k];
+		if (bits == 0)
+			continue;
+
+		atlasRow[first + k] |= bits << shift;
+		if (shift != 0 && first + k + 1 < atlasWords)
+			atlasRow[first + k + 1] |= bits >> (64 - shift);
+	}
+}
+
+// Largest masks first, the smaller ones then fill the gaps left between them
+struct UVBitmapPacker::LargerShape
+{
+	const std::vector<Shape>* shapes;
+
+	bool operator () (int a, int b) const
+	{
+		const Shape& shapeA = (*shapes)[a];
+		const Shape& shapeB = (*shapes)[b];
+		int areaA = shapeA.maskWidth * shapeA.maskHeight;
+		int areaB = shapeB.maskWidth * shapeB.maskHeight;
+		if (areaA != areaB)
+			return areaA > areaB;
+		return a < b;
+	}
+};
+
+UVBitmapPacker::UVBitmapPacker()
+{
+	m_resolution = 512;
+	m_margin = 0.0;
+	Clear();
+}
+
+void
+UVBitmapPacker::Clear()
+{
+	m_shapes.clear();
+	m_atlas.clear();
+	m_rowFreeCells.clear();
+	m_cellSize = 0.0;
+	m_scale = 1.0;
+	m_baseScale = 1.0;
+	m_baseCellSize = 0.0;
+	m_fittedScale = 0.0;
+	m_fittedUsedWidth = m_fittedUsedHeight = 0;
+	m_dilation = 0;
+	m_atlasWidth = m_atlasWords = m_atlasHeight = 0;
+	m_firstOpenRow = 0;
+	m_usedWidth = m_usedHeight = 0;
+}
+
+void
+UVBitmapPacker::SetResolution(int cellsAcross)
+{
+	m_resolution = std::max(cellsAcross, 16);
+}
+
+void
+UVBitmapPacker::SetMargin(double margin)
+{
+	m_margin = Max(margin, 0.0);
+}
+
+void
+UVBitmapPacker::AddShape(double width, double height, const UVTriangleBVH* shape)
+{
+	Shape s;
+	s.width = width;
+	s.height = height;
+	s.shape = shape;
+	s.maskWidth = s.maskHeight = 0;
+	s.dilatedWidth = s.dilatedHeight = s.dilatedWords = 0;
+	s.cellCount = 0;
+	s.baseWidth = s.baseHeight = 0;
+	s.fittedWidth = s.fittedHeight = 0;
+	s.fittedX = s.fittedY = 0;
+	s.cellX = s.cellY = 0;
+	s.u = s.v = 0.0;
+	m_shapes.push_back(s);
+}
+
+void
+UVBitmapPacker::GetPosition(uint index, double2& position) const
+{
+	position[0] = m_shapes[index].u;
+	position[1] = m_shapes[index].v;
+}
+
+void
+UVBitmapPacker::GetPackedSize(double& width, double& height) const
+{
+	width = m_usedWidth * m_cellSize;
+	height = m_usedHeight * m_cellSize;
+}
+
+void
+UVBitmapPacker::Pack(double originU, double originV)
+{
+	size_t numShapes = m_shapes.size();
+	if (numShapes == 0)
+		return;
+
+	// The atlas is as wide as a square holding the boxes, or the widest box
+	double totalArea = 0.0;
+	double maxWidth = 0.0;
+	size_t i = 0;
+	for (i = 0; i < numShapes; i++)
+	{
+		const Shape& s = m_shapes[i];
+		totalArea += (s.width + m_margin) * (s.height + m_margin);
+		maxWidth = Max(maxWidth, s.width + 2.0 * m_margin);
+	}
+	double atlasSize = Max(sqrt(totalArea), maxWidth);
+	if (atlasSize <= 0.0)
+	{
+		for (i = 0; i < numShapes; i++)
+		{
+			m_shapes[i].u = originU;
+			m_shapes[i].v = originV;
+		}
+		return;
+	}
+
+	m_scale = 1.0;
+	m_cellSize = atlasSize / m_resolution;
+	PackCells(originU, originV, false);
+}
+
+// The shapes are rasterised once at the largest scale, each smaller scale tried only shrinks
+// those masks, and a trial whose masks match the last fit reuses its placements unpacked
+double
+UVBitmapPacker::FitToTile(double originU, double originV, double tileSize)
+{
+	size_t numShapes = m_shapes.size();
+	if (numShapes == 0 || tileSize <= 0.0)
+		return 0.0;
+
+	// The shapes can't cover more than the tile, and none can be wider or taller than it
+	double high = DBL_MAX;
+	double maxSize = 0.0;
+	double area = GetShapesArea();
+	if (area > 0.0)
+	{
+		high = sqrt(tileSize * tileSize / area);
+	}
+	for (size_t i = 0; i < numShapes; i++)
+	{
+		const Shape& s = m_shapes[i];
+		if (s.width > 0.0)
+			high = Min(high, (tileSize - 2.0 * m_margin) / s.width);
+		if (s.height > 0.0)
+			high = Min(high, (tileSize - 2.0 * m_margin) / s.height);
+		maxSize = Max(maxSize, Max(s.width, s.height));
+	}
+	if (high <= 0.0 || high == DBL_MAX)
+		return 0.0;
+
+	m_cellSize = tileSize / m_resolution;
+	m_dilation = (int)ceil(m_margin / m_cellSize);
+	m_fittedScale = 0.0;
+
+	m_baseScale = high;
+	m_baseCellSize = Max(m_cellSize / BaseCellsPerCell, maxSize * high / m_resolution);
+	m_scale = high;
+	ParallelFor((int)numShapes, ShapeGrainSize, RasteriseBaseRange, this);
+
+	// Shrink until the shapes fit, then search between the scale that fits and the one that didn't
+	double low = high;
+	bool isFitting = PackScale(originU, originV, high);
+	for (int i = 0; i < FitShrinkSteps && !isFitting; i++)
+	{
+		high = low;
+		low *= 0.5;
+		isFitting = PackScale(originU, originV, low);
+	}
+
+	if (isFitting && low != m_baseScale)
+	{
+		double maxCells = maxSize / m_cellSize;
+		for (int i = 0; i < FitSearchSteps && (high - low) * maxCells > FitCellPrecision; i++)
+		{
+			double scale = 0.5 * (low + high);
+			if (PackScale(originU, originV, scale))
+				low = scale;
+			else
+				high = scale;
+		}
+	}
+
+	// Leave the shapes where they were placed at the best scale found
+	if (isFitting)
+	{
+		m_scale = m_fittedScale;
+		m_usedWidth = m_fittedUsedWidth;
+		m_usedHeight = m_fittedUsedHeight;
+		for (size_t i = 0; i < numShapes; i++)
+		{
+			Shape& s = m_shapes[i];
+			s.u = originU + (s.fittedX + m_dilation) * m_cellSize + s.width * m_scale * 0.5;
+			s.v = originV + (s.fittedY + m_dilation) * m_cellSize + s.height * m_scale * 0.5;
+		}
+	}
+
+	for (size_t i = 0; i < numShapes; i++)
+	{
+		std::vector<PackWord> empty;
+		m_shapes[i].baseMask.swap(empty);
+		std::vector<PackWord> emptyFitted;
+		m_shapes[i].fittedMask.swap(emptyFitted);
+	}
+	return isFitting ? m_fittedScale : 0.0;
+}
+
+// One trial of FitToTile, the base masks shrunk to the scale and packed into the tile
+bool
+UVBitmapPacker::PackScale(double originU, double originV, double scale)
+{
+	m_scale = scale;
+	ParallelFor((int)m_shapes.size(), ShapeGrainSize, ShrinkRange, this);
+
+	if (m_fittedScale > 0.0 && IsFittedMask())
+	{
+		m_fittedScale = scale;
+		return true;
+	}
+
+	if (!PlaceShapes(originU, originV, true))
+		return false;
+
+	KeepFitted();
+	return true;
+}
+
+void
+UVBitmapPacker::KeepFitted()
+{
+	m_fittedScale = m_scale;
+	m_fittedUsedWidth = m_usedWidth;
+	m_fittedUsedHeight = m_usedHeight;
+	for (size_t i = 0; i < m_shapes.size(); i++)
+	{
+		Shape& s = m_shapes[i];
+		s.fittedWidth = s.maskWidth;
+		s.fittedHeight = s.maskHeight;
+		s.fittedX = s.cellX;
+		s.fittedY = s.cellY;
+		s.fittedMask.swap(s.mask);
+	}
+}
+
+bool
+UVBitmapPacker::IsFittedMask() const
+{
+	for (size_t i = 0; i < m_shapes.size(); i++)
+	{
+		const Shape& s = m_shapes[i];
+		if (s.maskWidth != s.fittedWidth || s.maskHeight != s.fittedHeight || s.mask != s.fittedMask)
+			return false;
+	}
+	return true;
+}
+
+bool
+UVBitmapPacker::PackToTile(double originU, double originV, double tileSize, double scale)
+{
+	if (m_shapes.empty() || tileSize <= 0.0 || scale <= 0.0)
+		return false;
+
+	m_cellSize = tileSize / m_resolution;
+	m_scale = scale;
+	return PackCells(originU, originV, true);
+}
+
+double
+UVBitmapPacker::GetShapesArea() const
+{
+	double area = 0.0;
+	for (size_t i = 0; i < m_shapes.size(); i++)
+	{
+		const Shape& s = m_shapes[i];
+		if (s.shape == NULL || s.shape->IsEmpty())
+		{
+			area += s.width * s.height;
+			continue;
+		}
+
+		int numTriangles = s.shape->GetNumTriangles();
+		for (int t = 0; t < numTriangles; t++)
+		{
+			double u[3], v[3];
+			s.shape->GetTriangle(t, u, v);
+			area += 0.5 * fabs((u[1] - u[0]) * (v[2] - v[0]) - (u[2] - u[0]) * (v[1] - v[0]));
+		}
+	}
+	return area;
+}
+
+// Places the shapes at the current scale and cell size.  A bounded atlas is a square of
+// m_resolution cells, and this returns false at the first shape that doesn't fit in it.
+bool
+UVBitmapPacker::PackCells(double originU, double originV, bool isBounded)
+{
+	m_dilation = (int)ceil(m_margin / m_cellSize);
+
+	ParallelFor((int)m_shapes.size(), ShapeGrainSize, RasteriseRange, this);
+
+	return PlaceShapes(originU, originV, isBounded);
+}
+
+// Places the masks already rasterised and dilated for the current scale
+bool
+UVBitmapPacker::PlaceShapes(double originU, double originV, bool isBounded)
+{
+	size_t numShapes = m_shapes.size();
+	size_t i = 0;
+
+	m_atlasWidth = m_resolution;
+	for (i = 0; i < numShapes; i++)
+	{
+		if (isBounded && (m_shapes[i].dilatedWidth > m_resolution || m_shapes[i].dilatedHeight > m_resolution))
+			return false;
+
+		m_atlasWidth = std::max(m_atlasWidth, m_shapes[i].dilatedWidth);
+	}
+	m_atlasWords = (m_atlasWidth + 63) / 64;
+	m_atlas.clear();
+	m_rowFreeCells.clear();
+	m_atlasHeight = 0;
+	m_firstOpenRow = 0;
+	m_usedWidth = m_usedHeight = 0;
+	AddAtlasRows(m_atlasWidth);
+
+	std::vector<int> order(numShapes);
+	for (i = 0; i < numShapes; i++)
+	{
+		order[i] = (int)i;
+	}
+	LargerShape larger;
+	larger.shapes = &m_shapes;
+	std::sort(order.begin(), order.end(), larger);
+
+	// A bounded atlas gives up as soon as the shapes left have more cells than it has free
+	int cellsLeft = 0;
+	int freeCells = m_atlasWidth * m_atlasHeight;
+	for (i = 0; i < numShapes; i++)
+	{
+		cellsLeft += m_shapes[i].cellCount;
+	}
+
+	for (i = 0; i < numShapes; i++)
+	{
+		Shape& s = m_shapes[order[i]];
+		if (isBounded && cellsLeft > freeCells)
+			return false;
+		cellsLeft -= s.cellCount;
+		freeCells -= s.cellCount;
+
+		bool isPlaced = false;
+		for (int y = m_firstOpenRow; !isPlaced; y++)
+		{
+			if (y + s.dilatedHeight > m_atlasHeight)
+			{
+				if (isBounded)
+					return false;
+
+				AddAtlasRows(std::max(s.dilatedHeight, m_atlasHeight));
+			}
+
+			if (!HasFreeCells(s, y))
+				continue;
+
+			int nextX = 0;
+			for (int x = 0; x + s.dilatedWidth <= m_atlasWidth; x = nextX)
+			{
+				if (Fits(s, x, y, nextX))
+				{
+					Place(s, x, y);
+					s.cellX = x;
+					s.cellY = y;
+					s.u = originU + (x + m_dilation) * m_cellSize + s.width * m_scale * 0.5;
+					s.v = originV + (y + m_dilation) * m_cellSize + s.height * m_scale * 0.5;
+					isPlaced = true;
+					break;
+				}
+			}
+		}
+
+		while (m_firstOpenRow < m_atlasHeight && m_rowFreeCells[m_firstOpenRow] == 0)
+		{
+			m_firstOpenRow++;
+		}
+	}
+	return true;
+}
+
+void
+UVBitmapPacker::RasteriseRange(void* data, int begin, int end)
+{
+	UVBitmapPacker& packer = *(UVBitmapPacker*)data;
+	for (int i = begin; i < end; i++)
+	{
+		packer.Rasterise(packer.m_shapes[i]);
+		packer.Dilate(packer.m_shapes[i]);
+	}
+}
+
+void
+UVBitmapPacker::RasteriseBaseRange(void* data, int begin, int end)
+{
+	UVBitmapPacker& packer = *(UVBitmapPacker*)data;
+	for (int i = begin; i < end; i++)
+	{
+		Shape& s = packer.m_shapes[i];
+		packer.RasteriseMask(s, packer.m_baseScale, packer.m_baseCellSize, s.baseMask, s.baseWidth, s.baseHeight);
+	}
+}
+
+void
+UVBitmapPacker::ShrinkRange(void* data, int begin, int end)
+{
+	UVBitmapPacker& packer = *(UVBitmapPacker*)data;
+	for (int i = begin; i < end; i++)
+	{
+		packer.Shrink(packer.m_shapes[i]);
+		packer.Dilate(packer.m_shapes[i]);
+	}
+}
+
+void
+UVBitmapPacker::Rasterise(Shape& s) const
+{
+	s.cellCount = RasteriseMask(s, m_scale, m_cellSize, s.mask, s.maskWidth, s.maskHeight);
+}
+
+// Marks every cell a triangle touches, so the mask never misses part of the shell.
+// Returns the number of cells set.
+int
+UVBitmapPacker::RasteriseMask(const Shape& s, double scale, double cellSize, std::vector<PackWord>& mask, int& maskWidth, int& maskHeight) const
+{
+	double width = s.width * scale;
+	double height = s.height * scale;
+	maskWidth = std::max(1, (int)ceil(width / cellSize));
+	maskHeight = std::max(1, (int)ceil(height / cellSize));
+	int maskWords = (maskWidth + 63) / 64;
+	mask.assign(maskWords * maskHeight, 0);
+
+	if (s.shape == NULL || s.shape->IsEmpty())
+	{
+		for (int y = 0; y < maskHeight; y++)
+		{
+			PackWord* row = &mask[y * maskWords];
+			for (int x = 0; x < maskWidth; x++)
+			{
+				SetBit(row, x);
+			}
+		}
+		return maskWidth * maskHeight;
+	}
+
+	int cellCount = 0;
+	double left = -0.5 * width;
+	double bottom = -0.5 * height;
+	int numTriangles = s.shape->GetNumTriangles();
+	for (int t = 0; t < numTriangles; t++)
+	{
+		double u[3], v[3];
+		s.shape->GetTriangle(t, u, v);
+		for (int k = 0; k < 3; k++)
+		{
+			u[k] *= scale;
+			v[k] *= scale;
+		}
+
+		double minU = Min(u[0], Min(u[1], u[2]));
+		double maxU = Max(u[0], Max(u[1], u[2]));
+		double minV = Min(v[0], Min(v[1], v[2]));
+		double maxV = Max(v[0], Max(v[1], v[2]));
+		int firstX = std::max(0, (int)floor((minU - left) / cellSize));
+		int lastX = std::min(maskWidth - 1, (int)floor((maxU - left) / cellSize));
+		int firstY = std::max(0, (int)floor((minV - bottom) / cellSize));
+		int lastY = std::min(maskHeight - 1, (int)floor((maxV - bottom) / cellSize));
+
+		for (int y = firstY; y <= lastY; y++)
+		{
+			PackWord* row = &mask[y * maskWords];
+			double cellMinV = bottom + y * cellSize;
+			for (int x = firstX; x <= lastX; x++)
+			{
+				double cellMinU = left + x * cellSize;
+				if (!GetBit(row, x) && TriangleOverlapsCell(u, v, cellMinU, cellMinV, cellMinU + cellSize, cellMinV + cellSize))
+				{
+					SetBit(row, x);
+					cellCount++;
+				}
+			}
+		}
+	}
+	return cellCount;
+}
+
+// Maps the base mask onto the cells of the current scale, which are factor base cells across.
+// A cell is set if any base cell it overlaps is, so the mask still covers the whole shell.
+void
+UVBitmapPacker::Shrink(Shape& s) const
+{
+	double factor = (m_cellSize / m_baseCellSize) * (m_baseScale / m_scale);
+	s.maskWidth = std::max(1, (int)ceil(s.width * m_scale / m_cellSize));
+	s.maskHeight = std::max(1, (int)ceil(s.height * m_scale / m_cellSize));
+	int maskWords = (s.maskWidth + 63) / 64;
+	int baseWords = (s.baseWidth + 63) / 64;
+	s.mask.assign(maskWords * s.maskHeight, 0);
+	s.cellCount = 0;
+
+	// The base rows under each row of cells are merged first, then each cell tests its span
+	std::vector<PackWord> rowBits(baseWords);
+	for (int y = 0; y < s.maskHeight; y++)
+	{
+		int firstRow = (int)floor(y * factor);
+		int lastRow = std::min(s.baseHeight - 1, (int)ceil((y + 1) * factor) - 1);
+		if (firstRow > lastRow)
+			continue;
+
+		std::fill(rowBits.begin(), rowBits.end(), 0);
+		for (int r = firstRow; r <= lastRow; r++)
+		{
+			const PackWord* baseRow = &s.baseMask[r * baseWords];
+			for (int w = 0; w < baseWords; w++)
+			{
+				rowBits[w] |= baseRow[w];
+			}
+		}
+
+		PackWord* row = &s.mask[y * maskWords];
+		for (int x = 0; x < s.maskWidth; x++)
+		{
+			int first = (int)floor(x * factor);
+			int last = std::min(s.baseWidth - 1, (int)ceil((x + 1) * factor) - 1);
+			if (first <= last && AnyBitInRange(&rowBits[0], first, last))
+			{
+				SetBit(row, x);
+				s.cellCount++;
+			}
+		}
+	}
+}
+
+// Grows the mask by the margin in every direction, along the rows a cell at a time,
+// then down the columns a whole word at a time
+void
+UVBitmapPacker::Dilate(Shape& s) const
+{
+	int d = m_dilation;
+	int maskWords = (s.maskWidth + 63) / 64;
+	s.dilatedWidth = s.maskWidth + 2 * d;
+	s.dilatedHeight = s.maskHeight + 2 * d;
+	s.dilatedWords = (s.dilatedWidth + 63) / 64;
+
+	if (d == 0)
+	{
+		s.dilated = s.mask;
+		FindRowRuns(s);
+		return;
+	}
+
+	std::vector<PackWord> wide(s.dilatedWords * s.maskHeight, 0);
+	int y = 0;
+	for (y = 0; y < s.maskHeight; y++)
+	{
+		const PackWord* row = &s.mask[y * maskWords];
+		PackWord* wideRow = &wide[y * s.dilatedWords];
+		for (int x = 0; x < s.maskWidth; x++)
+		{
+			if (GetBit(row, x))
+			{
+				// The cell at x is at x + d in the dilated mask, so it covers x to x + 2d
+				for (int k = 0; k <= 2 * d; k++)
+				{
+					SetBit(wideRow, x + k);
+				}
+			}
+		}
+	}
+
+	s.dilated.assign(s.dilatedWords * s.dilatedHeight, 0);
+	for (y = 0; y < s.maskHeight; y++)
+	{
+		const PackWord* wideRow = &wide[y * s.dilatedWords];
+		for (int k = 0; k <= 2 * d; k++)
+		{
+			PackWord* row = &s.dilated[(y + k) * s.dilatedWords];
+			for (int w = 0; w < s.dilatedWords; w++)
+			{
+				row[w] |= wideRow[w];
+			}
+		}
+	}
+	FindRowRuns(s);
+}
+
+void
+UVBitmapPacker::FindRowRuns(Shape& s)
+{
+	s.dilatedRunStarts.assign(s.dilatedHeight, 0);
+	s.dilatedRunEnds.assign(s.dilatedHeight, -1);
+	s.dilatedRowCells.assign(s.dilatedHeight, 0);
+	for (int y = 0; y < s.dilatedHeight; y++)
+	{
+		const PackWord* row = &s.dilated[y * s.dilatedWords];
+		int runStart = -1;
+		for (int x = 0; x <= s.dilatedWidth; x++)
+		{
+			bool isSet = (x < s.dilatedWidth && GetBit(row, x));
+			if (isSet)
+			{
+				s.dilatedRowCells[y]++;
+				if (runStart < 0)
+					runStart = x;
+			}
+			else if (runStart >= 0)
+			{
+				if (x - runStart > s.dilatedRunEnds[y] - s.dilatedRunStarts[y] + 1)
+				{
+					s.dilatedRunStarts[y] = runStart;
+					s.dilatedRunEnds[y] = x - 1;
+				}
+				runStart = -1;
+			}
+		}
+	}
+}
+
+// The dilated mask at x, y against the atlas, which only holds the undilated masks.
+// When it doesn't fit, nextX skips the positions where the longest run of the row
+// that collided would still cover a taken cell.
+bool
+UVBitmapPacker::Fits(const Shape& s, int x, int y, int& nextX) const
+{
+	nextX = x + 1;
+	for (int r = 0; r < s.dilatedHeight; r++)
+	{
+		if (RowOverlaps(&m_atlas[(y + r) * m_atlasWords], m_atlasWords, &s.dilated[r * s.dilatedWords], s.dilatedWords, x))
+		{
+			int runStart = s.dilatedRunStarts[r];
+			int taken = FindLastTakenCell(y + r, x + runStart, x + s.dilatedRunEnds[r]);
+			nextX = std::max(nextX, taken - runStart + 1);
+			return false;
+		}
+	}
+	return true;
+}
+
+// The last taken cell of the row from first to last inclusive, or -1 if they're all free
+int
+UVBitmapPacker::FindLastTakenCell(int y, int first, int last) const
+{
+	const PackWord* row = &m_atlas[y * m_atlasWords];
+	int firstWord = first >> 6;
+	for (int w = last >> 6; w >= firstWord; w--)
+	{
+		PackWord bits = row[w];
+		if (w == (last >> 6) && (last & 63) != 63)
+			bits &= ((PackWord)1 << ((last & 63) + 1)) - 1;
+		if (w == firstWord)
+			bits &= AllBits << (first & 63);
+		if (bits != 0)
+			return w * 64 + HighestBit(bits);
+	}
+	return -1;
+}
+
+void
+UVBitmapPacker::Place(const Shape& s, int x, int y)
+{
+	int maskWords = (s.maskWidth + 63) / 64;
+	int left = x + m_dilation;
+	int bottom = y + m_dilation;
+	for (int r = 0; r < s.maskHeight; r++)
+	{
+		PackWord* row = &m_atlas[(bottom + r) * m_atlasWords];
+		OrRow(row, m_atlasWords, &s.mask[r * maskWords], maskWords, left);
+
+		int usedCells = 0;
+		for (int w = 0; w < m_atlasWords; w++)
+		{
+			usedCells += CountBits(row[w]);
+		}
+		m_rowFreeCells[bottom + r] = m_atlasWidth - usedCells;
+	}
+	m_usedWidth = std::max(m_usedWidth, left + s.maskWidth);
+	m_usedHeight = std::max(m_usedHeight, bottom + s.maskHeight);
+}
+
+void
+UVBitmapPacker::AddAtlasRows(int numRows)
+{
+	m_atlasHeight += numRows;
+	m_atlas.resize(m_atlasHeight * m_atlasWords, 0);
+	m_rowFreeCells.resize(m_atlasHeight, m_atlasWidth);
+}
+
+// A row of the atlas with fewer free cells than the mask row over it can't take the shape anywhere
+bool
+UVBitmapPacker::HasFreeCells(const Shape& s, int y) const
+{
+	for (int r = 0; r < s.dilatedHeight; r++)
+	{
+		if (m_rowFreeCells[y + r] < s.dilatedRowCells[r])
+			return false;
+	}
+	return true;
+}
+
+// Separating axis test against the cell's axes and the triangle's edge normals
+bool
+UVBitmapPacker::TriangleOverlapsCell(const double u[3], const double v[3], double minU, double minV, double maxU, double maxV)
+{
+	if (Max(u[0], Max(u[1], u[2])) < minU || Min(u[0], Min(u[1], u[2])) > maxU)
+		return false;
+	if (Max(v[0], Max(v[1], v[2])) < minV || Min(v[0], Min(v[1], v[2])) > maxV)
+		return false;
+
+	double cornerU[4] = { minU, maxU, maxU, minU };
+	double cornerV[4] = { minV, minV, maxV, maxV };
+	for (int e = 0; e < 3; e++)
+	{
+		int next = (e + 1) % 3;
+		double normalU = v[e] - v[next];
+		double normalV = u[next] - u[e];
+
+		double edge = normalU * u[e] + normalV * v[e];
+		double opposite = normalU * u[(e + 2) % 3] + normalV * v[(e + 2) % 3];
+		double triangleMin = Min(edge, opposite);
+		double triangleMax = Max(edge, opposite);
+
+		double cellMin = normalU * cornerU[0] + normalV * cornerV[0];
+		double cellMax = cellMin;
+		for (int k = 1; k < 4; k++)
+		{
+			double d = normalU * cornerU[k] + normalV * cornerV[k];
+			cellMin = Min(cellMin, d);
+			cellMax = Max(cellMax, d);
+		}
+
+		if (cellMax < triangleMin || cellMin > triangleMax)
+			return false;
+	}
+	return true;
+}
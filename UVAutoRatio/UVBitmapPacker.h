@@ -0,0 +1,141 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+
+#ifndef UVBITMAPPACKER_H
+#define UVBITMAPPACKER_H
+
+#include <vector>
+
+class UVTriangleBVH;
+
+#ifdef WIN32
+typedef unsigned __int64 PackWord;
+#else
+typedef unsigned long long PackWord;
+#endif
+
+// Packs shells by their rasterised triangles instead of their bounding boxes.
+// Each shell becomes a bit mask on a grid of square cells, 64 cells to a word.
+// Shells are placed largest first at the lowest, then leftmost, spot where their
+// mask doesn't share a bit with the atlas, so L-shaped and diagonal shells nest.
+class UVBitmapPacker
+{
+public:
+	UVBitmapPacker();
+
+	void	Clear();
+
+	// Width of the atlas in cells, more cells fit the shells closer but take longer
+	void	SetResolution(int cellsAcross);
+
+	// Masks are dilated by this so packed shells are at least this far apart
+	void	SetMargin(double margin);
+
+	// The shape's triangles are relative to the box center, or NULL to pack the box
+	void	AddShape(double width, double height, const UVTriangleBVH* shape);
+
+	// Places every shape with the atlas's lower left corner at the origin
+	void	Pack(double originU, double originV);
+
+	// Finds the largest scale of the shapes that packs them into the square tile, and leaves
+	// them packed at it.  Returns 0 if they don't fit even when tiny, as the margin won't scale.
+	double	FitToTile(double originU, double originV, double tileSize);
+
+	// Packs the shapes at a fixed scale into the square tile, returns false if they don't all fit
+	bool	PackToTile(double originU, double originV, double tileSize, double scale);
+
+	// Area of the shapes' triangles, or of their boxes when they have none, before scaling
+	double	GetShapesArea() const;
+
+	void	GetPosition(uint index, double2& position) const;
+	void	GetPackedSize(double& width, double& height) const;
+
+private:
+	struct Shape
+	{
+		double	width, height;
+		const UVTriangleBVH* shape;
+
+		// The mask covers the shape, the dilated mask adds the margin all round
+		int		maskWidth, maskHeight;
+		int		dilatedWidth, dilatedHeight, dilatedWords;
+		int		cellCount;
+		std::vector<PackWord>	mask;
+		std::vector<PackWord>	dilated;
+
+		// Longest run of set cells in each dilated row, used to skip past the positions
+		// where the run would still cover a taken atlas cell
+		std::vector<int>		dilatedRunStarts;
+		std::vector<int>		dilatedRunEnds;
+
+		// Set cells of each dilated row, rows of the atlas with fewer free cells are skipped
+		std::vector<int>		dilatedRowCells;
+
+		// FitToTile rasterises the shape once, on finer cells at the largest scale it tries,
+		// and shrinks that mask onto the cells of each smaller scale
+		int		baseWidth, baseHeight;
+		std::vector<PackWord>	baseMask;
+
+		// The mask and cell of the last scale that fitted, a smaller scale with the same mask fits there too
+		int		fittedWidth, fittedHeight;
+		int		fittedX, fittedY;
+		std::vector<PackWord>	fittedMask;
+
+		int		cellX, cellY;
+		double	u, v;
+	};
+
+	struct LargerShape;
+
+	bool	PackCells(double originU, double originV, bool isBounded);
+	bool	PackScale(double originU, double originV, double scale);
+	bool	PlaceShapes(double originU, double originV, bool isBounded);
+	void	KeepFitted();
+	bool	IsFittedMask() const;
+	void	Rasterise(Shape& shape) const;
+	int		RasteriseMask(const Shape& shape, double scale, double cellSize, std::vector<PackWord>& mask, int& maskWidth, int& maskHeight) const;
+	void	Shrink(Shape& shape) const;
+	void	Dilate(Shape& shape) const;
+	bool	Fits(const Shape& shape, int x, int y, int& nextX) const;
+	int		FindLastTakenCell(int y, int first, int last) const;
+	void	Place(const Shape& shape, int x, int y);
+	void	AddAtlasRows(int numRows);
+	bool	HasFreeCells(const Shape& shape, int y) const;
+
+	static void		FindRowRuns(Shape& shape);
+	static void		RasteriseRange(void* data, int begin, int end);
+	static void		RasteriseBaseRange(void* data, int begin, int end);
+	static void		ShrinkRange(void* data, int begin, int end);
+	static bool		TriangleOverlapsCell(const double u[3], const double v[3], double minU, double minV, double maxU, double maxV);
+
+	std::vector<Shape>		m_shapes;
+	int						m_resolution;
+	double					m_margin;
+	double					m_cellSize;
+	double					m_scale;
+	double					m_baseScale;
+	double					m_baseCellSize;
+	double					m_fittedScale;
+	int						m_fittedUsedWidth, m_fittedUsedHeight;
+	int						m_dilation;
+
+	// Rows of m_atlasWords words, bit x of a row is cell x
+	std::vector<PackWord>	m_atlas;
+	int						m_atlasWidth, m_atlasWords, m_atlasHeight;
+	int						m_firstOpenRow;
+	std::vector<int>		m_rowFreeCells;
+	int						m_usedWidth, m_usedHeight;
+};
+
+#endif
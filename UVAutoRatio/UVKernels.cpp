@@ -0,0 +1,1050 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include <algorithm>
+#include <string.h>
+#include "Timer.h"
+#include "UVKernels.h"
+
+// Which variants the compiler can build.  Visual Studio accepts any instruction
+// set's intrinsics in any function, GCC and Clang need each function marked
+// with the instruction set it uses so the rest of the plugin isn't built for it.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define UVAR_SSE2 1
+#if _MSC_VER >= 1700
+#include <immintrin.h>
+#define UVAR_AVX2 1
+#else
+#define UVAR_AVX2 0
+#endif
+#if _MSC_VER >= 1911
+#define UVAR_AVX512 1
+#else
+#define UVAR_AVX512 0
+#endif
+#define UVAR_TARGET(x)
+#elif (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define UVAR_SSE2 1
+#define UVAR_AVX2 1
+#define UVAR_AVX512 1
+#define UVAR_TARGET(x) __attribute__((target(x)))
+// Every level has to give the scalar kernels' results bit for bit, so a multiply
+// and an add can't be fused, a fused multiply add rounds once instead of twice.
+// GCC fuses them by default wherever the target has FMA, and avx512f implies it,
+// so contraction is turned off for the whole file.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#else
+#pragma GCC optimize("fp-contract=off")
+#endif
+#else
+#define UVAR_SSE2 0
+#define UVAR_AVX2 0
+#define UVAR_AVX512 0
+#endif
+
+typedef void	(*MinMaxFunc)(const float*, int, float&, float&);
+typedef void	(*MinMaxIndexedFunc)(const float*, const int*, int, float&, float&);
+typedef void	(*ScaleFunc)(float*, int, float);
+typedef void	(*ScaleIndexedFunc)(float*, const int*, int, float);
+typedef void	(*TransformFunc)(float*, int, double, double, double);
+typedef void	(*TransformIndexedFunc)(float*, const int*, int, double, double, double);
+typedef double	(*SumTriangleAreasFunc)(const float*, const float*, const int*, int);
+
+// The variant of each kernel used at one level, a level without its own
+// variant of a kernel uses the one from the level below.  The indexed kernels
+// only have variants from the level with gathers (and scatters for the ones
+// that write), before that loading the lanes one at a time is slower than scalar.
+struct KernelTable
+{
+	MinMaxFunc				minMax;
+	MinMaxIndexedFunc		minMaxIndexed;
+	ScaleFunc				scale;
+	ScaleIndexedFunc		scaleIndexed;
+	TransformFunc			transform;
+	TransformIndexedFunc	transformIndexed;
+	SumTriangleAreasFunc	sumTriangleAreas;
+};
+
+static const char* KernelLevelNames[NumKernelLevels] = { "scalar", "sse2", "avx2", "avx512" };
+
+//-----------------------------------------------------------------------------
+// Scalar
+//-----------------------------------------------------------------------------
+
+inline void
+MinMaxValue(float value, float& low, float& high)
+{
+	if (value < low)
+		low = value;
+	if (high < value)
+		high = value;
+}
+
+// Area of one triangle, the same operations as GetTriangleArea2D
+inline double
+TriangleArea2D(const float* u, const float* v, const int* corners)
+{
+	float u0 = u[corners[0]], u1 = u[corners[1]], u2 = u[corners[2]];
+	float v0 = v[corners[0]], v1 = v[corners[1]], v2 = v[corners[2]];
+	double s = (u1 - u0) * (v2 - v0);
+	double t = (u2 - u0) * (v1 - v0);
+	return fabs((s - t) * 0.5);
+}
+
+// Folds the lanes of vector minimums and maximums into low and high.  A lane
+// that only saw NaNs still holds the starting values, so each side is folded
+// on its own.
+inline void
+FoldLanes(const float* lows, const float* highs, int numLanes, float& low, float& high)
+{
+	for (int k = 0; k < numLanes; k++)
+	{
+		if (lows[k] < low)
+			low = lows[k];
+		if (high < highs[k])
+			high = highs[k];
+	}
+}
+
+static void
+MinMaxScalar(const float* values, int count, float& low, float& high)
+{
+	for (int i = 0; i < count; i++)
+	{
+		MinMaxValue(values[i], low, high);
+	}
+}
+
+static void
+MinMaxIndexedScalar(const float* values, const int* indices, int count, float& low, float& high)
+{
+	for (int i = 0; i < count; i++)
+	{
+		MinMaxValue(values[indices[i]], low, high);
+	}
+}
+
+static void
+ScaleScalar(float* values, int count, float scale)
+{
+	for (int i = 0; i < count; i++)
+	{
+		values[i] *= scale;
+	}
+}
+
+static void
+ScaleIndexedScalar(float* values, const int* indices, int count, float scale)
+{
+	for (int i = 0; i < count; i++)
+	{
+		values[indices[i]] *= scale;
+	}
+}
+
+static void
+TransformScalar(float* values, int count, double center, double scale, double offset)
+{
+	for (int i = 0; i < count; i++)
+	{
+		values[i] = (float)((values[i] - center) * scale + center + offset);
+	}
+}
+
+static void
+TransformIndexedScalar(float* values, const int* indices, int count, double center, double scale, double offset)
+{
+	for (int i = 0; i < count; i++)
+	{
+		float& value = values[indices[i]];
+		value = (float)((value - center) * scale + center + offset);
+	}
+}
+
+static double
+SumTriangleAreasScalar(const float* u, const float* v, const int* corners, int numTriangles)
+{
+	double area = 0.0;
+	for (int i = 0; i < numTriangles; i++)
+	{
+		area += TriangleArea2D(u, v, corners + i * 3);
+	}
+	return area;
+}
+
+//-----------------------------------------------------------------------------
+// SSE2, 4 floats or 2 doubles at a time
+//-----------------------------------------------------------------------------
+
+#if UVAR_SSE2
+
+static UVAR_TARGET("sse2") void
+MinMaxSSE2(const float* values, int count, float& low, float& high)
+{
+	int i = 0;
+	if (count >= 4)
+	{
+		// The value goes first so NaNs are skipped, like MinMaxValue
+		__m128 lo = _mm_set1_ps(low);
+		__m128 hi = _mm_set1_ps(high);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(values + i);
+			lo = _mm_min_ps(x, lo);
+			hi = _mm_max_ps(x, hi);
+		}
+
+		float los[4], his[4];
+		_mm_storeu_ps(los, lo);
+		_mm_storeu_ps(his, hi);
+		FoldLanes(los, his, 4, low, high);
+	}
+	MinMaxScalar(values + i, count - i, low, high);
+}
+
+static UVAR_TARGET("sse2") void
+ScaleSSE2(float* values, int count, float scale)
+{
+	int i = 0;
+	__m128 s = _mm_set1_ps(scale);
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_storeu_ps(values + i, _mm_mul_ps(_mm_loadu_ps(values + i), s));
+	}
+	ScaleScalar(values + i, count - i, scale);
+}
+
+static UVAR_TARGET("sse2") inline __m128d
+TransformLanesSSE2(__m128d x, __m128d center, __m128d scale, __m128d offset)
+{
+	return _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_sub_pd(x, center), scale), center), offset);
+}
+
+static UVAR_TARGET("sse2") void
+TransformSSE2(float* values, int count, double center, double scale, double offset)
+{
+	int i = 0;
+	__m128d c = _mm_set1_pd(center);
+	__m128d s = _mm_set1_pd(scale);
+	__m128d o = _mm_set1_pd(offset);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(values + i);
+		__m128d a = TransformLanesSSE2(_mm_cvtps_pd(x), c, s, o);
+		__m128d b = TransformLanesSSE2(_mm_cvtps_pd(_mm_movehl_ps(x, x)), c, s, o);
+		_mm_storeu_ps(values + i, _mm_movelh_ps(_mm_cvtpd_ps(a), _mm_cvtpd_ps(b)));
+	}
+	TransformScalar(values + i, count - i, center, scale, offset);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// AVX2, 8 floats or 4 doubles at a time.  FMA isn't used, see the contraction
+// pragma at the top.
+//-----------------------------------------------------------------------------
+
+#if UVAR_AVX2
+
+static UVAR_TARGET("avx2") void
+MinMaxAVX2(const float* values, int count, float& low, float& high)
+{
+	int i = 0;
+	if (count >= 8)
+	{
+		__m256 lo = _mm256_set1_ps(low);
+		__m256 hi = _mm256_set1_ps(high);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(values + i);
+			lo = _mm256_min_ps(x, lo);
+			hi = _mm256_max_ps(x, hi);
+		}
+
+		float los[8], his[8];
+		_mm256_storeu_ps(los, lo);
+		_mm256_storeu_ps(his, hi);
+		FoldLanes(los, his, 8, low, high);
+	}
+	MinMaxScalar(values + i, count - i, low, high);
+}
+
+static UVAR_TARGET("avx2") void
+MinMaxIndexedAVX2(const float* values, const int* indices, int count, float& low, float& high)
+{
+	int i = 0;
+	if (count >= 8)
+	{
+		__m256 lo = _mm256_set1_ps(low);
+		__m256 hi = _mm256_set1_ps(high);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i index = _mm256_loadu_si256((const __m256i*)(indices + i));
+			__m256 x = _mm256_i32gather_ps(values, index, 4);
+			lo = _mm256_min_ps(x, lo);
+			hi = _mm256_max_ps(x, hi);
+		}
+
+		float los[8], his[8];
+		_mm256_storeu_ps(los, lo);
+		_mm256_storeu_ps(his, hi);
+		FoldLanes(los, his, 8, low, high);
+	}
+	MinMaxIndexedScalar(values, indices + i, count - i, low, high);
+}
+
+static UVAR_TARGET("avx2") void
+ScaleAVX2(float* values, int count, float scale)
+{
+	int i = 0;
+	__m256 s = _mm256_set1_ps(scale);
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(values + i, _mm256_mul_ps(_mm256_loadu_ps(values + i), s));
+	}
+	ScaleScalar(values + i, count - i, scale);
+}
+
+static UVAR_TARGET("avx2") inline __m256d
+TransformLanesAVX2(__m256d x, __m256d center, __m256d scale, __m256d offset)
+{
+	return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(x, center), scale), center), offset);
+}
+
+static UVAR_TARGET("avx2") void
+TransformAVX2(float* values, int count, double center, double scale, double offset)
+{
+	int i = 0;
+	__m256d c = _mm256_set1_pd(center);
+	__m256d s = _mm256_set1_pd(scale);
+	__m256d o = _mm256_set1_pd(offset);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256d a = TransformLanesAVX2(_mm256_cvtps_pd(_mm_loadu_ps(values + i)), c, s, o);
+		__m256d b = TransformLanesAVX2(_mm256_cvtps_pd(_mm_loadu_ps(values + i + 4)), c, s, o);
+		_mm_storeu_ps(values + i, _mm256_cvtpd_ps(a));
+		_mm_storeu_ps(values + i + 4, _mm256_cvtpd_ps(b));
+	}
+	TransformScalar(values + i, count - i, center, scale, offset);
+}
+
+// Splits the corners of 8 triangles, stored a triangle at a time, into their
+// first, second and third corners.  Each corner's ids fall in different lanes
+// of the three loads, so two blends and a permute put them in order.
+static UVAR_TARGET("avx2") inline void
+LoadCornersAVX2(const int* corners, __m256i& c0, __m256i& c1, __m256i& c2)
+{
+	__m256i a = _mm256_loadu_si256((const __m256i*)corners);
+	__m256i b = _mm256_loadu_si256((const __m256i*)(corners + 8));
+	__m256i c = _mm256_loadu_si256((const __m256i*)(corners + 16));
+	c0 = _mm256_permutevar8x32_epi32(_mm256_blend_epi32(_mm256_blend_epi32(a, b, 0x92), c, 0x24), _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+	c1 = _mm256_permutevar8x32_epi32(_mm256_blend_epi32(_mm256_blend_epi32(a, b, 0x24), c, 0x49), _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+	c2 = _mm256_permutevar8x32_epi32(_mm256_blend_epi32(_mm256_blend_epi32(a, b, 0x49), c, 0x92), _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+}
+
+static UVAR_TARGET("avx2") double
+SumTriangleAreasAVX2(const float* u, const float* v, const int* corners, int numTriangles)
+{
+	int i = 0;
+	double area = 0.0;
+	if (numTriangles >= 8)
+	{
+		__m256d half = _mm256_set1_pd(0.5);
+		__m256d signBit = _mm256_set1_pd(-0.0);
+		__m256d sumA = _mm256_setzero_pd();
+		__m256d sumB = _mm256_setzero_pd();
+		for (; i + 8 <= numTriangles; i += 8)
+		{
+			__m256i c0, c1, c2;
+			LoadCornersAVX2(corners + i * 3, c0, c1, c2);
+			__m256 u0 = _mm256_i32gather_ps(u, c0, 4);
+			__m256 u1 = _mm256_i32gather_ps(u, c1, 4);
+			__m256 u2 = _mm256_i32gather_ps(u, c2, 4);
+			__m256 v0 = _mm256_i32gather_ps(v, c0, 4);
+			__m256 v1 = _mm256_i32gather_ps(v, c1, 4);
+			__m256 v2 = _mm256_i32gather_ps(v, c2, 4);
+
+			__m256 s = _mm256_mul_ps(_mm256_sub_ps(u1, u0), _mm256_sub_ps(v2, v0));
+			__m256 t = _mm256_mul_ps(_mm256_sub_ps(u2, u0), _mm256_sub_ps(v1, v0));
+			__m256d a = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(s)), _mm256_cvtps_pd(_mm256_castps256_ps128(t)));
+			__m256d b = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(s, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(t, 1)));
+			sumA = _mm256_add_pd(sumA, _mm256_andnot_pd(signBit, _mm256_mul_pd(a, half)));
+			sumB = _mm256_add_pd(sumB, _mm256_andnot_pd(signBit, _mm256_mul_pd(b, half)));
+		}
+
+		double sums[4];
+		_mm256_storeu_pd(sums, _mm256_add_pd(sumA, sumB));
+		area = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+	}
+	return area + SumTriangleAreasScalar(u, v, corners + i * 3, numTriangles - i);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// AVX-512, 16 floats or 8 doubles at a time.  Only AVX-512F is used, it's
+// the part every AVX-512 CPU has, and it brings the scatters the indexed
+// kernels need to stay vectorised.
+//-----------------------------------------------------------------------------
+
+#if UVAR_AVX512
+
+static UVAR_TARGET("avx512f") inline __m512d
+TransformLanesAVX512(__m512d x, __m512d center, __m512d scale, __m512d offset)
+{
+	return _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(_mm512_sub_pd(x, center), scale), center), offset);
+}
+
+// The low and high 8 floats of a vector
+static UVAR_TARGET("avx512f") inline __m256
+LowHalfAVX512(__m512 x)
+{
+	return _mm512_castps512_ps256(x);
+}
+
+static UVAR_TARGET("avx512f") inline __m256
+HighHalfAVX512(__m512 x)
+{
+	return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x), 1));
+}
+
+static UVAR_TARGET("avx512f") inline __m512
+CombineHalvesAVX512(__m256 low, __m256 high)
+{
+	return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(low)), _mm256_castps_pd(high), 1));
+}
+
+static UVAR_TARGET("avx512f") void
+FoldMinMaxAVX512(__m512 lo, __m512 hi, float& low, float& high)
+{
+	float los[16], his[16];
+	_mm512_storeu_ps(los, lo);
+	_mm512_storeu_ps(his, hi);
+	FoldLanes(los, his, 16, low, high);
+}
+
+static UVAR_TARGET("avx512f") void
+MinMaxAVX512(const float* values, int count, float& low, float& high)
+{
+	int i = 0;
+	if (count >= 16)
+	{
+		__m512 lo = _mm512_set1_ps(low);
+		__m512 hi = _mm512_set1_ps(high);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512 x = _mm512_loadu_ps(values + i);
+			lo = _mm512_min_ps(x, lo);
+			hi = _mm512_max_ps(x, hi);
+		}
+		FoldMinMaxAVX512(lo, hi, low, high);
+	}
+	MinMaxScalar(values + i, count - i, low, high);
+}
+
+static UVAR_TARGET("avx512f") void
+MinMaxIndexedAVX512(const float* values, const int* indices, int count, float& low, float& high)
+{
+	int i = 0;
+	if (count >= 16)
+	{
+		__m512 lo = _mm512_set1_ps(low);
+		__m512 hi = _mm512_set1_ps(high);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512 x = _mm512_i32gather_ps(_mm512_loadu_si512(indices + i), values, 4);
+			lo = _mm512_min_ps(x, lo);
+			hi = _mm512_max_ps(x, hi);
+		}
+		FoldMinMaxAVX512(lo, hi, low, high);
+	}
+	MinMaxIndexedScalar(values, indices + i, count - i, low, high);
+}
+
+static UVAR_TARGET("avx512f") void
+ScaleAVX512(float* values, int count, float scale)
+{
+	int i = 0;
+	__m512 s = _mm512_set1_ps(scale);
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(values + i, _mm512_mul_ps(_mm512_loadu_ps(values + i), s));
+	}
+	ScaleScalar(values + i, count - i, scale);
+}
+
+static UVAR_TARGET("avx512f") void
+ScaleIndexedAVX512(float* values, const int* indices, int count, float scale)
+{
+	int i = 0;
+	__m512 s = _mm512_set1_ps(scale);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512i index = _mm512_loadu_si512(indices + i);
+		__m512 x = _mm512_i32gather_ps(index, values, 4);
+		_mm512_i32scatter_ps(values, index, _mm512_mul_ps(x, s), 4);
+	}
+	ScaleIndexedScalar(values, indices + i, count - i, scale);
+}
+
+static UVAR_TARGET("avx512f") void
+TransformAVX512(float* values, int count, double center, double scale, double offset)
+{
+	int i = 0;
+	__m512d c = _mm512_set1_pd(center);
+	__m512d s = _mm512_set1_pd(scale);
+	__m512d o = _mm512_set1_pd(offset);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512d a = TransformLanesAVX512(_mm512_cvtps_pd(_mm256_loadu_ps(values + i)), c, s, o);
+		__m512d b = TransformLanesAVX512(_mm512_cvtps_pd(_mm256_loadu_ps(values + i + 8)), c, s, o);
+		_mm256_storeu_ps(values + i, _mm512_cvtpd_ps(a));
+		_mm256_storeu_ps(values + i + 8, _mm512_cvtpd_ps(b));
+	}
+	TransformScalar(values + i, count - i, center, scale, offset);
+}
+
+static UVAR_TARGET("avx512f") void
+TransformIndexedAVX512(float* values, const int* indices, int count, double center, double scale, double offset)
+{
+	int i = 0;
+	__m512d c = _mm512_set1_pd(center);
+	__m512d s = _mm512_set1_pd(scale);
+	__m512d o = _mm512_set1_pd(offset);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512i index = _mm512_loadu_si512(indices + i);
+		__m512 x = _mm512_i32gather_ps(index, values, 4);
+		__m512d a = TransformLanesAVX512(_mm512_cvtps_pd(LowHalfAVX512(x)), c, s, o);
+		__m512d b = TransformLanesAVX512(_mm512_cvtps_pd(HighHalfAVX512(x)), c, s, o);
+		_mm512_i32scatter_ps(values, index, CombineHalvesAVX512(_mm512_cvtpd_ps(a), _mm512_cvtpd_ps(b)), 4);
+	}
+	TransformIndexedScalar(values, indices + i, count - i, center, scale, offset);
+}
+
+// Splits the corners of 16 triangles like LoadCornersAVX2
+static UVAR_TARGET("avx512f") inline void
+LoadCornersAVX512(const int* corners, __m512i& c0, __m512i& c1, __m512i& c2)
+{
+	__m512i a = _mm512_loadu_si512(corners);
+	__m512i b = _mm512_loadu_si512(corners + 16);
+	__m512i c = _mm512_loadu_si512(corners + 32);
+	c0 = _mm512_permutexvar_epi32(_mm512_setr_epi32(0, 3, 6, 9, 12, 15, 2, 5, 8, 11, 14, 1, 4, 7, 10, 13), _mm512_mask_blend_epi32(0x2492, _mm512_mask_blend_epi32(0x4924, a, b), c));
+	c1 = _mm512_permutexvar_epi32(_mm512_setr_epi32(1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2, 5, 8, 11, 14), _mm512_mask_blend_epi32(0x4924, _mm512_mask_blend_epi32(0x9249, a, b), c));
+	c2 = _mm512_permutexvar_epi32(_mm512_setr_epi32(2, 5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15), _mm512_mask_blend_epi32(0x9249, _mm512_mask_blend_epi32(0x2492, a, b), c));
+}
+
+static UVAR_TARGET("avx512f") double
+SumTriangleAreasAVX512(const float* u, const float* v, const int* corners, int numTriangles)
+{
+	int i = 0;
+	double area = 0.0;
+	if (numTriangles >= 16)
+	{
+		__m512i absMask = _mm512_set1_epi64(0x7fffffffffffffffLL);
+		__m512d half = _mm512_set1_pd(0.5);
+		__m512d sumA = _mm512_setzero_pd();
+		__m512d sumB = _mm512_setzero_pd();
+		for (; i + 16 <= numTriangles; i += 16)
+		{
+			__m512i c0, c1, c2;
+			LoadCornersAVX512(corners + i * 3, c0, c1, c2);
+			__m512 u0 = _mm512_i32gather_ps(c0, u, 4);
+			__m512 u1 = _mm512_i32gather_ps(c1, u, 4);
+			__m512 u2 = _mm512_i32gather_ps(c2, u, 4);
+			__m512 v0 = _mm512_i32gather_ps(c0, v, 4);
+			__m512 v1 = _mm512_i32gather_ps(c1, v, 4);
+			__m512 v2 = _mm512_i32gather_ps(c2, v, 4);
+
+			__m512 s = _mm512_mul_ps(_mm512_sub_ps(u1, u0), _mm512_sub_ps(v2, v0));
+			__m512 t = _mm512_mul_ps(_mm512_sub_ps(u2, u0), _mm512_sub_ps(v1, v0));
+			__m512d a = _mm512_sub_pd(_mm512_cvtps_pd(LowHalfAVX512(s)), _mm512_cvtps_pd(LowHalfAVX512(t)));
+			__m512d b = _mm512_sub_pd(_mm512_cvtps_pd(HighHalfAVX512(s)), _mm512_cvtps_pd(HighHalfAVX512(t)));
+
+			// _mm512_abs_pd isn't in every compiler, and the double and/andnot need AVX-512DQ
+			a = _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(_mm512_mul_pd(a, half)), absMask));
+			b = _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(_mm512_mul_pd(b, half)), absMask));
+			sumA = _mm512_add_pd(sumA, a);
+			sumB = _mm512_add_pd(sumB, b);
+		}
+
+		double sums[8];
+		_mm512_storeu_pd(sums, _mm512_add_pd(sumA, sumB));
+		for (int k = 0; k < 8; k++)
+		{
+			area += sums[k];
+		}
+	}
+	return area + SumTriangleAreasScalar(u, v, corners + i * 3, numTriangles - i);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// Dispatch
+//-----------------------------------------------------------------------------
+
+static KernelTable s_tables[NumKernelLevels];
+static const KernelTable* s_kernels = NULL;
+static KernelLevel s_level = KernelScalar;
+static KernelLevel s_supportedLevel = KernelScalar;
+static bool s_isInitialised = false;
+
+// Fills the table of each level from the level below, then its own variants
+static void
+BuildTables()
+{
+	KernelTable& scalar = s_tables[KernelScalar];
+	scalar.minMax = MinMaxScalar;
+	scalar.minMaxIndexed = MinMaxIndexedScalar;
+	scalar.scale = ScaleScalar;
+	scalar.scaleIndexed = ScaleIndexedScalar;
+	scalar.transform = TransformScalar;
+	scalar.transformIndexed = TransformIndexedScalar;
+	scalar.sumTriangleAreas = SumTriangleAreasScalar;
+
+	KernelTable& sse2 = s_tables[KernelSSE2];
+	sse2 = scalar;
+#if UVAR_SSE2
+	sse2.minMax = MinMaxSSE2;
+	sse2.scale = ScaleSSE2;
+	sse2.transform = TransformSSE2;
+#endif
+
+	KernelTable& avx2 = s_tables[KernelAVX2];
+	avx2 = sse2;
+#if UVAR_AVX2
+	avx2.minMax = MinMaxAVX2;
+	avx2.minMaxIndexed = MinMaxIndexedAVX2;
+	avx2.scale = ScaleAVX2;
+	avx2.transform = TransformAVX2;
+	avx2.sumTriangleAreas = SumTriangleAreasAVX2;
+#endif
+
+	KernelTable& avx512 = s_tables[KernelAVX512];
+	avx512 = avx2;
+#if UVAR_AVX512
+	avx512.minMax = MinMaxAVX512;
+	avx512.minMaxIndexed = MinMaxIndexedAVX512;
+	avx512.scale = ScaleAVX512;
+	avx512.scaleIndexed = ScaleIndexedAVX512;
+	avx512.transform = TransformAVX512;
+	avx512.transformIndexed = TransformIndexedAVX512;
+	avx512.sumTriangleAreas = SumTriangleAreasAVX512;
+#endif
+}
+
+#if UVAR_SSE2
+static void
+ReadCPUID(unsigned int leaf, unsigned int subleaf, unsigned int registers[4])
+{
+#if defined(_MSC_VER)
+	int info[4];
+#if _MSC_VER >= 1600
+	__cpuidex(info, (int)leaf, (int)subleaf);
+#else
+	__cpuid(info, (int)leaf);
+#endif
+	for (int i = 0; i < 4; i++)
+	{
+		registers[i] = (unsigned int)info[i];
+	}
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// The register state the operating system saves on a context switch,
+// the wider registers can't be used unless it saves them
+static unsigned int
+ReadXCR0()
+{
+#if defined(_MSC_VER)
+#if _MSC_VER >= 1600
+	return (unsigned int)_xgetbv(0);
+#else
+	return 0;
+#endif
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+#endif
+}
+#endif
+
+// The highest level the CPU and operating system support and this build has variants for
+static KernelLevel
+DetectKernelLevel()
+{
+	KernelLevel level = KernelScalar;
+#if UVAR_SSE2
+	unsigned int registers[4];
+	ReadCPUID(0, 0, registers);
+	unsigned int maxLeaf = registers[0];
+	if (maxLeaf < 1)
+		return level;
+
+	ReadCPUID(1, 0, registers);
+	bool hasSSE2 = (registers[3] & (1u << 26)) != 0;
+	bool hasOSXSave = (registers[2] & (1u << 27)) != 0;
+	bool hasAVX = (registers[2] & (1u << 28)) != 0;
+	if (!hasSSE2)
+		return level;
+	level = KernelSSE2;
+
+	if (!UVAR_AVX2 || !hasOSXSave || !hasAVX || maxLeaf < 7)
+		return level;
+
+	// XMM and YMM state, then the AVX-512 mask and ZMM state as well
+	unsigned int xcr0 = ReadXCR0();
+	if ((xcr0 & 0x6) != 0x6)
+		return level;
+
+	ReadCPUID(7, 0, registers);
+	bool hasAVX2 = (registers[1] & (1u << 5)) != 0;
+	bool hasAVX512F = (registers[1] & (1u << 16)) != 0;
+	if (!hasAVX2)
+		return level;
+	level = KernelAVX2;
+
+	if (UVAR_AVX512 && hasAVX512F && (xcr0 & 0xe6) == 0xe6)
+	{
+		level = KernelAVX512;
+	}
+#endif
+	return level;
+}
+
+KernelLevel
+InitialiseKernels(KernelLevel maxLevel)
+{
+	if (!s_isInitialised)
+	{
+		BuildTables();
+		s_supportedLevel = DetectKernelLevel();
+		s_isInitialised = true;
+	}
+
+	s_level = (maxLevel < s_supportedLevel) ? maxLevel : s_supportedLevel;
+	s_kernels = &s_tables[s_level];
+	return s_level;
+}
+
+KernelLevel
+GetKernelLevel()
+{
+	return s_level;
+}
+
+KernelLevel
+GetSupportedKernelLevel()
+{
+	return s_supportedLevel;
+}
+
+const char*
+GetKernelLevelName(KernelLevel level)
+{
+	if (level < KernelScalar || level >= NumKernelLevels)
+		return "unknown";
+	return KernelLevelNames[level];
+}
+
+// Until the plugin initialises them the scalar kernels are used
+static inline const KernelTable&
+GetKernels()
+{
+	if (s_kernels == NULL)
+	{
+		InitialiseKernels(KernelScalar);
+	}
+	return *s_kernels;
+}
+
+void
+KernelMinMax(const float* values, int count, float& low, float& high)
+{
+	GetKernels().minMax(values, count, low, high);
+}
+
+void
+KernelMinMaxIndexed(const float* values, const int* indices, int count, float& low, float& high)
+{
+	GetKernels().minMaxIndexed(values, indices, count, low, high);
+}
+
+void
+KernelScale(float* values, int count, float scale)
+{
+	GetKernels().scale(values, count, scale);
+}
+
+void
+KernelScaleIndexed(float* values, const int* indices, int count, float scale)
+{
+	GetKernels().scaleIndexed(values, indices, count, scale);
+}
+
+void
+KernelTransform(float* values, int count, double center, double scale, double offset)
+{
+	GetKernels().transform(values, count, center, scale, offset);
+}
+
+void
+KernelTransformIndexed(float* values, const int* indices, int count, double center, double scale, double offset)
+{
+	GetKernels().transformIndexed(values, indices, count, center, scale, offset);
+}
+
+double
+KernelSumTriangleAreas2D(const float* u, const float* v, const int* corners, int numTriangles)
+{
+	return GetKernels().sumTriangleAreas(u, v, corners, numTriangles);
+}
+
+//-----------------------------------------------------------------------------
+// Benchmark
+//-----------------------------------------------------------------------------
+
+enum BenchmarkKernel
+{
+	BenchmarkMinMax,
+	BenchmarkMinMaxIndexed,
+	BenchmarkScale,
+	BenchmarkScaleIndexed,
+	BenchmarkTransform,
+	BenchmarkTransformIndexed,
+	BenchmarkTriangleAreas,
+	NumBenchmarkKernels,
+};
+
+static const int BenchmarkShuffleWindow = 64;
+
+// Each kernel is timed this many times and the fastest kept, so other work
+// on the machine doesn't count against whichever level it happened to hit
+static const int BenchmarkTrials = 5;
+
+static const char* BenchmarkKernelNames[NumBenchmarkKernels] = { "minMax", "minMaxIndexed", "scale", "scaleIndexed", "transform", "transformIndexed", "triangleAreas" };
+
+// Synthetic UVs, indices standing in for a shell's UV ids, which are nearly
+// in order but shuffled locally, and triangles joining nearby UVs like faces do
+struct BenchmarkData
+{
+	std::vector<float>	u, v, values;
+	std::vector<int>	indices, corners;
+};
+
+static void
+BuildBenchmarkData(int numValues, BenchmarkData& data)
+{
+	unsigned int seed = 12345;
+	data.u.resize(numValues);
+	data.v.resize(numValues);
+	data.indices.resize(numValues);
+	for (int i = 0; i < numValues; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		data.u[i] = (float)(seed >> 8) / (float)(1 << 24);
+		seed = seed * 1664525u + 1013904223u;
+		data.v[i] = (float)(seed >> 8) / (float)(1 << 24);
+		data.indices[i] = i;
+	}
+	for (int i = numValues - 1; i > 0; i--)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		int window = std::min(i + 1, BenchmarkShuffleWindow);
+		std::swap(data.indices[i], data.indices[i - (int)((seed >> 8) % (unsigned int)window)]);
+	}
+
+	data.corners.resize(numValues * 3);
+	for (int i = 0; i < numValues; i++)
+	{
+		data.corners[i * 3 + 0] = i;
+		data.corners[i * 3 + 1] = (i + 1) % numValues;
+		data.corners[i * 3 + 2] = (i + 2) % numValues;
+	}
+}
+
+// What one run of a kernel wrote or returned
+struct BenchmarkResult
+{
+	std::vector<float>	values;
+	double				total;
+};
+
+// Runs one kernel once, with a center, scale and offset that don't round
+// exactly, so a level can be checked against scalar
+static void
+RunKernelOnce(const KernelTable& kernels, BenchmarkKernel kernel, const BenchmarkData& data, BenchmarkResult& result)
+{
+	int numValues = (int)data.u.size();
+	result.values = data.u;
+	result.total = 0.0;
+	float* values = &result.values[0];
+	const int* indices = &data.indices[0];
+
+	float low = FLT_MAX, high = -FLT_MAX;
+	switch (kernel)
+	{
+	case BenchmarkMinMax:
+		kernels.minMax(values, numValues, low, high);
+		result.total = (double)low + (double)high;
+		break;
+	case BenchmarkMinMaxIndexed:
+		kernels.minMaxIndexed(&data.v[0], indices, numValues, low, high);
+		result.total = (double)low + (double)high;
+		break;
+	case BenchmarkScale:
+		kernels.scale(values, numValues, 1.37f);
+		break;
+	case BenchmarkScaleIndexed:
+		kernels.scaleIndexed(values, indices, numValues, 0.77f);
+		break;
+	case BenchmarkTransform:
+		kernels.transform(values, numValues, 0.3, 1.123456789, 0.25);
+		break;
+	case BenchmarkTransformIndexed:
+		kernels.transformIndexed(values, indices, numValues, -0.3, 0.987654321, -2.5);
+		break;
+	case BenchmarkTriangleAreas:
+		result.total = kernels.sumTriangleAreas(&data.u[0], &data.v[0], &data.corners[0], numValues);
+		break;
+	default:
+		break;
+	}
+}
+
+// The values have to match bit for bit, the area totals only to rounding as
+// each level adds the areas in a different order
+static bool
+IsSameResult(BenchmarkKernel kernel, const BenchmarkResult& a, const BenchmarkResult& b)
+{
+	if (a.values.size() != b.values.size())
+		return false;
+	if (!a.values.empty() && memcmp(&a.values[0], &b.values[0], a.values.size() * sizeof(float)) != 0)
+		return false;
+	if (kernel == BenchmarkTriangleAreas)
+		return fabs(a.total - b.total) <= fabs(b.total) * 1e-12;
+	return a.total == b.total;
+}
+
+// Milliseconds taken to run one kernel numRepeats times
+static double
+TimeKernelTrial(const KernelTable& kernels, BenchmarkKernel kernel, BenchmarkData& data, int numRepeats)
+{
+	int numValues = (int)data.u.size();
+	data.values = data.u;
+	float* values = &data.values[0];
+	const int* indices = &data.indices[0];
+
+	// The results are kept so the work can't be optimised away
+	volatile double sink = 0.0;
+
+	Timer timer;
+	timer.reset();
+	for (int r = 0; r < numRepeats; r++)
+	{
+		float low = FLT_MAX, high = -FLT_MAX;
+		switch (kernel)
+		{
+		case BenchmarkMinMax:
+			kernels.minMax(values, numValues, low, high);
+			sink = sink + low + high;
+			break;
+		case BenchmarkMinMaxIndexed:
+			kernels.minMaxIndexed(values, indices, numValues, low, high);
+			sink = sink + low + high;
+			break;
+		case BenchmarkScale:
+			kernels.scale(values, numValues, (r & 1) ? 0.5f : 2.0f);
+			break;
+		case BenchmarkScaleIndexed:
+			kernels.scaleIndexed(values, indices, numValues, (r & 1) ? 0.5f : 2.0f);
+			break;
+		case BenchmarkTransform:
+			kernels.transform(values, numValues, 0.5, (r & 1) ? 0.5 : 2.0, 0.0);
+			break;
+		case BenchmarkTransformIndexed:
+			kernels.transformIndexed(values, indices, numValues, 0.5, (r & 1) ? 0.5 : 2.0, 0.0);
+			break;
+		case BenchmarkTriangleAreas:
+			sink = sink + kernels.sumTriangleAreas(&data.u[0], &data.v[0], &data.corners[0], numValues);
+			break;
+		default:
+			break;
+		}
+	}
+	double milliseconds = timer.getTime();
+	sink = sink + values[0];
+	return milliseconds;
+}
+
+static double
+TimeKernel(const KernelTable& kernels, BenchmarkKernel kernel, BenchmarkData& data, int numRepeats)
+{
+	double fastest = DBL_MAX;
+	for (int i = 0; i < BenchmarkTrials; i++)
+	{
+		double milliseconds = TimeKernelTrial(kernels, kernel, data, numRepeats);
+		if (milliseconds < fastest)
+			fastest = milliseconds;
+	}
+	return fastest;
+}
+
+void
+BenchmarkKernels(int numValues, int numRepeats, std::vector<KernelTiming>& timings)
+{
+	timings.clear();
+	if (numValues < 1 || numRepeats < 1)
+		return;
+
+	if (!s_isInitialised)
+	{
+		InitialiseKernels(KernelScalar);
+	}
+
+	BenchmarkData data;
+	BuildBenchmarkData(numValues, data);
+
+	for (int k = 0; k < NumBenchmarkKernels; k++)
+	{
+		BenchmarkKernel kernel = (BenchmarkKernel)k;
+		BenchmarkResult scalarResult;
+		RunKernelOnce(s_tables[KernelScalar], kernel, data, scalarResult);
+		double scalarMilliseconds = TimeKernel(s_tables[KernelScalar], kernel, data, numRepeats);
+		for (int level = KernelScalar; level <= s_supportedLevel; level++)
+		{
+			KernelTiming timing;
+			timing.kernel = BenchmarkKernelNames[k];
+			timing.level = (KernelLevel)level;
+			timing.milliseconds = (level == KernelScalar) ? scalarMilliseconds : TimeKernel(s_tables[level], kernel, data, numRepeats);
+			timing.speedup = (timing.milliseconds > 0.0) ? scalarMilliseconds / timing.milliseconds : 0.0;
+			timing.matches = true;
+			if (level != KernelScalar)
+			{
+				BenchmarkResult result;
+				RunKernelOnce(s_tables[level], kernel, data, result);
+				timing.matches = IsSameResult(kernel, result, scalarResult);
+			}
+			timings.push_back(timing);
+		}
+	}
+}
@@ -0,0 +1,70 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef UVKERNELS_H
+#define UVKERNELS_H
+
+#include <vector>
+
+// Instruction sets the array kernels have variants for, slowest first
+enum KernelLevel
+{
+	KernelScalar,
+	KernelSSE2,
+	KernelAVX2,
+	KernelAVX512,
+	NumKernelLevels,
+};
+
+// Picks the fastest variants that both the CPU and the compiler support, up to
+// maxLevel.  Called once when the plugin loads, before any work is threaded,
+// the scalar variants are used until then.
+KernelLevel	InitialiseKernels(KernelLevel maxLevel = KernelAVX512);
+KernelLevel	GetKernelLevel();
+KernelLevel	GetSupportedKernelLevel();
+const char*	GetKernelLevelName(KernelLevel level);
+
+// Widens low and high to take in the values, NaNs are skipped
+void		KernelMinMax(const float* values, int count, float& low, float& high);
+void		KernelMinMaxIndexed(const float* values, const int* indices, int count, float& low, float& high);
+
+// Multiplies the values by scale in single precision
+void		KernelScale(float* values, int count, float scale);
+void		KernelScaleIndexed(float* values, const int* indices, int count, float scale);
+
+// Scales the values about center then moves them by offset, in double precision
+// like Processor::TransformUV.  The indices must not repeat.
+void		KernelTransform(float* values, int count, double center, double scale, double offset);
+void		KernelTransformIndexed(float* values, const int* indices, int count, double center, double scale, double offset);
+
+// Total area of UV triangles, given as three UV ids each, measured like
+// GetTriangleArea2D.  Only the order the areas are added in differs between levels.
+double		KernelSumTriangleAreas2D(const float* u, const float* v, const int* corners, int numTriangles);
+
+// Time taken by one kernel at one level, over the same synthetic data as scalar,
+// and whether it gave the same results as scalar
+struct KernelTiming
+{
+	const char*	kernel;
+	KernelLevel	level;
+	double		milliseconds;
+	double		speedup;
+	bool		matches;
+};
+
+// Times every kernel at every level the CPU supports, the array kernels over
+// numValues values and the area kernel over numValues triangles, and checks
+// each level's results against scalar
+void		BenchmarkKernels(int numValues, int numRepeats, std::vector<KernelTiming>& timings);
+
+#endif
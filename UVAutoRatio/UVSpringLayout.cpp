@@ -15,10 +15,54 @@
 #include <algorithm>
 #include "MayaUtility.h"
 #include "Utility.h"
+#include "ThreadUtility.h"
+#include "UVTriangleBVH.h"
 #include "UVSpringLayout.h"
 
 using namespace std;
 
+// The step grows each step until it reaches the largest step the springs stay stable at
+static const double StepGrowth = 1.1;
+static const double MaxStepSize = 1.0;
+
+// Fraction of the average box size a box may move in one step
+static const double MaxMoveFraction = 0.1;
+
+// The boxes have settled once the kinetic energy stays this far below its peak
+static const double SettledEnergyFraction = 1.0e-8;
+static const int SettledSteps = 10;
+
+// Boxes and springs handled per thread pool task
+static const int BoxGrainSize = 1024;
+static const int SpringGrainSize = 2048;
+
+// Finding contacts tests a box against every later box, so a task takes fewer of them
+static const int ContactGrainSize = 64;
+
+static const double TwoPi = 6.28318530717958647692;
+
+static uint
+MixHash(uint h)
+{
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+// Repeatable value in [0, 1) used instead of rand(), so threaded steps match serial ones
+static double
+HashUnit(uint seed, uint a, uint b, uint c)
+{
+	uint h = MixHash(seed ^ 0x9e3779b9u);
+	h = MixHash(h ^ a);
+	h = MixHash(h ^ b);
+	h = MixHash(h ^ c);
+	return (double)(h >> 8) / 16777216.0;
+}
+
 bool
 Box::IsConnected(const Box& box) const
 {
@@ -41,6 +85,9 @@ Box::Box()
 	force[0] = force[1] = 0.0;
 	dp[0] = dp[1] = 0.0;
 	dv[0] = dv[1] = 0.0;
+	index = 0;
+	isFixed = false;
+	shape = NULL;
 	springs.reserve(256);
 }
 
@@ -53,6 +100,16 @@ UVSpringLayout::UVSpringLayout()
 {
 	m_boxes.reserve(256);
 	m_springs.reserve(2048);
+	m_shapeMargin = 0.0;
+	m_seed = 0;
+	m_stepSize = 0.001;
+	m_stepTime = 0.0;
+	m_maxMove = 0.0;
+	m_kineticEnergy = 0.0;
+	m_peakEnergy = 0.0;
+	m_numSteps = 0;
+	m_numSettledSteps = 0;
+	m_exitReason = LayoutRunning;
 }
 
 UVSpringLayout::~UVSpringLayout()
@@ -82,19 +139,50 @@ UVSpringLayout::Clear()
 		}
 		m_springs.clear();
 	}
+
+	m_maxMove = 0.0;
+	m_kineticEnergy = 0.0;
+	m_peakEnergy = 0.0;
+	m_numSteps = 0;
+	m_numSettledSteps = 0;
+	m_exitReason = LayoutRunning;
 }
 
 void
-UVSpringLayout::AddBox(double width, double height, const double2& center)
+UVSpringLayout::AddBox(double width, double height, const double2& center, const UVTriangleBVH* shape, bool isFixed)
 {
 	Box* b = new Box();
 	b->width = width;
 	b->height = height;
+	b->shape = shape;
+	b->index = (int)m_boxes.size();
+	b->isFixed = isFixed;
 	b->position[0] = center[0];
 	b->position[1] = center[1];
 	m_boxes.push_back(b);
 }
 
+// Shells closer than this are still pushed apart when their boxes overlap
+void
+UVSpringLayout::SetShapeMargin(double margin)
+{
+	m_shapeMargin = margin;
+}
+
+// The first step size, it adapts from there
+void
+UVSpringLayout::SetStepSize(double stepSize)
+{
+	m_stepSize = Min(stepSize, MaxStepSize);
+}
+
+// Picks the directions boxes stacked on the same spot are pushed apart in
+void
+UVSpringLayout::SetSeed(uint seed)
+{
+	m_seed = seed;
+}
+
 void
 UVSpringLayout::GetPosition(uint index, double2& position)
 {
@@ -102,44 +190,90 @@ UVSpringLayout::GetPosition(uint index, double2& position)
 	position[1] = m_boxes[index]->position[1];
 }
 
+int
+UVSpringLayout::GetNumSteps() const
+{
+	return m_numSteps;
+}
+
+// Only valid after stepping has stopped, a layout still running was stopped by the iteration limit
+LayoutExitReason
+UVSpringLayout::GetExitReason() const
+{
+	if (m_exitReason == LayoutRunning)
+		return LayoutIterationLimit;
+	return m_exitReason;
+}
+
+const char*
+UVSpringLayout::GetExitReasonName(LayoutExitReason reason)
+{
+	switch (reason)
+	{
+	case LayoutRunning:
+		return "running";
+	case LayoutSeparated:
+		return "separated";
+	case LayoutSettled:
+		return "settled with overlaps";
+	case LayoutIterationLimit:
+		return "reached the iteration limit";
+	}
+	return "unknown";
+}
+
+// Returns false once the boxes are separated or have settled
 bool
-UVSpringLayout::Step(double stepSize)
+UVSpringLayout::Step()
 {
-	ConnectOverlapping();
-	RemoveSprings();
-	UpdateParticles(stepSize);
+	if (m_exitReason != LayoutRunning)
+		return false;
 
-	size_t num = m_boxes.size();
-	size_t i = 0;
-	for (i = 0; i < num; i++)
+	// Moves are limited relative to the boxes so small layouts don't jump and large ones don't crawl
+	if (m_maxMove == 0.0 && !m_boxes.empty())
 	{
-		Box& box = *m_boxes[i];
-		if (box.springs.size() == 0)
+		double totalSize = 0.0;
+		for (size_t i = 0; i < m_boxes.size(); i++)
 		{
-			box.velocity[0] = box.velocity[1] = 0.0;
-			box.force[0] = box.force[1] = 0.0;
+			totalSize += m_boxes[i]->width + m_boxes[i]->height;
 		}
+		m_maxMove = Max(MaxMoveFraction * totalSize / (2.0 * m_boxes.size()), 1.0e-6);
 	}
 
-	// TODO: we could just check whether there are any springs instead of this check
-	bool intersections = (m_springs.size() != 0);
-	/*bool intersections = false;
-	for (i = 0; i < num; i++)
+	ConnectOverlapping();
+	RemoveSprings();
+
+	if (m_springs.size() == 0)
 	{
-		Box& boxA = *m_boxes[i];
+		m_exitReason = LayoutSeparated;
+		return false;
+	}
+
+	UpdateParticles();
+	m_numSteps++;
 
-		for (size_t j = i + 1; j < num; j++)
+	// Converged when the boxes stay still, the springs left are between boxes that can't separate
+	int num = (int)m_boxes.size();
+	m_rangeValues.assign((num + BoxGrainSize - 1) / BoxGrainSize, 0.0);
+	ParallelFor(num, BoxGrainSize, KineticEnergyRange, this);
+	m_kineticEnergy = SumRanges();
+	m_peakEnergy = Max(m_peakEnergy, m_kineticEnergy);
+
+	if (m_kineticEnergy <= m_peakEnergy * SettledEnergyFraction)
+	{
+		m_numSettledSteps++;
+		if (m_numSettledSteps >= SettledSteps)
 		{
-			Box& boxB = *m_boxes[j];
-			if (BoxIntersect(boxA, boxB))
-			{
-				intersections = true;
-				break;
-			}
+			m_exitReason = LayoutSettled;
+			return false;
 		}
-	}*/
+	}
+	else
+	{
+		m_numSettledSteps = 0;
+	}
 
-	return intersections;
+	return true;
 }
 
 bool
@@ -172,33 +306,68 @@ UVSpringLayout::BoxIntersect(const Box& a, const Box& b) const
 	return true;
 }
 
+// Boxes that overlap only need separating if their triangles do too
+bool
+UVSpringLayout::ShapeIntersect(const Box& a, const Box& b) const
+{
+	if (a.shape == NULL || b.shape == NULL)
+		return true;
+
+	return a.shape->Intersects(*b.shape, b.position[0] - a.position[0], b.position[1] - a.position[1], m_shapeMargin);
+}
+
+// Finds the overlapping boxes on the thread pool, then makes their springs in box order
+// so the springs are the same however the boxes were split between the threads
 void
 UVSpringLayout::ConnectOverlapping()
 {
-	size_t num = m_boxes.size();
-	for (size_t i = 0; i < num; i++)
+	int num = (int)m_boxes.size();
+	ParallelFor(num, ContactGrainSize, FindContactsRange, this);
+
+	for (int i = 0; i < num; i++)
 	{
 		Box& boxA = *m_boxes[i];
-		for (size_t j = i + 1; j < num; j++)
+		for (size_t j = 0; j < boxA.contacts.size(); j++)
+		{
+			Box& boxB = *boxA.contacts[j];
+
+			Spring* ss = new Spring();
+			ss->from = &boxA;
+			ss->to = &boxB;
+			ss->constant = 0.125;
+			ss->damping = 0.01;
+			double h1 = 0.75 * sqrt((boxA.width * boxA.width) + (boxA.height * boxA.height));
+			double h2 = 0.75 * sqrt((boxB.width *  boxB.width) + ( boxB.height * boxB.height));
+			ss->restLength = h1 + h2;
+			ss->force[0] = ss->force[1] = 0.0;
+			ss->isSeparated = false;
+			boxA.springs.push_back(ss);
+			boxB.springs.push_back(ss);
+
+			m_springs.push_back(ss);
+		}
+		boxA.contacts.clear();
+	}
+}
+
+void
+UVSpringLayout::FindContactsRange(void* data, int begin, int end)
+{
+	UVSpringLayout& layout = *(UVSpringLayout*)data;
+	int num = (int)layout.m_boxes.size();
+	for (int i = begin; i < end; i++)
+	{
+		Box& boxA = *layout.m_boxes[i];
+		boxA.contacts.clear();
+		for (int j = i + 1; j < num; j++)
 		{
-			Box& boxB = *m_boxes[j];
-			if (BoxIntersect(boxA, boxB))
+			Box& boxB = *layout.m_boxes[j];
+			if (layout.BoxIntersect(boxA, boxB))
 			{
 				// check if already connected
-				if (!boxA.IsConnected(boxB))
+				if (!boxA.IsConnected(boxB) && layout.ShapeIntersect(boxA, boxB))
 				{
-					Spring* ss = new Spring();
-					ss->from = &boxA;
-					ss->to = &boxB;
-					ss->constant = 0.125;
-					ss->damping = 0.01;
-					double h1 = 0.75 * sqrt((boxA.width * boxA.width) + (boxA.height * boxA.height));
-					double h2 = 0.75 * sqrt((boxB.width *  boxB.width) + ( boxB.height * boxB.height));
-					ss->restLength = h1 + h2;
-					boxA.springs.push_back(ss);
-					boxB.springs.push_back(ss);
-
-					m_springs.push_back(ss);
+					boxA.contacts.push_back(&boxB);
 				}
 			}
 		}
@@ -208,18 +377,21 @@ UVSpringLayout::ConnectOverlapping()
 void
 UVSpringLayout::RemoveSprings()
 {
-	std::vector<Spring*> springstoRemove;
-	uint i = 0;
-	for (i = 0; i < m_springs.size(); i++)
+	ParallelFor((int)m_springs.size(), SpringGrainSize, CheckSpringsRange, this);
+
+	// Keeps the order of the springs left, the boxes sum their forces in that order
+	size_t numKept = 0;
+	for (size_t i = 0; i < m_springs.size(); i++)
 	{
-		Spring& s = *m_springs[i];
-		Box& boxA = *s.from;
-		Box& boxB = *s.to;
-		if (!BoxIntersect(boxA, boxB))
+		Spring* s = m_springs[i];
+		if (s->isSeparated)
 		{
+			Box& boxA = *s->from;
+			Box& boxB = *s->to;
+
 			// Try find the spring
-			vector<Spring*>::iterator itA = std::find(boxA.springs.begin(), boxA.springs.end(), &s);
-			vector<Spring*>::iterator itB = std::find(boxB.springs.begin(), boxB.springs.end(), &s);
+			vector<Spring*>::iterator itA = std::find(boxA.springs.begin(), boxA.springs.end(), s);
+			vector<Spring*>::iterator itB = std::find(boxB.springs.begin(), boxB.springs.end(), s);
 
 			assert(itA != boxA.springs.end());
 			assert(itB != boxB.springs.end());
@@ -227,57 +399,155 @@ UVSpringLayout::RemoveSprings()
 			boxA.springs.erase(itA);
 			boxB.springs.erase(itB);
 
-			springstoRemove.push_back(&s);
+			delete s;
+		}
+		else
+		{
+			m_springs[numKept++] = s;
 		}
 	}
+	m_springs.resize(numKept);
+}
 
-	for (i = 0; i < springstoRemove.size(); i++)
+void
+UVSpringLayout::CheckSpringsRange(void* data, int begin, int end)
+{
+	UVSpringLayout& layout = *(UVSpringLayout*)data;
+	for (int i = begin; i < end; i++)
 	{
-		Spring& s = *springstoRemove[i];
-
-		vector<Spring*>::iterator itA = std::find(m_springs.begin(), m_springs.end(), &s);
-		assert(itA != m_springs.end());
-		m_springs.erase(itA);
+		Spring& s = *layout.m_springs[i];
+		s.isSeparated = (!layout.BoxIntersect(*s.from, *s.to) || !layout.ShapeIntersect(*s.from, *s.to));
 	}
 }
 
+// Semi-implicit Euler, the new velocity moves the box, which stays stable
+// at much larger steps than updating the position with the old velocity
 void
-UVSpringLayout::UpdateParticles(double dt)
+UVSpringLayout::UpdateParticles()
 {
 	CalculateForces();
-	CalculateDerivatives();
+	AdaptStepSize();
+
+	m_stepTime = m_stepSize;
+
+	// Limit the step so the fastest box can't jump past the boxes it is separating from
+	int num = (int)m_boxes.size();
+	m_rangeValues.assign((num + BoxGrainSize - 1) / BoxGrainSize, 0.0);
+	ParallelFor(num, BoxGrainSize, MaxSpeedRange, this);
+	double maxSpeedSquared = MaxRanges();
+	if (maxSpeedSquared * m_stepTime * m_stepTime > m_maxMove * m_maxMove)
+	{
+		m_stepTime = m_maxMove / sqrt(maxSpeedSquared);
+	}
 
-	for (uint i = 0; i < m_boxes.size(); i++)
+	ParallelFor(num, BoxGrainSize, IntegrateRange, this);
+}
+
+void
+UVSpringLayout::MaxSpeedRange(void* data, int begin, int end)
+{
+	UVSpringLayout& layout = *(UVSpringLayout*)data;
+	double dt = layout.m_stepTime;
+	double maxSpeedSquared = 0.0;
+	for (int i = begin; i < end; i++)
 	{
-		Box& box = *m_boxes[i];
-		box.position[0] += box.dp[0] * dt;
-		box.position[1] += box.dp[1] * dt;
+		Box& box = *layout.m_boxes[i];
+		if (box.isFixed)
+			continue;
+
+		double u = box.velocity[0] + box.dv[0] * dt;
+		double v = box.velocity[1] + box.dv[1] * dt;
+		maxSpeedSquared = Max(maxSpeedSquared, u * u + v * v);
+	}
+	layout.m_rangeValues[begin / BoxGrainSize] = maxSpeedSquared;
+}
+
+void
+UVSpringLayout::IntegrateRange(void* data, int begin, int end)
+{
+	UVSpringLayout& layout = *(UVSpringLayout*)data;
+	double dt = layout.m_stepTime;
+	for (int i = begin; i < end; i++)
+	{
+		Box& box = *layout.m_boxes[i];
+		if (box.isFixed)
+			continue;
+
 		box.velocity[0] += box.dv[0] * dt;
 		box.velocity[1] += box.dv[1] * dt;
+		box.position[0] += box.velocity[0] * dt;
+		box.position[1] += box.velocity[1] * dt;
 	}
 }
 
+// Boxes without springs are stopped, the rest add their kinetic energy to their range
 void
-UVSpringLayout::CalculateForces()
+UVSpringLayout::KineticEnergyRange(void* data, int begin, int end)
 {
-	double drag = 0.1;
-	uint i = 0;
-	for (i = 0; i < m_boxes.size(); i++)
+	UVSpringLayout& layout = *(UVSpringLayout*)data;
+	double energy = 0.0;
+	for (int i = begin; i < end; i++)
 	{
-		Box& box = *m_boxes[i];
+		Box& box = *layout.m_boxes[i];
+		if (box.springs.size() == 0)
+		{
+			box.velocity[0] = box.velocity[1] = 0.0;
+			box.force[0] = box.force[1] = 0.0;
+		}
+		energy += 0.5 * (box.velocity[0] * box.velocity[0] + box.velocity[1] * box.velocity[1]);
+	}
+	layout.m_rangeValues[begin / BoxGrainSize] = energy;
+}
 
-		box.force[0] = box.force[1] = 0.0;
+double
+UVSpringLayout::SumRanges() const
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < m_rangeValues.size(); i++)
+	{
+		sum += m_rangeValues[i];
+	}
+	return sum;
+}
 
-		box.force[0] -= drag * box.velocity[0];
-		box.force[1] -= drag * box.velocity[1];
+double
+UVSpringLayout::MaxRanges() const
+{
+	double maximum = 0.0;
+	for (size_t i = 0; i < m_rangeValues.size(); i++)
+	{
+		maximum = Max(maximum, m_rangeValues[i]);
 	}
+	return maximum;
+}
+
+// The step grows until the displacement limit in UpdateParticles takes over,
+// which keeps the fastest box stable however stiff the springs it is caught between
+void
+UVSpringLayout::AdaptStepSize()
+{
+	m_stepSize = Min(m_stepSize * StepGrowth, MaxStepSize);
+}
 
-	for (i = 0; i < m_springs.size(); i++)
+// Each spring works out its force once, then each box gathers the forces of its own
+// springs, so no two threads add to the same box
+void
+UVSpringLayout::CalculateForces()
+{
+	ParallelFor((int)m_springs.size(), SpringGrainSize, SpringForcesRange, this);
+	ParallelFor((int)m_boxes.size(), BoxGrainSize, BoxForcesRange, this);
+}
+
+void
+UVSpringLayout::SpringForcesRange(void* data, int begin, int end)
+{
+	UVSpringLayout& layout = *(UVSpringLayout*)data;
+	for (int i = begin; i < end; i++)
 	{
-		Spring& s = *m_springs[i];
+		Spring& s = *layout.m_springs[i];
 
-		Box& p1 = *s.from;
-		Box& p2 = *s.to;
+		const Box& p1 = *s.from;
+		const Box& p2 = *s.to;
 
 		double len = 0.0;
 		double2 d;
@@ -292,37 +562,51 @@ UVSpringLayout::CalculateForces()
 		}
 		else
 		{
-			p1.position[0] += RandomSignedUnit() * 0.001;
-			p1.position[1] += RandomSignedUnit() * 0.001;
-			p2.position[0] += RandomSignedUnit() * 0.001;
-			p2.position[1] += RandomSignedUnit() * 0.001;
+			// Boxes on the same spot are pushed apart in a direction picked from the seed
+			double angle = HashUnit(layout.m_seed, (uint)p1.index, (uint)p2.index, (uint)layout.m_numSteps) * TwoPi;
+			d[0] = cos(angle);
+			d[1] = sin(angle);
 		}
 
-		double2 f;
-		f[0] = s.constant * (len - s.restLength);
-		f[0] += s.damping * (p1.velocity[0] - p2.velocity[0]) * d[0];
-		f[0] *= -d[0];
-		f[1] = s.constant * (len - s.restLength);
-		f[1] += s.damping * (p1.velocity[1] - p2.velocity[1]) * d[1];
-		f[1] *= -d[1];
-
-		p1.force[0] += f[0];
-		p1.force[1] += f[1];
-		p2.force[0] -= f[0];
-		p2.force[1] -= f[1];
+		s.force[0] = s.constant * (len - s.restLength);
+		s.force[0] += s.damping * (p1.velocity[0] - p2.velocity[0]) * d[0];
+		s.force[0] *= -d[0];
+		s.force[1] = s.constant * (len - s.restLength);
+		s.force[1] += s.damping * (p1.velocity[1] - p2.velocity[1]) * d[1];
+		s.force[1] *= -d[1];
 	}
 }
 
 void
-UVSpringLayout::CalculateDerivatives()
+UVSpringLayout::BoxForcesRange(void* data, int begin, int end)
 {
-	for (uint i = 0; i < m_boxes.size(); i++)
+	UVSpringLayout& layout = *(UVSpringLayout*)data;
+	double drag = 0.1;
+	for (int i = begin; i < end; i++)
 	{
-		Box& box = *m_boxes[i];
+		Box& box = *layout.m_boxes[i];
+
+		box.force[0] = -drag * box.velocity[0];
+		box.force[1] = -drag * box.velocity[1];
+
+		for (size_t j = 0; j < box.springs.size(); j++)
+		{
+			const Spring& s = *box.springs[j];
+			if (s.from == &box)
+			{
+				box.force[0] += s.force[0];
+				box.force[1] += s.force[1];
+			}
+			else
+			{
+				box.force[0] -= s.force[0];
+				box.force[1] -= s.force[1];
+			}
+		}
+
 		box.dp[0] = box.velocity[0];
 		box.dp[1] = box.velocity[1];
 		box.dv[0] = box.force[0];     //  / box.mass;
 		box.dv[1] = box.force[1];     //  / box.mass;
 	}
 }
-
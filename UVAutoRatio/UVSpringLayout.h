@@ -19,6 +19,16 @@
 
 class Box;
 class Spring;
+class UVTriangleBVH;
+
+// Why the layout stopped stepping
+enum LayoutExitReason
+{
+	LayoutRunning,
+	LayoutSeparated,		// No boxes overlap
+	LayoutSettled,			// Boxes still overlap but have stopped moving
+	LayoutIterationLimit,	// Still moving when the iteration limit was reached
+};
 
 class Box
 {
@@ -33,8 +43,20 @@ public:
 	double2 force;
 	double2 dp, dv;
 
+	// Position in the layout, orders the springs so every run sums them the same way
+	int index;
+
+	// Fixed boxes push the others away but never move themselves
+	bool isFixed;
+
 	std::vector<Spring*> springs;
 
+	// Overlapping boxes found for this box this step, before springs are made for them
+	std::vector<Box*> contacts;
+
+	// Triangles of the shell relative to its starting position, or NULL to only use the box
+	const UVTriangleBVH* shape;
+
 	bool IsConnected(const Box& box) const;
 };
 
@@ -46,6 +68,10 @@ public:
 	double constant;
 	double damping;
 	double restLength;
+
+	// Force on from this step, to gets the opposite
+	double2 force;
+	bool isSeparated;
 };
 
 class UVSpringLayout
@@ -55,21 +81,55 @@ public:
 	~UVSpringLayout();
 
 	void	Clear();
-	void	AddBox(double width, double height, const double2& center);
-	bool	Step(double stepSize);
+	void	AddBox(double width, double height, const double2& center, const UVTriangleBVH* shape = NULL, bool isFixed = false);
+	void	SetShapeMargin(double margin);
+	void	SetStepSize(double stepSize);
+	void	SetSeed(uint seed);
+	bool	Step();
 	void	GetPosition(uint index, double2& position);
 
+	int					GetNumSteps() const;
+	LayoutExitReason	GetExitReason() const;
+	static const char*	GetExitReasonName(LayoutExitReason reason);
+
 private:
 	void	ConnectOverlapping();
 	void	RemoveSprings();
-	void	UpdateParticles(double time);
+	void	UpdateParticles();
 	void	CalculateForces();
-	void	CalculateDerivatives();
+	void	AdaptStepSize();
+	double	SumRanges() const;
+	double	MaxRanges() const;
 
 	bool	BoxIntersect(const Box& a, const Box& b) const;
+	bool	ShapeIntersect(const Box& a, const Box& b) const;
+
+	// Each step runs these on the thread pool, every range only writes to its own boxes or springs
+	static void		FindContactsRange(void* data, int begin, int end);
+	static void		CheckSpringsRange(void* data, int begin, int end);
+	static void		SpringForcesRange(void* data, int begin, int end);
+	static void		BoxForcesRange(void* data, int begin, int end);
+	static void		MaxSpeedRange(void* data, int begin, int end);
+	static void		IntegrateRange(void* data, int begin, int end);
+	static void		KineticEnergyRange(void* data, int begin, int end);
 
 	std::vector<Box*> m_boxes;
 	std::vector<Spring*> m_springs;
+	double	m_shapeMargin;
+	uint	m_seed;
+
+	// Sum or maximum of each range of boxes, combined in order so the result doesn't depend on the threads
+	std::vector<double>	m_rangeValues;
+
+	// Adaptive integration
+	double	m_stepSize;
+	double	m_stepTime;
+	double	m_maxMove;
+	double	m_kineticEnergy;
+	double	m_peakEnergy;
+	int		m_numSteps;
+	int		m_numSettledSteps;
+	LayoutExitReason	m_exitReason;
 };
 
 
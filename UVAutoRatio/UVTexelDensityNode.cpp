@@ -0,0 +1,370 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "Utility.h"
+#include "UVTexelDensityNode.h"
+
+const MTypeId UVTexelDensityNode::typeId(0x0007F1A0);
+const MString UVTexelDensityNode::typeName("uvTexelDensity");
+
+MObject UVTexelDensityNode::inMesh;
+MObject UVTexelDensityNode::uvSetName;
+MObject UVTexelDensityNode::shellSurfaceArea;
+MObject UVTexelDensityNode::shellUVArea;
+MObject UVTexelDensityNode::shellRatio;
+MObject UVTexelDensityNode::surfaceArea;
+MObject UVTexelDensityNode::uvArea;
+MObject UVTexelDensityNode::ratio;
+MObject UVTexelDensityNode::numShells;
+
+static bool
+IsEqual(const MIntArray& a, const MIntArray& b)
+{
+	uint length = a.length();
+	if (length != b.length())
+		return false;
+
+	for (uint i = 0; i < length; i++)
+	{
+		if (a[i] != b[i])
+			return false;
+	}
+	return true;
+}
+
+// Builds a list of the faces using each element, grouped by element
+static void
+BuildElementFaces(const MIntArray& faceCounts, const MIntArray& elementIds, int numElements, std::vector<int>& offsets, std::vector<int>& faces)
+{
+	offsets.assign(numElements + 1, 0);
+	uint numIds = elementIds.length();
+	for (uint i = 0; i < numIds; i++)
+	{
+		offsets[elementIds[i] + 1]++;
+	}
+	for (int i = 0; i < numElements; i++)
+	{
+		offsets[i + 1] += offsets[i];
+	}
+
+	std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+	faces.resize(numIds);
+	uint numFaces = faceCounts.length();
+	uint index = 0;
+	for (uint face = 0; face < numFaces; face++)
+	{
+		int count = faceCounts[face];
+		for (int k = 0; k < count; k++)
+		{
+			faces[fill[elementIds[index]]++] = (int)face;
+			index++;
+		}
+	}
+}
+
+UVTexelDensityNode::UVTexelDensityNode()
+{
+	m_isValid = false;
+	m_numShells = 0;
+}
+
+UVTexelDensityNode::~UVTexelDensityNode()
+{
+}
+
+void*
+UVTexelDensityNode::creator()
+{
+	return new UVTexelDensityNode;
+}
+
+MStatus
+UVTexelDensityNode::initialize()
+{
+	MStatus status;
+	MFnTypedAttribute typedAttr;
+	MFnNumericAttribute numericAttr;
+
+	inMesh = typedAttr.create("inMesh", "im", MFnData::kMesh, &status);
+	typedAttr.setStorable(false);
+	typedAttr.setHidden(true);
+
+	uvSetName = typedAttr.create("uvSetName", "uvs", MFnData::kString, &status);
+	typedAttr.setStorable(true);
+
+	shellSurfaceArea = typedAttr.create("shellSurfaceArea", "ssa", MFnData::kDoubleArray, &status);
+	typedAttr.setWritable(false);
+	typedAttr.setStorable(false);
+
+	shellUVArea = typedAttr.create("shellUVArea", "sua", MFnData::kDoubleArray, &status);
+	typedAttr.setWritable(false);
+	typedAttr.setStorable(false);
+
+	shellRatio = typedAttr.create("shellRatio", "sr", MFnData::kDoubleArray, &status);
+	typedAttr.setWritable(false);
+	typedAttr.setStorable(false);
+
+	surfaceArea = numericAttr.create("surfaceArea", "sa", MFnNumericData::kDouble, 0.0, &status);
+	numericAttr.setWritable(false);
+	numericAttr.setStorable(false);
+
+	uvArea = numericAttr.create("uvArea", "ua", MFnNumericData::kDouble, 0.0, &status);
+	numericAttr.setWritable(false);
+	numericAttr.setStorable(false);
+
+	ratio = numericAttr.create("ratio", "r", MFnNumericData::kDouble, 0.0, &status);
+	numericAttr.setWritable(false);
+	numericAttr.setStorable(false);
+
+	numShells = numericAttr.create("numShells", "ns", MFnNumericData::kInt, 0, &status);
+	numericAttr.setWritable(false);
+	numericAttr.setStorable(false);
+
+	addAttribute(inMesh);
+	addAttribute(uvSetName);
+	addAttribute(shellSurfaceArea);
+	addAttribute(shellUVArea);
+	addAttribute(shellRatio);
+	addAttribute(surfaceArea);
+	addAttribute(uvArea);
+	addAttribute(ratio);
+	addAttribute(numShells);
+
+	MObject inputs[] = { inMesh, uvSetName };
+	MObject outputs[] = { shellSurfaceArea, shellUVArea, shellRatio, surfaceArea, uvArea, ratio, numShells };
+	for (int i = 0; i < 2; i++)
+	{
+		for (int j = 0; j < 7; j++)
+		{
+			attributeAffects(inputs[i], outputs[j]);
+		}
+	}
+
+	return MS::kSuccess;
+}
+
+MStatus
+UVTexelDensityNode::compute(const MPlug& plug, MDataBlock& data)
+{
+	MStatus status;
+
+	if (plug != shellSurfaceArea && plug != shellUVArea && plug != shellRatio &&
+		plug != surfaceArea && plug != uvArea && plug != ratio && plug != numShells)
+	{
+		return MS::kUnknownParameter;
+	}
+
+	MObject meshObject = data.inputValue(inMesh, &status).asMesh();
+	MFnMesh mesh(meshObject, &status);
+	if (status != MS::kSuccess)
+	{
+		m_isValid = false;
+	}
+	else
+	{
+		MString uvSet = data.inputValue(uvSetName, &status).asString();
+		if (uvSet.length() == 0)
+		{
+			mesh.getCurrentUVSetName(uvSet);
+		}
+
+		// Only the points and UVs can be compared against the cache
+		MeshFaceData faceData;
+		MFloatArray uArray, vArray;
+		bool isRead = faceData.Build(mesh, &uvSet, MSpace::kObject);
+		isRead = isRead && (mesh.getUVs(uArray, vArray, &uvSet) == MS::kSuccess);
+		if (!isRead)
+		{
+			m_isValid = false;
+		}
+		else if (m_isValid && IsSameTopology(faceData, uvSet))
+		{
+			Update(faceData, uArray, vArray);
+		}
+		else
+		{
+			Rebuild(mesh, uvSet, faceData, uArray, vArray);
+		}
+	}
+
+	// Sum the faces into their shells
+	std::vector<double> shellSurface(m_numShells, 0.0), shellUV(m_numShells, 0.0);
+	double totalSurface = 0.0, totalUV = 0.0;
+	if (m_isValid)
+	{
+		uint numFaces = m_faceShells.length();
+		for (uint i = 0; i < numFaces; i++)
+		{
+			int shell = m_faceShells[i];
+			if (shell >= 0)
+			{
+				shellSurface[shell] += m_faceSurfaceArea[i];
+				shellUV[shell] += m_faceUVArea[i];
+			}
+			totalSurface += m_faceSurfaceArea[i];
+			totalUV += m_faceUVArea[i];
+		}
+	}
+
+	MDoubleArray surfaceValues, uvValues, ratioValues;
+	int shellCount = m_isValid ? m_numShells : 0;
+	surfaceValues.setLength(shellCount);
+	uvValues.setLength(shellCount);
+	ratioValues.setLength(shellCount);
+	for (int i = 0; i < shellCount; i++)
+	{
+		surfaceValues[i] = shellSurface[i];
+		uvValues[i] = shellUV[i];
+		ratioValues[i] = (shellUV[i] > 0.0) ? (shellSurface[i] / shellUV[i]) : 0.0;
+	}
+
+	MFnDoubleArrayData arrayData;
+	data.outputValue(shellSurfaceArea).set(arrayData.create(surfaceValues));
+	data.outputValue(shellUVArea).set(arrayData.create(uvValues));
+	data.outputValue(shellRatio).set(arrayData.create(ratioValues));
+	data.outputValue(surfaceArea).set(totalSurface);
+	data.outputValue(uvArea).set(totalUV);
+	data.outputValue(ratio).set((totalUV > 0.0) ? (totalSurface / totalUV) : 0.0);
+	data.outputValue(numShells).set(shellCount);
+
+	data.setClean(shellSurfaceArea);
+	data.setClean(shellUVArea);
+	data.setClean(shellRatio);
+	data.setClean(surfaceArea);
+	data.setClean(uvArea);
+	data.setClean(ratio);
+	data.setClean(numShells);
+
+	return MS::kSuccess;
+}
+
+bool
+UVTexelDensityNode::IsSameTopology(const MeshFaceData& faceData, const MString& uvSet) const
+{
+	return (uvSet == m_uvSet &&
+			faceData.unitScale == m_faceData.unitScale &&
+			faceData.points.length() == m_faceData.points.length() &&
+			IsEqual(faceData.faceVertexCounts, m_faceData.faceVertexCounts) &&
+			IsEqual(faceData.vertexIds, m_faceData.vertexIds) &&
+			IsEqual(faceData.uvCounts, m_faceData.uvCounts) &&
+			IsEqual(faceData.uvIds, m_faceData.uvIds));
+}
+
+// Measures every face and works out the shells and adjacency again
+void
+UVTexelDensityNode::Rebuild(const MFnMesh& mesh, const MString& uvSet, const MeshFaceData& faceData, const MFloatArray& uArray, const MFloatArray& vArray)
+{
+	m_isValid = false;
+	m_uvSet = uvSet;
+	m_faceData = faceData;
+	m_uArray.copy(uArray);
+	m_vArray.copy(vArray);
+
+	if (!m_faceData.BuildTriangles(mesh))
+		return;
+
+	// The shell of a face is the shell of its first UV
+	MIntArray uvShellIds;
+	unsigned int shellCount = 0;
+	if (mesh.getUvShellsIds(uvShellIds, shellCount, &uvSet) != MS::kSuccess)
+		return;
+	m_numShells = (int)shellCount;
+
+	uint numFaces = m_faceData.faceVertexCounts.length();
+	m_faceShells.setLength(numFaces);
+	for (uint i = 0; i < numFaces; i++)
+	{
+		m_faceShells[i] = -1;
+		if (m_faceData.uvCounts[i] > 0)
+		{
+			m_faceShells[i] = uvShellIds[m_faceData.uvIds[m_faceData.uvOffsets[i]]];
+		}
+	}
+
+	BuildAdjacency();
+
+	m_faceSurfaceArea.assign(numFaces, 0.0);
+	m_faceUVArea.assign(numFaces, 0.0);
+	for (uint i = 0; i < numFaces; i++)
+	{
+		MeasureFace((int)i);
+	}
+
+	m_isValid = true;
+}
+
+// The topology hasn't changed, so only the faces around moved points and UVs are measured
+void
+UVTexelDensityNode::Update(const MeshFaceData& faceData, const MFloatArray& uArray, const MFloatArray& vArray)
+{
+	uint numFaces = m_faceData.faceVertexCounts.length();
+	std::vector<char> isDirty(numFaces, 0);
+
+	uint numPoints = faceData.points.length();
+	for (uint i = 0; i < numPoints; i++)
+	{
+		const MPoint& a = faceData.points[i];
+		const MPoint& b = m_faceData.points[i];
+		if (a.x != b.x || a.y != b.y || a.z != b.z)
+		{
+			m_faceData.points[i] = a;
+			for (int j = m_vertexFaceOffsets[i]; j < m_vertexFaceOffsets[i + 1]; j++)
+			{
+				isDirty[m_vertexFaces[j]] = 1;
+			}
+		}
+	}
+
+	// UVs that no face uses may have been added or removed
+	uint numUVs = uArray.length();
+	if (numUVs != m_uArray.length())
+	{
+		m_uArray.setLength(numUVs);
+		m_vArray.setLength(numUVs);
+		BuildElementFaces(m_faceData.uvCounts, m_faceData.uvIds, (int)numUVs, m_uvFaceOffsets, m_uvFaces);
+	}
+	for (uint i = 0; i < numUVs; i++)
+	{
+		if (uArray[i] != m_uArray[i] || vArray[i] != m_vArray[i])
+		{
+			m_uArray[i] = uArray[i];
+			m_vArray[i] = vArray[i];
+			for (int j = m_uvFaceOffsets[i]; j < m_uvFaceOffsets[i + 1]; j++)
+			{
+				isDirty[m_uvFaces[j]] = 1;
+			}
+		}
+	}
+
+	for (uint i = 0; i < numFaces; i++)
+	{
+		if (isDirty[i])
+		{
+			MeasureFace((int)i);
+		}
+	}
+}
+
+void
+UVTexelDensityNode::BuildAdjacency()
+{
+	BuildElementFaces(m_faceData.faceVertexCounts, m_faceData.vertexIds, (int)m_faceData.points.length(), m_vertexFaceOffsets, m_vertexFaces);
+	BuildElementFaces(m_faceData.uvCounts, m_faceData.uvIds, (int)m_uArray.length(), m_uvFaceOffsets, m_uvFaces);
+}
+
+void
+UVTexelDensityNode::MeasureFace(int face)
+{
+	GetFaceAreas(m_faceData, m_uArray, m_vArray, face, m_faceSurfaceArea[face], m_faceUVArea[face]);
+}
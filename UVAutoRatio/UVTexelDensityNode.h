@@ -0,0 +1,75 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef UVTEXELDENSITYNODE_H
+#define UVTEXELDENSITYNODE_H
+
+#include <vector>
+#include "Utility.h"
+
+// Outputs the surface area, UV area and ratio of every UV shell of the input mesh.
+// The areas of each face are cached, and when only points or UVs change just the
+// faces using them are measured again. Areas are in the space of the input mesh,
+// so connect worldMesh rather than outMesh to measure in world space.
+class UVTexelDensityNode : public MPxNode
+{
+public:
+	UVTexelDensityNode();
+	virtual ~UVTexelDensityNode();
+
+	MStatus			compute(const MPlug& plug, MDataBlock& data);
+
+	static void*	creator();
+	static MStatus	initialize();
+
+	static const MTypeId	typeId;
+	static const MString	typeName;
+
+	// Inputs
+	static MObject	inMesh;
+	static MObject	uvSetName;
+
+	// Outputs
+	static MObject	shellSurfaceArea;
+	static MObject	shellUVArea;
+	static MObject	shellRatio;
+	static MObject	surfaceArea;
+	static MObject	uvArea;
+	static MObject	ratio;
+	static MObject	numShells;
+
+private:
+	void			Rebuild(const MFnMesh& mesh, const MString& uvSet, const MeshFaceData& faceData, const MFloatArray& uArray, const MFloatArray& vArray);
+	void			Update(const MeshFaceData& faceData, const MFloatArray& uArray, const MFloatArray& vArray);
+	bool			IsSameTopology(const MeshFaceData& faceData, const MString& uvSet) const;
+	void			BuildAdjacency();
+	void			MeasureFace(int face);
+
+	bool				m_isValid;
+	MString				m_uvSet;
+	MeshFaceData		m_faceData;
+	MFloatArray			m_uArray, m_vArray;
+
+	// Which shell each face belongs to, -1 for unmapped faces
+	MIntArray			m_faceShells;
+	int					m_numShells;
+
+	std::vector<double>	m_faceSurfaceArea;
+	std::vector<double>	m_faceUVArea;
+
+	// Faces using each vertex and each UV, as offsets into a flat list
+	std::vector<int>	m_vertexFaceOffsets, m_vertexFaces;
+	std::vector<int>	m_uvFaceOffsets, m_uvFaces;
+};
+
+#endif
@@ -0,0 +1,429 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include <algorithm>
+#include "ThreadUtility.h"
+#include "UVTriangleBVH.h"
+
+// Triangles tested against the tree per thread pool task
+static const int TriangleGrainSize = 1024;
+
+struct UVTriangleBVH::CentroidLess
+{
+	int axis;
+
+	bool operator () (const Triangle& a, const Triangle& b) const
+	{
+		if (axis == 0)
+			return (a.minU + a.maxU) < (b.minU + b.maxU);
+		return (a.minV + a.maxV) < (b.minV + b.maxV);
+	}
+};
+
+static bool
+OverlapLess(const UVOverlap& a, const UVOverlap& b)
+{
+	if (a.ownerA != b.ownerA)
+		return a.ownerA < b.ownerA;
+	return a.ownerB < b.ownerB;
+}
+
+// Sorts by owner pair and sums the areas of repeated pairs
+static void
+MergeOverlaps(std::vector<UVOverlap>& overlaps)
+{
+	if (overlaps.empty())
+		return;
+
+	std::sort(overlaps.begin(), overlaps.end(), OverlapLess);
+	size_t last = 0;
+	for (size_t i = 1; i < overlaps.size(); i++)
+	{
+		if (overlaps[i].ownerA == overlaps[last].ownerA && overlaps[i].ownerB == overlaps[last].ownerB)
+		{
+			overlaps[last].area += overlaps[i].area;
+		}
+		else
+		{
+			overlaps[++last] = overlaps[i];
+		}
+	}
+	overlaps.resize(last + 1);
+}
+
+UVTriangleBVH::UVTriangleBVH()
+{
+}
+
+void
+UVTriangleBVH::Clear()
+{
+	m_triangles.clear();
+	m_nodes.clear();
+}
+
+void
+UVTriangleBVH::AddTriangle(const float2& a, const float2& b, const float2& c, int owner)
+{
+	Triangle t;
+	t.u[0] = a[0]; t.v[0] = a[1];
+	t.u[1] = b[0]; t.v[1] = b[1];
+	t.u[2] = c[0]; t.v[2] = c[1];
+	t.minU = std::min(t.u[0], std::min(t.u[1], t.u[2]));
+	t.maxU = std::max(t.u[0], std::max(t.u[1], t.u[2]));
+	t.minV = std::min(t.v[0], std::min(t.v[1], t.v[2]));
+	t.maxV = std::max(t.v[0], std::max(t.v[1], t.v[2]));
+	t.owner = owner;
+	m_triangles.push_back(t);
+}
+
+int
+UVTriangleBVH::GetNumTriangles() const
+{
+	return (int)m_triangles.size();
+}
+
+bool
+UVTriangleBVH::IsEmpty() const
+{
+	return m_triangles.empty();
+}
+
+// Triangles are in build order, not the order they were added in
+void
+UVTriangleBVH::GetTriangle(int index, double u[3], double v[3]) const
+{
+	const Triangle& t = m_triangles[index];
+	for (int k = 0; k < 3; k++)
+	{
+		u[k] = t.u[k];
+		v[k] = t.v[k];
+	}
+}
+
+void
+UVTriangleBVH::Build()
+{
+	m_nodes.clear();
+	if (m_triangles.empty())
+		return;
+
+	m_nodes.reserve(2 * (m_triangles.size() / MaxLeafTriangles + 1));
+	m_nodes.push_back(Node());
+	BuildNode(0, 0, (int)m_triangles.size());
+}
+
+void
+UVTriangleBVH::BuildNode(int nodeIndex, int first, int count)
+{
+	Node node;
+	node.minU = node.minV = FLT_MAX;
+	node.maxU = node.maxV = -FLT_MAX;
+	for (int i = first; i < first + count; i++)
+	{
+		const Triangle& t = m_triangles[i];
+		node.minU = std::min(node.minU, t.minU);
+		node.minV = std::min(node.minV, t.minV);
+		node.maxU = std::max(node.maxU, t.maxU);
+		node.maxV = std::max(node.maxV, t.maxV);
+	}
+	node.first = first;
+	node.count = count;
+	node.child = -1;
+
+	if (count > MaxLeafTriangles)
+	{
+		// Split at the median centroid along the longest side
+		CentroidLess less;
+		less.axis = ((node.maxU - node.minU) >= (node.maxV - node.minV)) ? 0 : 1;
+		int half = count / 2;
+		std::nth_element(m_triangles.begin() + first, m_triangles.begin() + first + half, m_triangles.begin() + first + count, less);
+
+		node.count = 0;
+		node.child = (int)m_nodes.size();
+		m_nodes.push_back(Node());
+		m_nodes.push_back(Node());
+		m_nodes[nodeIndex] = node;
+
+		BuildNode(node.child, first, half);
+		BuildNode(node.child + 1, first + half, count - half);
+		return;
+	}
+
+	m_nodes[nodeIndex] = node;
+}
+
+void
+UVTriangleBVH::Scale(double scaleU, double scaleV)
+{
+	float su = (float)scaleU;
+	float sv = (float)scaleV;
+	for (size_t i = 0; i < m_triangles.size(); i++)
+	{
+		Triangle& t = m_triangles[i];
+		for (int k = 0; k < 3; k++)
+		{
+			t.u[k] *= su;
+			t.v[k] *= sv;
+		}
+		t.minU *= su; t.maxU *= su;
+		t.minV *= sv; t.maxV *= sv;
+	}
+	for (size_t i = 0; i < m_nodes.size(); i++)
+	{
+		Node& node = m_nodes[i];
+		node.minU *= su; node.maxU *= su;
+		node.minV *= sv; node.maxV *= sv;
+	}
+}
+
+bool
+UVTriangleBVH::Intersects(const UVTriangleBVH& other, double offsetU, double offsetV, double margin) const
+{
+	if (m_nodes.empty() || other.m_nodes.empty())
+		return false;
+
+	std::vector<std::pair<int, int> > stack;
+	stack.push_back(std::make_pair(0, 0));
+	while (!stack.empty())
+	{
+		const Node& a = m_nodes[stack.back().first];
+		const Node& b = other.m_nodes[stack.back().second];
+		int indexA = stack.back().first;
+		int indexB = stack.back().second;
+		stack.pop_back();
+
+		if (a.maxU + margin <= b.minU + offsetU || b.maxU + offsetU + margin <= a.minU ||
+			a.maxV + margin <= b.minV + offsetV || b.maxV + offsetV + margin <= a.minV)
+			continue;
+
+		bool isLeafA = (a.child < 0);
+		bool isLeafB = (b.child < 0);
+		if (isLeafA && isLeafB)
+		{
+			for (int i = a.first; i < a.first + a.count; i++)
+			{
+				for (int j = b.first; j < b.first + b.count; j++)
+				{
+					if (TrianglesIntersect(m_triangles[i], other.m_triangles[j], offsetU, offsetV, margin))
+						return true;
+				}
+			}
+		}
+		else if (isLeafB || (!isLeafA && (a.maxU - a.minU) * (a.maxV - a.minV) >= (b.maxU - b.minU) * (b.maxV - b.minV)))
+		{
+			stack.push_back(std::make_pair(a.child, indexB));
+			stack.push_back(std::make_pair(a.child + 1, indexB));
+		}
+		else
+		{
+			stack.push_back(std::make_pair(indexA, b.child));
+			stack.push_back(std::make_pair(indexA, b.child + 1));
+		}
+	}
+	return false;
+}
+
+// Separating axis test using the edge normals of both triangles
+bool
+UVTriangleBVH::TrianglesIntersect(const Triangle& a, const Triangle& b, double offsetU, double offsetV, double margin)
+{
+	double au[3], av[3], bu[3], bv[3];
+	for (int k = 0; k < 3; k++)
+	{
+		au[k] = a.u[k];
+		av[k] = a.v[k];
+		bu[k] = b.u[k] + offsetU;
+		bv[k] = b.v[k] + offsetV;
+	}
+
+	for (int edge = 0; edge < 6; edge++)
+	{
+		const double* eu = (edge < 3) ? au : bu;
+		const double* ev = (edge < 3) ? av : bv;
+		int k0 = edge % 3;
+		int k1 = (k0 + 1) % 3;
+		double nu = -(ev[k1] - ev[k0]);
+		double nv = eu[k1] - eu[k0];
+		double length = sqrt(nu * nu + nv * nv);
+		if (length <= 0.0)
+			continue;
+		nu /= length;
+		nv /= length;
+
+		double minA = DBL_MAX, maxA = -DBL_MAX, minB = DBL_MAX, maxB = -DBL_MAX;
+		for (int k = 0; k < 3; k++)
+		{
+			double pa = au[k] * nu + av[k] * nv;
+			double pb = bu[k] * nu + bv[k] * nv;
+			minA = std::min(minA, pa);
+			maxA = std::max(maxA, pa);
+			minB = std::min(minB, pb);
+			maxB = std::max(maxB, pb);
+		}
+
+		if (maxA + margin <= minB || maxB + margin <= minA)
+			return false;
+	}
+	return true;
+}
+
+// Area of the intersection of two triangles, by clipping a against the edges of b
+double
+UVTriangleBVH::GetOverlapArea(const Triangle& a, const Triangle& b)
+{
+	double polygonU[9], polygonV[9];
+	int numPoints = 3;
+	for (int k = 0; k < 3; k++)
+	{
+		polygonU[k] = a.u[k];
+		polygonV[k] = a.v[k];
+	}
+
+	// Clip to the inside of b whichever way round it is wound
+	double winding = (b.u[1] - b.u[0]) * (b.v[2] - b.v[0]) - (b.u[2] - b.u[0]) * (b.v[1] - b.v[0]);
+	if (winding == 0.0)
+		return 0.0;
+	double sign = (winding > 0.0) ? 1.0 : -1.0;
+
+	for (int edge = 0; edge < 3 && numPoints > 0; edge++)
+	{
+		double u0 = b.u[edge], v0 = b.v[edge];
+		double eu = b.u[(edge + 1) % 3] - u0;
+		double ev = b.v[(edge + 1) % 3] - v0;
+
+		double clippedU[9], clippedV[9];
+		int numClipped = 0;
+		for (int i = 0; i < numPoints; i++)
+		{
+			int j = (i + 1) % numPoints;
+			double di = sign * (eu * (polygonV[i] - v0) - ev * (polygonU[i] - u0));
+			double dj = sign * (eu * (polygonV[j] - v0) - ev * (polygonU[j] - u0));
+
+			if (di >= 0.0)
+			{
+				clippedU[numClipped] = polygonU[i];
+				clippedV[numClipped] = polygonV[i];
+				numClipped++;
+			}
+			if ((di >= 0.0) != (dj >= 0.0) && numClipped < 9)
+			{
+				double t = di / (di - dj);
+				clippedU[numClipped] = polygonU[i] + (polygonU[j] - polygonU[i]) * t;
+				clippedV[numClipped] = polygonV[i] + (polygonV[j] - polygonV[i]) * t;
+				numClipped++;
+			}
+		}
+
+		numPoints = numClipped;
+		for (int i = 0; i < numPoints; i++)
+		{
+			polygonU[i] = clippedU[i];
+			polygonV[i] = clippedV[i];
+		}
+	}
+
+	double area = 0.0;
+	for (int i = 0; i < numPoints; i++)
+	{
+		int j = (i + 1) % numPoints;
+		area += polygonU[i] * polygonV[j] - polygonU[j] * polygonV[i];
+	}
+	return fabs(area) * 0.5;
+}
+
+// Overlaps of one triangle with the triangles of owners after its own, so each pair is only found once
+void
+UVTriangleBVH::FindTriangleOverlaps(int triangleIndex, std::vector<UVOverlap>& overlaps) const
+{
+	const Triangle& t = m_triangles[triangleIndex];
+
+	std::vector<int> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.maxU <= t.minU || t.maxU <= node.minU || node.maxV <= t.minV || t.maxV <= node.minV)
+			continue;
+
+		if (node.child >= 0)
+		{
+			stack.push_back(node.child);
+			stack.push_back(node.child + 1);
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			const Triangle& other = m_triangles[i];
+			if (other.owner <= t.owner)
+				continue;
+			if (other.maxU <= t.minU || t.maxU <= other.minU || other.maxV <= t.minV || t.maxV <= other.minV)
+				continue;
+
+			double area = GetOverlapArea(t, other);
+			if (area > 0.0)
+			{
+				UVOverlap overlap;
+				overlap.ownerA = t.owner;
+				overlap.ownerB = other.owner;
+				overlap.area = area;
+				overlaps.push_back(overlap);
+			}
+		}
+	}
+}
+
+// Shared with the thread pool tasks, every range of triangles has its own list of overlaps
+struct FindOverlapsData
+{
+	const UVTriangleBVH*					tree;
+	std::vector<std::vector<UVOverlap> >*	rangeOverlaps;
+};
+
+void
+UVTriangleBVH::FindOverlapsRange(void* data, int begin, int end)
+{
+	FindOverlapsData& find = *(FindOverlapsData*)data;
+	std::vector<UVOverlap>& overlaps = (*find.rangeOverlaps)[begin / TriangleGrainSize];
+	for (int i = begin; i < end; i++)
+	{
+		find.tree->FindTriangleOverlaps(i, overlaps);
+	}
+	MergeOverlaps(overlaps);
+}
+
+void
+UVTriangleBVH::FindOverlaps(std::vector<UVOverlap>& overlaps) const
+{
+	overlaps.clear();
+	if (m_nodes.empty())
+		return;
+
+	int numTriangles = (int)m_triangles.size();
+	std::vector<std::vector<UVOverlap> > rangeOverlaps((numTriangles + TriangleGrainSize - 1) / TriangleGrainSize);
+
+	FindOverlapsData find;
+	find.tree = this;
+	find.rangeOverlaps = &rangeOverlaps;
+	ParallelFor(numTriangles, TriangleGrainSize, FindOverlapsRange, &find);
+
+	for (size_t i = 0; i < rangeOverlaps.size(); i++)
+	{
+		overlaps.insert(overlaps.end(), rangeOverlaps[i].begin(), rangeOverlaps[i].end());
+	}
+	MergeOverlaps(overlaps);
+}
@@ -0,0 +1,87 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef UVTRIANGLEBVH_H
+#define UVTRIANGLEBVH_H
+
+#include <vector>
+
+// Triangles of two different owners (usually UV shells) that overlap, and by how much
+struct UVOverlap
+{
+	int		ownerA, ownerB;
+	double	area;
+};
+
+// Bounding volume hierarchy over UV triangles.  Each triangle is tagged with
+// an owner, so that overlaps are only reported between different shells.
+// Built by splitting at the median of the longest axis, so O(n log n).
+// Once built it is only read, so it can be queried from several threads.
+class UVTriangleBVH
+{
+public:
+	UVTriangleBVH();
+
+	void	Clear();
+	void	AddTriangle(const float2& a, const float2& b, const float2& c, int owner);
+	void	Build();
+
+	// Scales every triangle about the origin, the tree stays valid for positive scales
+	void	Scale(double scaleU, double scaleV);
+
+	int		GetNumTriangles() const;
+	bool	IsEmpty() const;
+	void	GetTriangle(int index, double u[3], double v[3]) const;
+
+	// Whether any triangle of this tree and any triangle of the other tree,
+	// moved by the offset, are closer than margin.  Touching doesn't count.
+	bool	Intersects(const UVTriangleBVH& other, double offsetU, double offsetV, double margin) const;
+
+	// Every pair of owners with overlapping triangles, with the overlapping area
+	void	FindOverlaps(std::vector<UVOverlap>& overlaps) const;
+
+private:
+	struct Triangle
+	{
+		float	u[3], v[3];
+		float	minU, minV, maxU, maxV;
+		int		owner;
+	};
+
+	// Leaves have a count of triangles, other nodes have two children starting at child
+	struct Node
+	{
+		float	minU, minV, maxU, maxV;
+		int		first, count;
+		int		child;
+	};
+
+	struct CentroidLess;
+
+	enum
+	{
+		MaxLeafTriangles = 4,
+	};
+
+	void	BuildNode(int nodeIndex, int first, int count);
+	void	FindTriangleOverlaps(int triangleIndex, std::vector<UVOverlap>& overlaps) const;
+
+	static bool		TrianglesIntersect(const Triangle& a, const Triangle& b, double offsetU, double offsetV, double margin);
+	static double	GetOverlapArea(const Triangle& a, const Triangle& b);
+	static void		FindOverlapsRange(void* data, int begin, int end);
+
+	std::vector<Triangle>	m_triangles;
+	std::vector<Node>		m_nodes;
+};
+
+#endif
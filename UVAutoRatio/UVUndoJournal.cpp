@@ -0,0 +1,131 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#include "MayaPCH.h"
+#include "UVUndoJournal.h"
+
+UVUndoJournal::UVUndoJournal()
+{
+	m_entries.reserve(128);
+}
+
+UVUndoJournal::~UVUndoJournal()
+{
+	Clear();
+}
+
+void
+UVUndoJournal::Clear()
+{
+	std::vector<Entry*>::reverse_iterator riter;
+	for ( riter = m_entries.rbegin(); riter != m_entries.rend(); ++riter )
+	{
+		delete (*riter);
+	}
+	m_entries.clear();
+}
+
+bool
+UVUndoJournal::IsEmpty() const
+{
+	return m_entries.empty();
+}
+
+void
+UVUndoJournal::Record(const MDagPath& dagPath, const MString& uvSetName,
+					  const MFloatArray& originalU, const MFloatArray& originalV,
+					  const MFloatArray& finalU, const MFloatArray& finalV)
+{
+	assert(originalU.length() == finalU.length() && originalV.length() == finalV.length());
+
+	Entry* entry = new Entry;
+	entry->dagPath = dagPath;
+	entry->uvSetName = uvSetName;
+	entry->originalU.copy(originalU);
+	entry->originalV.copy(originalV);
+
+	// Delta encode the final state, shells that weren't touched cost nothing
+	uint numUVs = finalU.length();
+	for (uint i = 0; i < numUVs; i++)
+	{
+		if (finalU[i] != originalU[i] || finalV[i] != originalV[i])
+		{
+			entry->changedIndices.append((int)i);
+			entry->changedU.append(finalU[i]);
+			entry->changedV.append(finalV[i]);
+		}
+	}
+
+	m_entries.push_back(entry);
+}
+
+MStatus
+UVUndoJournal::Undo()
+{
+	MStatus result = MS::kSuccess;
+
+	std::vector<Entry*>::reverse_iterator riter;
+	for ( riter = m_entries.rbegin(); riter != m_entries.rend(); ++riter )
+	{
+		Entry& entry = *(*riter);
+
+		MStatus status;
+		MFnMesh mesh(entry.dagPath, &status);
+		if (status == MS::kSuccess)
+		{
+			status = mesh.setUVs(entry.originalU, entry.originalV, &entry.uvSetName);
+		}
+		if (status != MS::kSuccess)
+		{
+			result = status;
+		}
+	}
+
+	return result;
+}
+
+MStatus
+UVUndoJournal::Redo()
+{
+	MStatus result = MS::kSuccess;
+
+	for (uint i = 0; i < m_entries.size(); i++)
+	{
+		Entry& entry = *m_entries[i];
+
+		MStatus status;
+		MFnMesh mesh(entry.dagPath, &status);
+		if (status == MS::kSuccess)
+		{
+			MFloatArray uArray, vArray;
+			uArray.copy(entry.originalU);
+			vArray.copy(entry.originalV);
+
+			uint numChanged = entry.changedIndices.length();
+			for (uint j = 0; j < numChanged; j++)
+			{
+				uint index = (uint)entry.changedIndices[j];
+				uArray[index] = entry.changedU[j];
+				vArray[index] = entry.changedV[j];
+			}
+
+			status = mesh.setUVs(uArray, vArray, &entry.uvSetName);
+		}
+		if (status != MS::kSuccess)
+		{
+			result = status;
+		}
+	}
+
+	return result;
+}
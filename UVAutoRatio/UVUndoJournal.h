@@ -0,0 +1,49 @@
+//
+// UVAutoRatio Maya Plugin Source Code
+// Copyright (C) 2007-2014 RenderHeads Ltd.
+//
+// This source is available for distribution and/or modification
+// only under the terms of the MIT license.  All rights reserved.
+//
+// The source is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// FITNESS FOR A PARTICULAR PURPOSE. See the MIT license
+// for more details.
+//
+
+#ifndef UVUNDOJOURNAL_H
+#define UVUNDOJOURNAL_H
+
+#include <vector>
+
+// Records the UVs of each mesh written by the command so that undo and redo
+// are a single setUVs per mesh, instead of replaying a modifier per shell.
+// The original UVs are kept in full, the final UVs only as the values that changed.
+class UVUndoJournal
+{
+public:
+	UVUndoJournal();
+	~UVUndoJournal();
+
+	void		Record(const MDagPath& dagPath, const MString& uvSetName,
+						const MFloatArray& originalU, const MFloatArray& originalV,
+						const MFloatArray& finalU, const MFloatArray& finalV);
+	MStatus		Undo();
+	MStatus		Redo();
+	void		Clear();
+	bool		IsEmpty() const;
+
+private:
+	struct Entry
+	{
+		MDagPath	dagPath;
+		MString		uvSetName;
+		MFloatArray	originalU, originalV;
+		MIntArray	changedIndices;
+		MFloatArray	changedU, changedV;
+	};
+
+	std::vector<Entry*>	m_entries;
+};
+
+#endif
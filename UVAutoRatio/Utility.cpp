@@ -13,6 +13,7 @@
 
 #include "MayaPCH.h"
 #include "Utility.h"
+#include "UVKernels.h"
 
 double
 GetAreaMeshSurface(const MDagPath& meshDagPath, bool isWorldSpace)
@@ -251,17 +252,7 @@ GetMinMaxValues(const MFloatArray& values, double& mmin, double& mmax)
 	low = FLT_MAX;
 	hi = -FLT_MAX;
 
-	uint numSamples = values.length();
-	for (uint i = 0; i < numSamples; i++)
-	{
-#ifdef WIN32
-		low = min(low, values[i]);
-		hi = max(hi, values[i]);
-#else
-		low = std::min(low, values[i]);
-		hi = std::max(hi, values[i]);
-#endif
-	}
+	KernelMinMax(GetFloatArrayData(values), (int)values.length(), low, hi);
 
 	mmin = low;
 	mmax = hi;
@@ -274,21 +265,13 @@ GetMinMaxValues(const MFloatArray& values, const int* indices, int numIndices, d
 	low = FLT_MAX;
 	hi = -FLT_MAX;
 
-	uint numSamples = (uint)numIndices;
-	for (uint i = 0; i < numSamples; i++)
+	for (int i = 0; i < numIndices; i++)
 	{
-		int index = indices[i];
-		assert(index >= 0 && index < (int)values.length());
-
-#ifdef WIN32
-		low = min(low, values[index]);
-		hi = max(hi, values[index]);
-#else
-		low = std::min(low, values[index]);
-		hi = std::max(hi, values[index]);
-#endif
+		assert(indices[i] >= 0 && indices[i] < (int)values.length());
 	}
 
+	KernelMinMaxIndexed(GetFloatArrayData(values), indices, numIndices, low, hi);
+
 	mmin = low;
 	mmax = hi;
 }
@@ -494,3 +477,192 @@ FindUVSet(const MFnMesh& mesh, bool overrideUVSet, bool fallbackToCurrentAllowed
 	return result;
 }
 
+MeshFaceData::MeshFaceData()
+{
+	unitScale = 1.0;
+}
+
+bool
+MeshFaceData::Build(const MFnMesh& mesh, const MString* uvSetName, MSpace::Space space)
+{
+	MStatus status;
+
+	Clear();
+
+	status = mesh.getVertices(faceVertexCounts, vertexIds);
+	if (status != MS::kSuccess)
+		return false;
+
+	status = mesh.getAssignedUVs(uvCounts, uvIds, uvSetName);
+	if (status != MS::kSuccess)
+		return false;
+
+	status = mesh.getPoints(points, space);
+	if (status != MS::kSuccess)
+		return false;
+
+	// MDistance reads the scene's units, which isn't safe away from the main thread
+	unitScale = MDistance::internalToUI(1.0);
+
+	uint numFaces = faceVertexCounts.length();
+	if (uvCounts.length() != numFaces)
+		return false;
+
+	// Offsets of the first face-vertex of each face, faces without
+	// UVs have no entries in the UV list so they need their own offsets
+	faceVertexOffsets.setLength(numFaces);
+	uvOffsets.setLength(numFaces);
+	int offset = 0, uvOffset = 0;
+	for (uint i = 0; i < numFaces; i++)
+	{
+		faceVertexOffsets[i] = offset;
+		uvOffsets[i] = uvOffset;
+		offset += faceVertexCounts[i];
+		uvOffset += uvCounts[i];
+	}
+
+	return true;
+}
+
+bool
+MeshFaceData::BuildTriangles(const MFnMesh& mesh)
+{
+	MStatus status;
+
+	status = mesh.getTriangles(triangleCounts, triangleVertices);
+	if (status != MS::kSuccess)
+		return false;
+
+	uint numFaces = triangleCounts.length();
+	if (numFaces != faceVertexCounts.length())
+		return false;
+
+	triangleOffsets.setLength(numFaces);
+	int offset = 0;
+	for (uint i = 0; i < numFaces; i++)
+	{
+		triangleOffsets[i] = offset;
+		offset += triangleCounts[i];
+	}
+
+	return true;
+}
+
+// Surface and UV area of one face, using the same triangles and area
+// functions as GetAreaFacesSurface and GetAreaFacesUV.
+// Needs BuildTriangles, faces that aren't fully mapped have no UV area.
+void
+GetFaceAreas(const MeshFaceData& data, const MFloatArray& uArray, const MFloatArray& vArray, int face, double& surfaceArea, double& uvArea)
+{
+	surfaceArea = GetFaceSurfaceArea(data, data.points, face);
+	uvArea = GetFaceUVArea(data, uArray, vArray, face);
+}
+
+// Only the surface area of one face, the points can come from
+// another evaluation of the mesh as long as its topology is the same.
+// Safe on any thread, the unit scale was read by Build.
+double
+GetFaceSurfaceArea(const MeshFaceData& data, const MPointArray& points, int face)
+{
+	int count = data.faceVertexCounts[face];
+	int vertexOffset = data.faceVertexOffsets[face];
+
+	double surfaceArea = 0.0;
+	int numTriangles = data.triangleCounts[face];
+	int triangleOffset = data.triangleOffsets[face];
+	for (int i = 0; i < numTriangles; i++)
+	{
+		// convert mesh-relative vertex index into polygon-relative
+		int polygonVertexIndex[3] = { 0, 0, 0 };
+		for (int k = 0; k < 3; k++)
+		{
+			int vertex = data.triangleVertices[(triangleOffset + i) * 3 + k];
+			for (int kk = 0; kk < count; kk++)
+			{
+				if (data.vertexIds[vertexOffset + kk] == vertex)
+				{
+					polygonVertexIndex[k] = kk;
+					break;
+				}
+			}
+		}
+
+		const MPoint& a = points[data.vertexIds[vertexOffset + polygonVertexIndex[0]]];
+		const MPoint& b = points[data.vertexIds[vertexOffset + polygonVertexIndex[1]]];
+		const MPoint& c = points[data.vertexIds[vertexOffset + polygonVertexIndex[2]]];
+
+		double la = a.distanceTo(b) * data.unitScale;
+		double lb = a.distanceTo(c) * data.unitScale;
+		double lc = b.distanceTo(c) * data.unitScale;
+		double areaSquared = GetTriangleAreaSquared(la, lb, lc);
+		if (areaSquared > 0.0)
+			surfaceArea += sqrt(areaSquared);
+	}
+	return surfaceArea;
+}
+
+// Only the UV area of one face, for when the surface area is already known
+double
+GetFaceUVArea(const MeshFaceData& data, const MFloatArray& uArray, const MFloatArray& vArray, int face)
+{
+	int count = data.faceVertexCounts[face];
+	if (data.uvCounts[face] != count)
+		return 0.0;
+
+	double uvArea = 0.0;
+	int numTriangles = data.triangleCounts[face];
+	for (int i = 0; i < numTriangles; i++)
+	{
+		int uvIds[3];
+		GetFaceTriangleUVIds(data, face, i, uvIds);
+
+		float2 uv[3];
+		for (int k = 0; k < 3; k++)
+		{
+			uv[k][0] = uArray[uvIds[k]];
+			uv[k][1] = vArray[uvIds[k]];
+		}
+		uvArea += GetTriangleArea2D(uv[0], uv[1], uv[2]);
+	}
+	return uvArea;
+}
+
+// UV ids of the corners of one of Maya's triangles of a fully mapped face
+void
+GetFaceTriangleUVIds(const MeshFaceData& data, int face, int triangle, int uvIds[3])
+{
+	int count = data.faceVertexCounts[face];
+	int vertexOffset = data.faceVertexOffsets[face];
+	int uvOffset = data.uvOffsets[face];
+	int triangleOffset = data.triangleOffsets[face];
+	for (int k = 0; k < 3; k++)
+	{
+		// convert mesh-relative vertex index into polygon-relative
+		int vertex = data.triangleVertices[(triangleOffset + triangle) * 3 + k];
+		int polygonVertexIndex = 0;
+		for (int kk = 0; kk < count; kk++)
+		{
+			if (data.vertexIds[vertexOffset + kk] == vertex)
+			{
+				polygonVertexIndex = kk;
+				break;
+			}
+		}
+		uvIds[k] = data.uvIds[uvOffset + polygonVertexIndex];
+	}
+}
+
+void
+MeshFaceData::Clear()
+{
+	faceVertexCounts.clear();
+	faceVertexOffsets.clear();
+	vertexIds.clear();
+	uvCounts.clear();
+	uvOffsets.clear();
+	uvIds.clear();
+	points.clear();
+	triangleCounts.clear();
+	triangleOffsets.clear();
+	triangleVertices.clear();
+}
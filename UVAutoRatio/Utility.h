@@ -17,6 +17,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string.h>
 
 enum UVSetResult
 {
@@ -30,6 +31,13 @@ double		GetAreaMeshSurface(const MDagPath& meshDagPath, bool isWorldSpace);
 double		GetAreaFacesUV(const MDagPath& dagPath, MObject& component, const MString* uvSetName);
 double		GetAreaFacesSurface(const MDagPath& dagPath, MObject& component, bool isWorldSpace);
 
+// MFloatArray keeps its elements together, but its const [] returns copies
+inline const float*
+GetFloatArrayData(const MFloatArray& values)
+{
+	return values.length() > 0 ? &const_cast<MFloatArray&>(values)[0] : NULL;
+}
+
 void		GetMinMaxValues(const MFloatArray& values, double& mmin, double& mmax);
 void		GetMinMaxValues(const MFloatArray& values, const int* indices, int numIndices, double& mmin, double& mmax);
 
@@ -41,6 +49,98 @@ void		SelectUVSet(std::vector<MDGModifier*>* history, const MString& uvSetName);
 MString		GetCurrentUVSetName(const MFnMesh& mesh);
 UVSetResult	FindUVSet(const MFnMesh& mesh, bool overrideUVSet, bool fallbackToCurrentAllowed, const MString& overrideSetName);
 
+#ifdef WIN32
+typedef unsigned __int64 UVHash;
+typedef __int64 UVHashCell;
+#else
+typedef unsigned long long UVHash;
+typedef long long UVHashCell;
+#endif
+
+// Flat per-face topology of a mesh, read once so that per-shell work
+// can index arrays instead of walking the mesh with iterators
+struct MeshFaceData
+{
+	MIntArray	faceVertexCounts;
+	MIntArray	faceVertexOffsets;
+	MIntArray	vertexIds;
+	MIntArray	uvCounts;
+	MIntArray	uvOffsets;
+	MIntArray	uvIds;
+	MPointArray	points;
+
+	// Internal to UI distance units, read on the main thread by Build
+	// so the faces can be measured on the thread pool
+	double		unitScale;
+
+	// Maya's triangulation of each face, only read by BuildTriangles
+	MIntArray	triangleCounts;
+	MIntArray	triangleOffsets;
+	MIntArray	triangleVertices;
+
+	MeshFaceData();
+
+	bool		Build(const MFnMesh& mesh, const MString* uvSetName, MSpace::Space space = MSpace::kWorld);
+	bool		BuildTriangles(const MFnMesh& mesh);
+	void		Clear();
+};
+
+void		GetFaceAreas(const MeshFaceData& data, const MFloatArray& uArray, const MFloatArray& vArray, int face, double& surfaceArea, double& uvArea);
+double		GetFaceSurfaceArea(const MeshFaceData& data, const MPointArray& points, int face);
+double		GetFaceUVArea(const MeshFaceData& data, const MFloatArray& uArray, const MFloatArray& vArray, int face);
+void		GetFaceTriangleUVIds(const MeshFaceData& data, int face, int triangle, int uvIds[3]);
+
+// FNV-1a hashing, used to identify duplicated shells
+const UVHash UVHashSeed = 14695981039346656037ULL;
+
+inline void
+HashCombine(UVHash& hash, int value)
+{
+	const unsigned char* bytes = (const unsigned char*)&value;
+	for (int i = 0; i < (int)sizeof(value); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+inline void
+HashCombine64(UVHash& hash, UVHash value)
+{
+	for (int i = 0; i < (int)sizeof(value); i++)
+	{
+		hash ^= (value >> (i * 8)) & 0xff;
+		hash *= 1099511628211ULL;
+	}
+}
+
+// A value snapped to a grid, so tiny floating point differences between
+// copies of the same shell don't produce different hashes.  Values too far
+// out for a 64 bit cell, and NaNs, use their bits instead.
+inline UVHash
+QuantizeHash(double value, double resolution)
+{
+	double cell = floor(value / resolution + 0.5);
+	if (fabs(cell) < 4.0e18)
+		return (UVHash)(UVHashCell)cell;
+
+	UVHash bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+// A second hash of the same values with unrelated mixing (splitmix64), so
+// a match of both is needed before two shells are taken to be the same
+inline void
+HashCombineCheck(UVHash& hash, UVHash value)
+{
+	value += 0x9e3779b97f4a7c15ULL;
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	value ^= value >> 31;
+	hash = ((hash << 7) | (hash >> 57)) ^ value;
+}
+
 // Heron 3d Triangle Area algorithm
 // a, b, c are the lengths of the sides of the triangle
 // There are faster algorithms, but this will do for now